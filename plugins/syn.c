@@ -0,0 +1,164 @@
+/*
+ * Scriptable, asynchronous network packet generator/analyzer.
+ *
+ * Copyright (c) 2015, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Example plugin, equivalent to the syn.lua script: it sends out TCP SYN
+ * packets and reports the ports that reply with SYN+ACK. Build with:
+ *
+ *   cc -shared -fPIC -I<pktizr>/src -o syn.so syn.c
+ *
+ * and run with "pktizr -S plugin:./syn.so ...".
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <arpa/inet.h>
+
+#include "pktizr_plugin.h"
+
+#define LOCAL_PORT 64434
+
+#define TCP_SYN 0x02
+#define TCP_RST 0x04
+#define TCP_ACK 0x10
+
+struct syn {
+    const struct pktizr_host *host;
+};
+
+static void *syn_init(const struct pktizr_host *host) {
+    struct syn *s = calloc(1, sizeof(*s));
+    if (s == NULL)
+        return NULL;
+
+    s->host = host;
+
+    return s;
+}
+
+static void syn_fini(void *ctx) {
+    free(ctx);
+}
+
+static int syn_loop(void *ctx, uint32_t addr, uint16_t port, uint16_t sport,
+                    uint8_t *buf, size_t *len, unsigned *flags) {
+    struct syn *s = ctx;
+    uint32_t seq;
+
+    if (*len < 40)
+        return -1;
+
+    if (!sport)
+        sport = LOCAL_PORT;
+
+    seq = s->host->cookie(s->host, s->host->local_addr, addr, sport, port);
+
+    memset(buf, 0, 40);
+
+    /* IPv4 header, length and checksums are filled in by pktizr */
+    buf[0] = 0x45;
+    buf[8] = 64;
+    buf[9] = IPPROTO_TCP;
+    memcpy(buf + 12, &s->host->local_addr, 4);
+    memcpy(buf + 16, &addr, 4);
+
+    /* TCP header */
+    sport = htons(sport);
+    port  = htons(port);
+    seq   = htonl(seq);
+
+    memcpy(buf + 20, &sport, 2);
+    memcpy(buf + 22, &port, 2);
+    memcpy(buf + 24, &seq, 4);
+    buf[32] = 5 << 4;
+    buf[33] = TCP_SYN;
+    buf[34] = 0x04;
+
+    *len   = 40;
+    *flags = PKTIZR_FRAME_FIXUP;
+
+    return 0;
+}
+
+static int syn_recv(void *ctx, const uint8_t *frame, size_t len) {
+    struct syn *s = ctx;
+    const uint8_t *ip, *tcp;
+    uint32_t src, dst, ack;
+    uint16_t sport, dport;
+    char addr[INET_ADDRSTRLEN];
+
+    if ((len < 14 + 20) || (frame[12] != 0x08) || (frame[13] != 0x00))
+        return 0;
+
+    ip = frame + 14;
+    if ((ip[9] != IPPROTO_TCP) || (len < 14 + (ip[0] & 0x0f) * 4 + 20))
+        return 0;
+
+    tcp = ip + (ip[0] & 0x0f) * 4;
+
+    if (!(tcp[13] & TCP_ACK))
+        return 0;
+
+    memcpy(&src, ip + 12, 4);
+    memcpy(&dst, ip + 16, 4);
+    memcpy(&sport, tcp, 2);
+    memcpy(&dport, tcp + 2, 2);
+    memcpy(&ack, tcp + 8, 4);
+
+    sport = ntohs(sport);
+    dport = ntohs(dport);
+
+    if (ntohl(ack) - 1 !=
+        (uint32_t) s->host->cookie(s->host, dst, src, dport, sport))
+        return 0;
+
+    /* don't report closed ports */
+    if (!(tcp[13] & TCP_SYN))
+        return 0;
+
+    inet_ntop(AF_INET, &src, addr, sizeof(addr));
+
+    s->host->print(s->host, "Port %u at %s is open", sport, addr);
+
+    return 1;
+}
+
+const struct pktizr_plugin pktizr_plugin = {
+    .abi  = PKTIZR_PLUGIN_ABI,
+    .name = "syn",
+
+    .init = syn_init,
+    .fini = syn_fini,
+
+    .loop = syn_loop,
+    .recv = syn_recv,
+};
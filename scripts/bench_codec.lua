@@ -0,0 +1,138 @@
+-- This script compares the native DNS and NTP decoders of the codec library
+-- with equivalent pure Lua implementations, using the same inputs. It doesn't
+-- send any packet, and can be run with e.g.:
+--
+--   pktizr -S bench_codec.lua -o -p 1 127.0.0.1
+
+local bin   = require("pktizr.bin")
+local bit   = require("pktizr.bit")
+local codec = require("pktizr.codec")
+local std   = require("pktizr.std")
+
+local iterations = 100000
+
+-- A? example.com. reply with an A and a CNAME answer
+local dns_reply = codec.dns_encode(0x1234, "example.com") ..
+    '\xc0\x0c\x00\x01\x00\x01\x00\x00\x0e\x10\x00\x04\x5d\xb8\xd8\x22' ..
+    '\xc0\x0c\x00\x05\x00\x01\x00\x00\x0e\x10\x00\x06\x03www\xc0\x0c'
+
+dns_reply = dns_reply:sub(1, 2) .. '\x81\x80\x00\x01\x00\x02' ..
+            dns_reply:sub(9)
+
+-- NTPv4 server reply
+local ntp_reply = '\x24\x02\x03\xe8\x00\x00\x00\x10\x00\x00\x00\x20' ..
+    'GPS\x00' .. string.rep('\xe0\x00\x00\x00\x80\x00\x00\x00', 4)
+
+local function lua_dns_name(msg, off)
+    local labels = {}
+    local next_off
+
+    for _ = 1, 16 do
+        local len = msg:byte(off)
+
+        if len >= 0xc0 then
+            next_off = next_off or off + 2
+            off = bit.band(bin.unpack('>H', msg, off), 0x3fff) + 1
+        elseif len == 0 then
+            break
+        else
+            labels[#labels + 1] = msg:sub(off + 1, off + len)
+            off = off + len + 1
+        end
+    end
+
+    return table.concat(labels, '.'), next_off or off + 1
+end
+
+local function lua_dns_decode(msg)
+    local res = {}
+    local flags, qdcount, ancount, nscount, arcount, off
+
+    res.id, flags, qdcount, ancount, nscount, arcount, off =
+        bin.unpack('>HHHHHH', msg)
+
+    res.qr     = bit.rshift(flags, 15) == 1
+    res.opcode = bit.band(bit.rshift(flags, 11), 0x0f)
+    res.rcode  = bit.band(flags, 0x0f)
+
+    res.qname, off = lua_dns_name(msg, off)
+    res.qtype, res.qclass, off = bin.unpack('>HH', msg, off)
+
+    res.answers = {}
+
+    for i = 1, ancount do
+        local an = {}
+        local rdlen
+
+        an.name, off = lua_dns_name(msg, off)
+        an.type, an.class, an.ttl, rdlen, off = bin.unpack('>HHIH', msg, off)
+        an.rdata = msg:sub(off, off + rdlen - 1)
+
+        if an.type == 1 then
+            an.data = string.format('%u.%u.%u.%u', an.rdata:byte(1, 4))
+        elseif an.type == 5 then
+            an.data = lua_dns_name(msg, off)
+        end
+
+        res.answers[i] = an
+        off = off + rdlen
+    end
+
+    return res
+end
+
+local function lua_ntp_time(sec, frac)
+    if sec == 0 and frac == 0 then
+        return 0
+    end
+
+    return sec - 2208988800 + frac / 4294967296
+end
+
+local function lua_ntp_decode(msg)
+    local res = {}
+    local b0, delay, disp
+
+    b0, res.stratum, res.poll, res.precision, delay, disp, res.ref_id =
+        bin.unpack('>BBbbiII', msg)
+
+    res.li      = bit.rshift(b0, 6)
+    res.version = bit.band(bit.rshift(b0, 3), 0x07)
+    res.mode    = bit.band(b0, 0x07)
+
+    res.root_delay      = delay / 65536
+    res.root_dispersion = disp / 65536
+
+    res.ref_time  = lua_ntp_time(bin.unpack('>II', msg, 17))
+    res.orig_time = lua_ntp_time(bin.unpack('>II', msg, 25))
+    res.recv_time = lua_ntp_time(bin.unpack('>II', msg, 33))
+    res.xmit_time = lua_ntp_time(bin.unpack('>II', msg, 41))
+
+    return res
+end
+
+local function bench(name, func, input)
+    local start = os.clock()
+
+    for _ = 1, iterations do
+        func(input)
+    end
+
+    local elapsed = os.clock() - start
+
+    std.print("%-12s %8.3f s %10.0f/s", name, elapsed, iterations / elapsed)
+end
+
+assert(codec.dns_decode(dns_reply).answers[2].data ==
+       lua_dns_decode(dns_reply).answers[2].data)
+assert(codec.ntp_decode(ntp_reply).xmit_time ==
+       lua_ntp_decode(ntp_reply).xmit_time)
+
+bench("dns (lua)",   lua_dns_decode,   dns_reply)
+bench("dns (codec)", codec.dns_decode, dns_reply)
+bench("ntp (lua)",   lua_ntp_decode,   ntp_reply)
+bench("ntp (codec)", codec.ntp_decode, ntp_reply)
+
+function loop(addr, port)
+    return nil
+end
@@ -1,9 +1,9 @@
 -- This script sends out DNS requests for the "example.com" domain, and listens
 -- for matching replies.
 
-local bin = require("pktizr.bin")
-local pkt = require("pktizr.pkt")
-local std = require("pktizr.std")
+local codec = require("pktizr.codec")
+local pkt   = require("pktizr.pkt")
+local std   = require("pktizr.std")
 
 -- template packets
 local local_addr = std.get_addr()
@@ -17,17 +17,13 @@ pkt_udp.sport = local_port
 
 local pkt_dns = pkt.Raw()
 
--- A? example.com. (without initial transaction ID)
-local dns_query = '\x01\x00\x00\x01\x00\x00\x00\x00\x00\x00\x07\x65\x78\x61\x6d\x70\x6c\x65\x03\x63\x6f\x6d\x00\x00\x01\x00\x01'
-local dns_length = string.len(dns_query)
-
 function loop(addr, port)
     pkt_ip4.dst = addr
 
     pkt_udp.dport = port
 
     local seq = pkt.cookie16(local_addr, addr, local_port, port)
-    pkt_dns.payload = bin.pack('>Hc' .. dns_length, seq, dns_query)
+    pkt_dns.payload = codec.dns_encode(seq, "example.com")
 
     return pkt_ip4, pkt_udp, pkt_dns
 end
@@ -49,9 +45,9 @@ function recv(pkts)
 
     local pkt_id = pkt.cookie16(dst, src, dport, sport)
 
-    local dns_id = bin.unpack('>H', pkt_dns.payload)
+    local dns = codec.dns_decode(pkt_dns.payload)
 
-    if pkt_id ~= dns_id then
+    if not dns or not dns.qr or pkt_id ~= dns.id then
         return
     end
 
@@ -0,0 +1,105 @@
+-- This script does the same as http.lua, but it's written as a flow: each TCP
+-- connection is handled by its own coroutine that waits for the next packet
+-- of the connection with std.wait(), instead of re-deriving the state of the
+-- exchange from every single reply.
+--
+-- The same notes about the local system's TCP RST packets that apply to the
+-- http.lua script apply here as well.
+
+local pkt = require("pktizr.pkt")
+local std = require("pktizr.std")
+
+-- template packets
+local local_addr = std.get_addr()
+local local_port = 64434
+
+local pkt_ip4 = pkt.IP()
+pkt_ip4.src = local_addr
+
+local pkt_tcp = pkt.TCP()
+pkt_tcp.sport = local_port
+pkt_tcp.syn   = true
+
+local http_req = "GET / HTTP/1.1\r\n\r\n"
+
+function loop(addr, port)
+    pkt_ip4.dst = addr
+
+    pkt_tcp.dport = port
+    pkt_tcp.seq   = pkt.cookie32(local_addr, addr, local_port, port)
+
+    return pkt_ip4, pkt_tcp
+end
+
+local function reply(addr, port, seq, ack_seq, flags, payload)
+    local ip4 = pkt.IP()
+    ip4.src = local_addr
+    ip4.dst = addr
+
+    local tcp = pkt.TCP()
+    tcp.sport   = local_port
+    tcp.dport   = port
+    tcp.seq     = seq
+    tcp.ack_seq = ack_seq
+    tcp.ack     = flags.ack or false
+    tcp.psh     = flags.psh or false
+    tcp.rst     = flags.rst or false
+
+    if payload then
+        local raw = pkt.Raw()
+        raw.payload = payload
+
+        pkt.send(ip4, tcp, raw)
+    else
+        pkt.send(ip4, tcp)
+    end
+end
+
+function flow(addr, port, pkts)
+    local pkt_tcp = pkts[2]
+
+    if #pkts < 2 or pkt_tcp._type ~= 'tcp' then
+        return
+    end
+
+    local seq = pkt.cookie32(local_addr, addr, local_port, port)
+
+    if not (pkt_tcp.syn and pkt_tcp.ack) or pkt_tcp.ack_seq - 1 ~= seq then
+        return
+    end
+
+    local ack_seq = pkt_tcp.seq + 1
+
+    seq = seq + 1
+
+    reply(addr, port, seq, ack_seq, { ack = true })
+    reply(addr, port, seq, ack_seq, { ack = true, psh = true }, http_req)
+
+    seq = seq + #http_req
+
+    while true do
+        pkts = std.wait(5)
+
+        -- timed out, give up on the connection
+        if pkts == nil then
+            reply(addr, port, seq, 0, { rst = true })
+            return
+        end
+
+        pkt_tcp = pkts[2]
+
+        if pkt_tcp.rst then
+            return
+        end
+
+        if pkt_tcp.psh and #pkts >= 3 then
+            local status = pkts[3].payload:match("HTTP/1.1 %d+[^\r\n]*")
+            if status ~= nil then
+                std.print("HTTP status from %s.%u: %s", addr, port, status)
+            end
+
+            reply(addr, port, seq, 0, { rst = true })
+            return true
+        end
+    end
+end
@@ -1,12 +1,11 @@
 -- This script sends out NTP requests and listens for matching replies.
 
-local bin = require("pktizr.bin")
-local bit = require("pktizr.bit")
-local pkt = require("pktizr.pkt")
-local std = require("pktizr.std")
+local codec = require("pktizr.codec")
+local pkt   = require("pktizr.pkt")
+local std   = require("pktizr.std")
 
--- NTP MONLIST
-local ntp_query = '\x17\x00\x03\x2a\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00'
+-- NTP MONLIST (version 2, private mode, implementation 3, request 42)
+local ntp_query = codec.ntp_encode(2, 7, 3, 42)
 
 -- template packets
 local local_addr = std.get_addr()
@@ -38,24 +37,14 @@ function recv(pkts)
         return
     end
 
-    local vers, impl, code = bin.unpack('>BBB', pkt_ntp.payload)
+    local ntp = codec.ntp_decode(pkt_ntp.payload)
 
-    -- response bit set
-    if bit.rshift(vers, 7) ~= 1 then
-        return
-    end
-
-    -- version is as expected
-    if bit.band(bit.rshift(vers, 3), 0x07) ~= 2 then
-        return
-    end
-  
-    -- mode is as expected
-    if bit.band(vers, 0x07) ~= 7 then
+    -- response with the expected version and mode
+    if not ntp or not ntp.response or ntp.version ~= 2 or ntp.mode ~= 7 then
         return
     end
 
     local fmt = "Received NTP reply from %s.%u: impl=%u, code=%u"
-    std.print(fmt, pkt_ip4.src, pkt_udp.sport, impl, code)
+    std.print(fmt, pkt_ip4.src, pkt_udp.sport, ntp.impl, ntp.code)
     return true
 end
@@ -0,0 +1,52 @@
+-- This script sends protocol-specific UDP probes and listens for replies. The
+-- payloads are taken from the database given with --udp-payloads (see
+-- udp_payloads.txt), and ports without a payload are sent an empty datagram.
+
+local pkt = require("pktizr.pkt")
+local std = require("pktizr.std")
+
+-- template packets
+local local_addr = std.get_addr()
+local local_port = 64434
+
+local pkt_ip4 = pkt.IP()
+pkt_ip4.src = local_addr
+
+local pkt_udp = pkt.UDP()
+pkt_udp.sport = local_port
+
+local pkt_payload = pkt.Raw()
+
+-- sport is only set when pktizr is run with --source-ports
+function loop(addr, port, sport)
+    pkt_ip4.dst = addr
+
+    pkt_udp.sport = sport or local_port
+    pkt_udp.dport = port
+
+    -- the payload is referenced from the database, not copied
+    pkt_payload.payload_db = port
+
+    return pkt_ip4, pkt_udp, pkt_payload
+end
+
+function recv(pkts)
+    local pkt_ip4 = pkts[1]
+    local pkt_udp = pkts[2]
+
+    if #pkts < 2 or pkt_udp._type ~= 'udp' then
+        return
+    end
+
+    local src = pkt_ip4.src
+
+    local sport = pkt_udp.sport
+    local dport = pkt_udp.dport
+
+    if dport ~= (std.source_port(src, sport) or local_port) then
+        return
+    end
+
+    std.print("Received UDP reply from %s.%u", src, sport)
+    return true
+end
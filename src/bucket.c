@@ -69,3 +69,10 @@ void bucket_consume(struct bucket *t) {
 
     return;
 }
+
+void bucket_set_rate(struct bucket *t, uint64_t rate) {
+    t->rate = rate;
+
+    if (t->tokens > rate)
+        t->tokens = rate;
+}
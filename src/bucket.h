@@ -36,3 +36,4 @@ struct bucket {
 
 void bucket_init(struct bucket *t, uint64_t rate);
 void bucket_consume(struct bucket *t);
+void bucket_set_rate(struct bucket *t, uint64_t rate);
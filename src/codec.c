@@ -0,0 +1,785 @@
+/*
+ * Scriptable, asynchronous network packet generator/analyzer.
+ *
+ * Copyright (c) 2015, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Native encoders and decoders for common UDP application protocols, exposed to
+ * scripts as the pktizr.codec library. Decoders work directly on the payload
+ * string and return flat tables, or nil if the payload is malformed.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <arpa/inet.h>
+
+#include <lua.h>
+#include <lualib.h>
+#include <lauxlib.h>
+
+#include "lua-compat-5.3/c-api/compat-5.3.h"
+
+#define DNS_MAX_LEN     512
+#define DNS_MAX_NAME    256
+#define DNS_MAX_ANSWERS 64
+
+#define NTP_LEN         48
+#define NTP_UNIX_EPOCH  2208988800UL
+
+#define SNMP_MAX_LEN    1472
+#define SNMP_MAX_OID    128
+#define SNMP_MAX_VARS   64
+
+static inline uint16_t get16(const uint8_t *p) {
+    return (p[0] << 8) | p[1];
+}
+
+static inline uint32_t get32(const uint8_t *p) {
+    return ((uint32_t) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+#define SET_FIELD(L, NAME, PUSH, VAL)   \
+    do {                                \
+        PUSH(L, VAL);                   \
+        lua_setfield(L, -2, NAME);      \
+    } while (0)
+
+#define SET_NUMBER(NAME, VAL)  SET_FIELD(L, NAME, lua_pushnumber, VAL)
+#define SET_BOOLEAN(NAME, VAL) SET_FIELD(L, NAME, lua_pushboolean, VAL)
+#define SET_STRING(NAME, VAL)  SET_FIELD(L, NAME, lua_pushstring, VAL)
+
+/* DNS */
+
+/* decodes the (possibly compressed) name at *off into out, and advances *off
+ * past it */
+static int dns_name(const uint8_t *msg, size_t len, size_t *off, char *out) {
+    size_t pos = *off, n = 0;
+    size_t jumps = 0;
+    bool jumped = false;
+
+    while (1) {
+        uint8_t l;
+
+        if (pos >= len)
+            return -1;
+
+        l = msg[pos];
+
+        if ((l & 0xc0) == 0xc0) {
+            if ((pos + 1 >= len) || (++jumps > 16))
+                return -1;
+
+            if (!jumped)
+                *off = pos + 2;
+
+            pos    = ((l & 0x3f) << 8) | msg[pos + 1];
+            jumped = true;
+            continue;
+        }
+
+        if (l & 0xc0)
+            return -1;
+
+        pos++;
+
+        if (l == 0)
+            break;
+
+        if ((pos + l > len) || (n + l + 2 > DNS_MAX_NAME))
+            return -1;
+
+        if (n > 0)
+            out[n++] = '.';
+
+        memcpy(out + n, msg + pos, l);
+        n   += l;
+        pos += l;
+    }
+
+    if (!jumped)
+        *off = pos;
+
+    if (n == 0)
+        out[n++] = '.';
+
+    out[n] = '\0';
+
+    return 0;
+}
+
+static int dns_answer(lua_State *L, const uint8_t *msg, size_t len,
+                      size_t *off) {
+    char name[DNS_MAX_NAME];
+    uint16_t type, rdlen;
+    size_t pos;
+
+    if (dns_name(msg, len, off, name) < 0)
+        return -1;
+
+    pos = *off;
+    if (pos + 10 > len)
+        return -1;
+
+    type  = get16(msg + pos);
+    rdlen = get16(msg + pos + 8);
+
+    if (pos + 10 + rdlen > len)
+        return -1;
+
+    lua_createtable(L, 0, 5);
+
+    SET_STRING("name",  name);
+    SET_NUMBER("type",  type);
+    SET_NUMBER("class", get16(msg + pos + 2));
+    SET_NUMBER("ttl",   get32(msg + pos + 4));
+
+    pos += 10;
+
+    switch (type) {
+    case 1:  /* A */
+    case 28: /* AAAA */ {
+        char addr[INET6_ADDRSTRLEN];
+        int af = (type == 1) ? AF_INET : AF_INET6;
+
+        if (rdlen != ((type == 1) ? 4 : 16))
+            break;
+
+        inet_ntop(af, msg + pos, addr, sizeof(addr));
+        SET_STRING("data", addr);
+        break;
+    }
+
+    case 2:  /* NS */
+    case 5:  /* CNAME */
+    case 12: /* PTR */ {
+        size_t name_off = pos;
+
+        if (dns_name(msg, pos + rdlen, &name_off, name) < 0)
+            break;
+
+        SET_STRING("data", name);
+        break;
+    }
+    }
+
+    lua_pushlstring(L, (const char *) msg + pos, rdlen);
+    lua_setfield(L, -2, "rdata");
+
+    *off = pos + rdlen;
+
+    return 0;
+}
+
+static int codec_dns_decode(lua_State *L) {
+    size_t len, off = 12;
+    uint16_t flags, ancount;
+    char name[DNS_MAX_NAME];
+
+    const uint8_t *msg = (const uint8_t *) luaL_checklstring(L, 1, &len);
+
+    if (len < 12)
+        goto invalid;
+
+    flags   = get16(msg + 2);
+    ancount = get16(msg + 6);
+
+    lua_createtable(L, 0, 18);
+
+    SET_NUMBER("id",      get16(msg));
+    SET_BOOLEAN("qr",     flags >> 15);
+    SET_NUMBER("opcode",  (flags >> 11) & 0x0f);
+    SET_BOOLEAN("aa",     (flags >> 10) & 1);
+    SET_BOOLEAN("tc",     (flags >> 9) & 1);
+    SET_BOOLEAN("rd",     (flags >> 8) & 1);
+    SET_BOOLEAN("ra",     (flags >> 7) & 1);
+    SET_NUMBER("rcode",   flags & 0x0f);
+    SET_NUMBER("qdcount", get16(msg + 4));
+    SET_NUMBER("ancount", ancount);
+    SET_NUMBER("nscount", get16(msg + 8));
+    SET_NUMBER("arcount", get16(msg + 10));
+
+    /* only the first question is decoded */
+    if (get16(msg + 4) > 0) {
+        if ((dns_name(msg, len, &off, name) < 0) || (off + 4 > len))
+            goto invalid;
+
+        SET_STRING("qname",  name);
+        SET_NUMBER("qtype",  get16(msg + off));
+        SET_NUMBER("qclass", get16(msg + off + 2));
+
+        off += 4;
+
+        for (int i = 1; i < get16(msg + 4); i++) {
+            if ((dns_name(msg, len, &off, name) < 0) || (off + 4 > len))
+                goto invalid;
+
+            off += 4;
+        }
+    }
+
+    if (ancount > DNS_MAX_ANSWERS)
+        ancount = DNS_MAX_ANSWERS;
+
+    lua_createtable(L, ancount, 0);
+
+    for (int i = 0; i < ancount; i++) {
+        if (dns_answer(L, msg, len, &off) < 0)
+            goto invalid;
+
+        lua_rawseti(L, -2, i + 1);
+    }
+
+    lua_setfield(L, -2, "answers");
+
+    return 1;
+
+invalid:
+    lua_pushnil(L);
+    return 1;
+}
+
+static int codec_dns_encode(lua_State *L) {
+    uint8_t buf[DNS_MAX_LEN];
+    size_t len, n = 12;
+
+    uint16_t id     = luaL_checkinteger(L, 1);
+    const char *qn  = luaL_checklstring(L, 2, &len);
+    uint16_t qtype  = luaL_optinteger(L, 3, 1);
+    bool rd         = lua_isnoneornil(L, 4) ? true : lua_toboolean(L, 4);
+
+    if (len + 2 + 4 + 12 > DNS_MAX_LEN)
+        return luaL_error(L, "Invalid DNS name");
+
+    memset(buf, 0, 12);
+
+    buf[0] = id >> 8;
+    buf[1] = id & 0xff;
+    buf[2] = rd ? 0x01 : 0x00;
+    buf[5] = 1;
+
+    while (*qn != '\0') {
+        const char *dot = strchr(qn, '.');
+        size_t l = dot ? (size_t) (dot - qn) : strlen(qn);
+
+        if ((l == 0) || (l > 63))
+            return luaL_error(L, "Invalid DNS name");
+
+        buf[n++] = l;
+        memcpy(buf + n, qn, l);
+        n += l;
+
+        qn += l;
+        if (*qn == '.')
+            qn++;
+    }
+
+    buf[n++] = 0;
+
+    buf[n++] = qtype >> 8;
+    buf[n++] = qtype & 0xff;
+    buf[n++] = 0;
+    buf[n++] = 1;
+
+    lua_pushlstring(L, (const char *) buf, n);
+    return 1;
+}
+
+/* NTP */
+
+static double ntp_time(const uint8_t *p) {
+    uint32_t sec  = get32(p);
+    uint32_t frac = get32(p + 4);
+
+    if ((sec == 0) && (frac == 0))
+        return 0;
+
+    return (double) sec - NTP_UNIX_EPOCH + (double) frac / 4294967296.0;
+}
+
+static int codec_ntp_decode(lua_State *L) {
+    size_t len;
+    uint8_t mode;
+
+    const uint8_t *msg = (const uint8_t *) luaL_checklstring(L, 1, &len);
+
+    if (len < 8) {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    mode = msg[0] & 0x07;
+
+    /* private mode (e.g. monlist) only shares the first byte */
+    if (mode == 7) {
+        lua_createtable(L, 0, 9);
+
+        SET_BOOLEAN("response", msg[0] >> 7);
+        SET_BOOLEAN("more",     (msg[0] >> 6) & 1);
+        SET_NUMBER("version",   (msg[0] >> 3) & 0x07);
+        SET_NUMBER("mode",      mode);
+        SET_NUMBER("seq",       msg[1] & 0x7f);
+        SET_NUMBER("impl",      msg[2]);
+        SET_NUMBER("code",      msg[3]);
+        SET_NUMBER("err",       msg[4] >> 4);
+        SET_NUMBER("count",     ((msg[4] & 0x0f) << 8) | msg[5]);
+        SET_NUMBER("size",      ((msg[6] & 0x0f) << 8) | msg[7]);
+
+        return 1;
+    }
+
+    if (len < NTP_LEN) {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    lua_createtable(L, 0, 13);
+
+    SET_NUMBER("li",              msg[0] >> 6);
+    SET_NUMBER("version",         (msg[0] >> 3) & 0x07);
+    SET_NUMBER("mode",            mode);
+    SET_NUMBER("stratum",         msg[1]);
+    SET_NUMBER("poll",            (int8_t) msg[2]);
+    SET_NUMBER("precision",       (int8_t) msg[3]);
+    SET_NUMBER("root_delay",      (double) (int32_t) get32(msg + 4) / 65536.0);
+    SET_NUMBER("root_dispersion", (double) get32(msg + 8) / 65536.0);
+    SET_NUMBER("ref_id",          get32(msg + 12));
+    SET_NUMBER("ref_time",        ntp_time(msg + 16));
+    SET_NUMBER("orig_time",       ntp_time(msg + 24));
+    SET_NUMBER("recv_time",       ntp_time(msg + 32));
+    SET_NUMBER("xmit_time",       ntp_time(msg + 40));
+
+    return 1;
+}
+
+static int codec_ntp_encode(lua_State *L) {
+    uint8_t buf[NTP_LEN];
+
+    uint8_t version = luaL_optinteger(L, 1, 4);
+    uint8_t mode    = luaL_optinteger(L, 2, 3);
+
+    if ((version > 7) || (mode > 7))
+        return luaL_error(L, "Invalid NTP version or mode");
+
+    memset(buf, 0, sizeof(buf));
+
+    buf[0] = (version << 3) | mode;
+
+    if (mode == 7) {
+        buf[2] = luaL_checkinteger(L, 3);
+        buf[3] = luaL_checkinteger(L, 4);
+    }
+
+    lua_pushlstring(L, (const char *) buf, sizeof(buf));
+    return 1;
+}
+
+/* SNMP */
+
+enum {
+    BER_INTEGER   = 0x02,
+    BER_OCTETS    = 0x04,
+    BER_NULL      = 0x05,
+    BER_OID       = 0x06,
+    BER_SEQUENCE  = 0x30,
+    BER_IPADDR    = 0x40,
+    BER_COUNTER32 = 0x41,
+    BER_GAUGE32   = 0x42,
+    BER_TIMETICKS = 0x43,
+    BER_COUNTER64 = 0x46,
+    SNMP_GET      = 0xa0,
+};
+
+/* reads the tag and length at *off, and leaves *off at the start of the value */
+static int ber_tlv(const uint8_t *buf, size_t len, size_t *off,
+                   uint8_t *tag, size_t *vlen) {
+    size_t pos = *off;
+
+    if (pos + 2 > len)
+        return -1;
+
+    *tag  = buf[pos++];
+    *vlen = buf[pos++];
+
+    if (*vlen & 0x80) {
+        size_t n = *vlen & 0x7f;
+
+        if ((n == 0) || (n > 2) || (pos + n > len))
+            return -1;
+
+        *vlen = 0;
+
+        while (n--)
+            *vlen = (*vlen << 8) | buf[pos++];
+    }
+
+    if (pos + *vlen > len)
+        return -1;
+
+    *off = pos;
+
+    return 0;
+}
+
+static int ber_expect(const uint8_t *buf, size_t len, size_t *off,
+                      uint8_t tag, size_t *vlen) {
+    uint8_t t;
+
+    if ((ber_tlv(buf, len, off, &t, vlen) < 0) || (t != tag))
+        return -1;
+
+    return 0;
+}
+
+static double ber_int(const uint8_t *buf, size_t len, bool sign) {
+    int64_t v = 0;
+
+    if (len == 0)
+        return 0;
+
+    if (sign && (buf[0] & 0x80))
+        v = -1;
+
+    for (size_t i = 0; i < len && i < 9; i++)
+        v = (int64_t) ((uint64_t) v << 8) | buf[i];
+
+    if (!sign)
+        return (double) (uint64_t) v;
+
+    return (double) v;
+}
+
+static int ber_oid(const uint8_t *buf, size_t len, char *out, size_t size) {
+    size_t n = 0;
+    uint64_t v = 0;
+
+    if (len == 0)
+        return -1;
+
+    n = snprintf(out, size, "%u.%u", buf[0] / 40, buf[0] % 40);
+
+    for (size_t i = 1; i < len; i++) {
+        v = (v << 7) | (buf[i] & 0x7f);
+
+        if (buf[i] & 0x80)
+            continue;
+
+        n += snprintf(out + n, size - n, ".%llu", (unsigned long long) v);
+        if (n >= size)
+            return -1;
+
+        v = 0;
+    }
+
+    return 0;
+}
+
+static int snmp_varbind(lua_State *L, const uint8_t *buf, size_t len,
+                        size_t *off) {
+    uint8_t tag;
+    size_t vlen, end;
+    char oid[SNMP_MAX_OID * 4];
+
+    if (ber_expect(buf, len, off, BER_SEQUENCE, &vlen) < 0)
+        return -1;
+
+    end = *off + vlen;
+
+    if (ber_expect(buf, end, off, BER_OID, &vlen) < 0)
+        return -1;
+
+    if (ber_oid(buf + *off, vlen, oid, sizeof(oid)) < 0)
+        return -1;
+
+    *off += vlen;
+
+    if (ber_tlv(buf, end, off, &tag, &vlen) < 0)
+        return -1;
+
+    lua_createtable(L, 0, 3);
+
+    SET_STRING("oid",  oid);
+    SET_NUMBER("type", tag);
+
+    switch (tag) {
+    case BER_INTEGER:
+        SET_NUMBER("value", ber_int(buf + *off, vlen, true));
+        break;
+
+    case BER_COUNTER32:
+    case BER_GAUGE32:
+    case BER_TIMETICKS:
+    case BER_COUNTER64:
+        SET_NUMBER("value", ber_int(buf + *off, vlen, false));
+        break;
+
+    case BER_OID:
+        if (ber_oid(buf + *off, vlen, oid, sizeof(oid)) == 0)
+            SET_STRING("value", oid);
+        break;
+
+    case BER_IPADDR:
+        if (vlen == 4) {
+            char addr[INET_ADDRSTRLEN];
+
+            inet_ntop(AF_INET, buf + *off, addr, sizeof(addr));
+            SET_STRING("value", addr);
+        }
+        break;
+
+    case BER_OCTETS:
+        lua_pushlstring(L, (const char *) buf + *off, vlen);
+        lua_setfield(L, -2, "value");
+        break;
+    }
+
+    *off = end;
+
+    return 0;
+}
+
+static int codec_snmp_decode(lua_State *L) {
+    size_t len, off = 0, vlen, end;
+    uint8_t pdu;
+
+    const uint8_t *msg = (const uint8_t *) luaL_checklstring(L, 1, &len);
+
+    if (ber_expect(msg, len, &off, BER_SEQUENCE, &vlen) < 0)
+        goto invalid;
+
+    len = off + vlen;
+
+    lua_createtable(L, 0, 7);
+
+    if (ber_expect(msg, len, &off, BER_INTEGER, &vlen) < 0)
+        goto invalid;
+
+    SET_NUMBER("version", ber_int(msg + off, vlen, true));
+    off += vlen;
+
+    if (ber_expect(msg, len, &off, BER_OCTETS, &vlen) < 0)
+        goto invalid;
+
+    lua_pushlstring(L, (const char *) msg + off, vlen);
+    lua_setfield(L, -2, "community");
+    off += vlen;
+
+    if ((ber_tlv(msg, len, &off, &pdu, &vlen) < 0) || ((pdu & 0xe0) != 0xa0))
+        goto invalid;
+
+    SET_NUMBER("pdu", pdu);
+
+    if (ber_expect(msg, len, &off, BER_INTEGER, &vlen) < 0)
+        goto invalid;
+
+    SET_NUMBER("request_id", ber_int(msg + off, vlen, true));
+    off += vlen;
+
+    if (ber_expect(msg, len, &off, BER_INTEGER, &vlen) < 0)
+        goto invalid;
+
+    SET_NUMBER("error_status", ber_int(msg + off, vlen, true));
+    off += vlen;
+
+    if (ber_expect(msg, len, &off, BER_INTEGER, &vlen) < 0)
+        goto invalid;
+
+    SET_NUMBER("error_index", ber_int(msg + off, vlen, true));
+    off += vlen;
+
+    if (ber_expect(msg, len, &off, BER_SEQUENCE, &vlen) < 0)
+        goto invalid;
+
+    end = off + vlen;
+
+    lua_createtable(L, 1, 0);
+
+    for (int i = 1; (off < end) && (i <= SNMP_MAX_VARS); i++) {
+        if (snmp_varbind(L, msg, end, &off) < 0)
+            goto invalid;
+
+        lua_rawseti(L, -2, i);
+    }
+
+    lua_setfield(L, -2, "varbinds");
+
+    return 1;
+
+invalid:
+    lua_pushnil(L);
+    return 1;
+}
+
+/* BER values are encoded back to front, so that the lengths of the nested
+ * values are known when their headers are prepended */
+struct ber_buf {
+    uint8_t buf[SNMP_MAX_LEN];
+    size_t  pos;
+};
+
+static int ber_prepend(struct ber_buf *b, const void *data, size_t len) {
+    if (len > b->pos)
+        return -1;
+
+    b->pos -= len;
+    memcpy(b->buf + b->pos, data, len);
+
+    return 0;
+}
+
+static int ber_header(struct ber_buf *b, uint8_t tag, size_t len) {
+    uint8_t hdr[4];
+    size_t n;
+
+    hdr[0] = tag;
+
+    if (len < 0x80) {
+        hdr[1] = len;
+        n = 2;
+    } else if (len < 0x100) {
+        hdr[1] = 0x81;
+        hdr[2] = len;
+        n = 3;
+    } else {
+        hdr[1] = 0x82;
+        hdr[2] = len >> 8;
+        hdr[3] = len & 0xff;
+        n = 4;
+    }
+
+    return ber_prepend(b, hdr, n);
+}
+
+static int ber_integer(struct ber_buf *b, int64_t v) {
+    uint8_t val[8];
+    size_t n = 0;
+
+    /* minimal two's complement encoding */
+    do {
+        val[7 - n++] = v & 0xff;
+        v >>= 8;
+    } while ((n < 8) && !(((v == 0) && !(val[8 - n] & 0x80)) ||
+                          ((v == -1) && (val[8 - n] & 0x80))));
+
+    if (ber_prepend(b, val + 8 - n, n) < 0)
+        return -1;
+
+    return ber_header(b, BER_INTEGER, n);
+}
+
+static int ber_oid_encode(struct ber_buf *b, const char *oid) {
+    uint32_t arcs[SNMP_MAX_OID];
+    size_t cnt = 0, start = b->pos;
+
+    while (*oid != '\0') {
+        char *end;
+
+        if (cnt >= SNMP_MAX_OID)
+            return -1;
+
+        arcs[cnt++] = strtoul(oid, &end, 10);
+
+        if ((end == oid) || ((*end != '.') && (*end != '\0')))
+            return -1;
+
+        oid = (*end == '.') ? end + 1 : end;
+    }
+
+    if ((cnt < 2) || (arcs[0] > 2) || (arcs[1] >= 40))
+        return -1;
+
+    for (size_t i = cnt - 1; i >= 2; i--) {
+        uint32_t v = arcs[i];
+        uint8_t byte = v & 0x7f;
+
+        if (ber_prepend(b, &byte, 1) < 0)
+            return -1;
+
+        while (v >>= 7) {
+            byte = 0x80 | (v & 0x7f);
+
+            if (ber_prepend(b, &byte, 1) < 0)
+                return -1;
+        }
+    }
+
+    uint8_t first = arcs[0] * 40 + arcs[1];
+    if (ber_prepend(b, &first, 1) < 0)
+        return -1;
+
+    return ber_header(b, BER_OID, start - b->pos);
+}
+
+static int codec_snmp_encode(lua_State *L) {
+    size_t clen, end;
+    struct ber_buf b;
+
+    const char *community = luaL_checklstring(L, 1, &clen);
+    const char *oid       = luaL_checkstring(L, 2);
+    int64_t req_id        = luaL_optinteger(L, 3, 1);
+    int64_t version       = luaL_optinteger(L, 4, 0);
+
+    b.pos = end = sizeof(b.buf);
+
+    /* varbind: { oid, NULL } */
+    if ((ber_header(&b, BER_NULL, 0) < 0) || (ber_oid_encode(&b, oid) < 0) ||
+        (ber_header(&b, BER_SEQUENCE, end - b.pos) < 0) ||
+        (ber_header(&b, BER_SEQUENCE, end - b.pos) < 0))
+        return luaL_error(L, "Invalid SNMP OID");
+
+    if ((ber_integer(&b, 0) < 0) || (ber_integer(&b, 0) < 0) ||
+        (ber_integer(&b, req_id) < 0) ||
+        (ber_header(&b, SNMP_GET, end - b.pos) < 0) ||
+        (ber_prepend(&b, community, clen) < 0) ||
+        (ber_header(&b, BER_OCTETS, clen) < 0) ||
+        (ber_integer(&b, version) < 0) ||
+        (ber_header(&b, BER_SEQUENCE, end - b.pos) < 0))
+        return luaL_error(L, "SNMP message too long");
+
+    lua_pushlstring(L, (const char *) b.buf + b.pos, end - b.pos);
+    return 1;
+}
+
+LUALIB_API int luaopen_codec(lua_State *L) {
+    luaL_Reg const funcs[] = {
+        { "dns_decode",  codec_dns_decode  },
+        { "dns_encode",  codec_dns_encode  },
+        { "ntp_decode",  codec_ntp_decode  },
+        { "ntp_encode",  codec_ntp_encode  },
+        { "snmp_decode", codec_snmp_decode },
+        { "snmp_encode", codec_snmp_encode },
+        { NULL,          NULL              }
+    };
+
+    luaL_newlib(L, funcs);
+
+    return 1;
+}
@@ -0,0 +1,281 @@
+/*
+ * Scriptable, asynchronous network packet generator/analyzer.
+ *
+ * Copyright (c) 2015, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <poll.h>
+#include <stdio.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include <pthread.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <arpa/inet.h>
+
+#include <urcu-qsbr.h>
+
+#include "ut/utlist.h"
+
+#include "netdev.h"
+#include "queue.h"
+#include "ranges.h"
+#include "pkt.h"
+#include "printf.h"
+#include "util.h"
+#include "pktizr.h"
+#include "control.h"
+
+#define CONTROL_POLL_MS 250
+
+struct pktizr_conf *conf_new(uint64_t rate, struct range *exclude) {
+    struct pktizr_conf *conf = calloc(1, sizeof(*conf));
+    if (conf == NULL)
+        fail_printf("OOM");
+
+    conf->rate    = rate;
+    conf->paused  = false;
+    conf->exclude = exclude;
+
+    return conf;
+}
+
+struct pktizr_conf *conf_dup(const struct pktizr_conf *conf) {
+    struct pktizr_conf *new = conf_new(conf->rate, NULL);
+    struct range *cur;
+
+    new->paused = conf->paused;
+
+    /* readers may still be walking the old list, so it's copied */
+    LL_FOREACH(conf->exclude, cur) {
+        range_list_add(NULL, &new->exclude, cur->start, cur->end);
+    }
+
+    return new;
+}
+
+void conf_free(struct pktizr_conf *conf) {
+    range_list_free(conf->exclude);
+
+    freep(&conf);
+}
+
+/*
+ * Replace the current configuration. The loop and recv threads only read it in
+ * between quiescent states, so the old one can be freed after a grace period.
+ */
+static void conf_publish(struct pktizr_args *args, struct pktizr_conf *new) {
+    struct pktizr_conf *old = args->conf;
+
+    rcu_assign_pointer(args->conf, new);
+
+    synchronize_rcu();
+
+    conf_free(old);
+}
+
+static void control_cmd(struct pktizr_args *args, char *line, FILE *out) {
+    struct pktizr_conf *conf;
+
+    char *cmd = strtok(line, " \t\r\n");
+    char *arg = strtok(NULL, " \t\r\n");
+
+    if (cmd == NULL)
+        return;
+
+    if (!strcmp(cmd, "set-rate")) {
+        char *end;
+        uint64_t rate;
+
+        if (arg == NULL)
+            goto invalid;
+
+        rate = strtoull(arg, &end, 10);
+        if (*end != '\0')
+            goto invalid;
+
+        conf = conf_dup(args->conf);
+        conf->rate = rate;
+
+        conf_publish(args, conf);
+    } else if (!strcmp(cmd, "pause") || !strcmp(cmd, "resume")) {
+        conf = conf_dup(args->conf);
+        conf->paused = !strcmp(cmd, "pause");
+
+        conf_publish(args, conf);
+    } else if (!strcmp(cmd, "add-exclude")) {
+        struct range *list = NULL, *cur;
+
+        if ((arg == NULL) || (range_parse_cidrs(arg, &list) < 0)) {
+            range_list_free(list);
+            goto invalid;
+        }
+
+        conf = conf_dup(args->conf);
+
+        LL_FOREACH(list, cur) {
+            range_list_add(NULL, &conf->exclude, cur->start, cur->end);
+        }
+
+        range_list_free(list);
+
+        conf_publish(args, conf);
+    } else if (!strcmp(cmd, "dump-stats")) {
+        conf = args->conf;
+
+        fprintf(out, "probes %zu/%zu\n", args->pkt_probe, args->pkt_count);
+        fprintf(out, "sent %zu\n", args->pkt_sent);
+        fprintf(out, "replies %zu\n", args->pkt_recv);
+        fprintf(out, "rate %zu\n", conf->rate);
+        fprintf(out, "paused %s\n", conf->paused ? "yes" : "no");
+        fprintf(out, "excluded %zu\n", range_list_count(conf->exclude));
+    } else {
+        fprintf(out, "error: unknown command %s\n", cmd);
+        return;
+    }
+
+    fprintf(out, "ok\n");
+    return;
+
+invalid:
+    fprintf(out, "error: invalid argument for %s\n", cmd);
+}
+
+static void control_client(struct pktizr_args *args, int fd) {
+    char  *line = NULL;
+    size_t size = 0;
+
+    /* separate streams, as sockets can't be seeked between reads and writes */
+    FILE *in  = fdopen(fd, "r");
+    FILE *out = fdopen(dup(fd), "w");
+
+    if ((in == NULL) || (out == NULL))
+        goto done;
+
+    /* unbuffered, so that polling the socket tells whether a line is pending */
+    setvbuf(in, NULL, _IONBF, 0);
+
+    /* an idle client must not keep pktizr from exiting */
+    while (!args->done) {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+        int rc = poll(&pfd, 1, CONTROL_POLL_MS);
+        if (rc <= 0)
+            continue;
+
+        if (getline(&line, &size, in) <= 0)
+            break;
+
+        control_cmd(args, line, out);
+        fflush(out);
+    }
+
+done:
+    free(line);
+
+    if (in)
+        fclose(in);
+    else
+        close(fd);
+
+    if (out)
+        fclose(out);
+}
+
+/*
+ * Serve the control socket, one client at a time. This is the only thread that
+ * modifies the configuration, so updates don't need any locking.
+ */
+static void *control_cb(void *p) {
+    struct pktizr_args *args = p;
+
+    if (pthread_setname_np(pthread_self(), "pktizr: control"))
+        fail_printf("Error setting thread name");
+
+    while (!args->done) {
+        struct pollfd pfd = { .fd = args->control_fd, .events = POLLIN };
+
+        int rc = poll(&pfd, 1, CONTROL_POLL_MS);
+        if (rc <= 0)
+            continue;
+
+        int fd = accept(args->control_fd, NULL, NULL);
+        if (fd < 0)
+            continue;
+
+        control_client(args, fd);
+    }
+
+    return NULL;
+}
+
+void control_start(struct pktizr_args *args, const char *path) {
+    struct sockaddr_un addr;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+        fail_printf("Control socket path too long: %s", path);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    args->control_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (args->control_fd < 0)
+        sysf_printf("socket(AF_UNIX)");
+
+    unlink(path);
+
+    if (bind(args->control_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+        sysf_printf("bind(%s)", path);
+
+    if (listen(args->control_fd, 1) < 0)
+        sysf_printf("listen()");
+
+    args->control_path = strdup(path);
+
+    if (pthread_create(&args->control_thread, NULL, control_cb, args))
+        fail_printf("Error creating control thread");
+}
+
+void control_stop(struct pktizr_args *args) {
+    if (args->control_fd < 0)
+        return;
+
+    pthread_join(args->control_thread, NULL);
+
+    closep(&args->control_fd);
+
+    unlink(args->control_path);
+    freep(&args->control_path);
+}
@@ -0,0 +1,220 @@
+/*
+ * Scriptable, asynchronous network packet generator/analyzer.
+ *
+ * Copyright (c) 2015, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Bounded-memory counters for script-defined keys.
+ *
+ * Every thread owns a table and is its only writer, so updates never lock.
+ * Keys are looked up in a short linear probe window; when the window is full,
+ * the entry with the lowest count is evicted and its count inherited by the new
+ * key, as in the Space-Saving algorithm, so that heavy hitters are kept with a
+ * bounded overestimation (tracked in err).
+ *
+ * Other threads can read a table while it's updated (e.g. to dump a summary):
+ * every entry carries a sequence counter that's odd while a key is replaced.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <urcu/uatomic.h>
+
+#include "count.h"
+#include "hash.h"
+#include "printf.h"
+#include "util.h"
+
+#define COUNT_PROBE 8
+
+static inline uint64_t count_hash(const char *key, size_t len) {
+    uint64_t seed[2] = { 0x9e3779b97f4a7c15ull, 0xc2b2ae3d27d4eb4full };
+
+    return pyrhash((const uint8_t *) seed, (const uint8_t *) key, len);
+}
+
+struct count_table *count_new(size_t size) {
+    size_t slots = COUNT_PROBE;
+
+    struct count_table *t = malloc(sizeof(*t));
+    if (t == NULL)
+        fail_printf("OOM");
+
+    while (slots < size)
+        slots <<= 1;
+
+    t->entries = calloc(slots, sizeof(*t->entries));
+    if (t->entries == NULL)
+        fail_printf("OOM");
+
+    t->mask    = slots - 1;
+    t->evicted = 0;
+    t->next    = NULL;
+
+    return t;
+}
+
+void count_free(struct count_table *t) {
+    freep(&t->entries);
+    free(t);
+}
+
+static void add_entry(struct count_table *t, const char *key, size_t len,
+                      uint64_t n, uint64_t err) {
+    uint64_t hash = count_hash(key, len);
+
+    struct count_entry *min = NULL;
+
+    for (size_t i = 0; i < COUNT_PROBE; i++) {
+        struct count_entry *e = &t->entries[(hash + i) & t->mask];
+
+        if (e->count == 0) {
+            min = e;
+            break;
+        }
+
+        if ((e->len == len) && !memcmp(e->key, key, len)) {
+            uatomic_set(&e->count, e->count + n);
+            uatomic_set(&e->err, e->err + err);
+            return;
+        }
+
+        if ((min == NULL) || (e->count < min->count))
+            min = e;
+    }
+
+    /* the evicted key's count is inherited, as an upper bound of the error */
+    if (min->count > 0) {
+        err += min->count;
+        n   += min->count;
+
+        t->evicted++;
+    }
+
+    CMM_STORE_SHARED(min->seq, min->seq + 1);
+    cmm_smp_wmb();
+
+    min->len = len;
+    memcpy(min->key, key, len);
+
+    min->err = err;
+
+    cmm_smp_wmb();
+    CMM_STORE_SHARED(min->count, n);
+
+    cmm_smp_wmb();
+    CMM_STORE_SHARED(min->seq, min->seq + 1);
+}
+
+void count_add(struct count_table *t, const char *key, size_t len, uint64_t n) {
+    if (len > COUNT_KEY_LEN)
+        len = COUNT_KEY_LEN;
+
+    if (n == 0)
+        return;
+
+    add_entry(t, key, len, n, 0);
+}
+
+static bool read_entry(struct count_entry *e, struct count_entry *out) {
+    while (1) {
+        uint32_t seq = CMM_LOAD_SHARED(e->seq);
+
+        if (seq & 1) {
+            caa_cpu_relax();
+            continue;
+        }
+
+        cmm_smp_rmb();
+
+        memcpy(out, e, sizeof(*out));
+
+        cmm_smp_rmb();
+
+        if (CMM_LOAD_SHARED(e->seq) == seq)
+            return out->count > 0;
+    }
+}
+
+void count_merge(struct count_table *dst, struct count_table *src) {
+    for (size_t i = 0; i <= src->mask; i++) {
+        struct count_entry e;
+
+        if (!read_entry(&src->entries[i], &e))
+            continue;
+
+        add_entry(dst, e.key, e.len, e.count, e.err);
+    }
+
+    dst->evicted += CMM_LOAD_SHARED(src->evicted);
+}
+
+static int cmp_entry(const void *a, const void *b) {
+    const struct count_entry *x = a, *y = b;
+
+    if (x->count != y->count)
+        return (x->count < y->count) ? 1 : -1;
+
+    if (x->len != y->len)
+        return (x->len < y->len) ? -1 : 1;
+
+    return memcmp(x->key, y->key, x->len);
+}
+
+void count_dump(struct count_table *t, FILE *out) {
+    size_t n = 0;
+
+    _free_ struct count_entry *entries = malloc((t->mask + 1) * sizeof(*entries));
+    if (entries == NULL)
+        fail_printf("OOM");
+
+    for (size_t i = 0; i <= t->mask; i++) {
+        if (read_entry(&t->entries[i], &entries[n]))
+            n++;
+    }
+
+    qsort(entries, n, sizeof(*entries), cmp_entry);
+
+    for (size_t i = 0; i < n; i++) {
+        struct count_entry *e = &entries[i];
+
+        if (e->err)
+            fprintf(out, "%.*s\t%zu (+/- %zu)\n", e->len, e->key,
+                    e->count, e->err);
+        else
+            fprintf(out, "%.*s\t%zu\n", e->len, e->key, e->count);
+    }
+
+    if (t->evicted)
+        fprintf(out, "(%zu keys evicted, counts are approximate)\n",
+                t->evicted);
+}
@@ -0,0 +1,752 @@
+/*
+ * Scriptable, asynchronous network packet generator/analyzer.
+ *
+ * Copyright (c) 2015, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Daemon mode: a single pktizr process owns the netdev (with its route, gateway
+ * and ring setup) and runs the scan jobs submitted over a UNIX socket.
+ *
+ * Every client connection submits one job with a line like:
+ *
+ *   scan <targets> <ports> <script> [<rate>]
+ *
+ * and receives "ok <id>", followed by the results printed by the job's script
+ * and, once the job is finished, its counters and a "done" line. Closing the
+ * connection cancels the job, and so does not reading the results fast enough:
+ * the connection is non-blocking, so that a client that stops reading can't
+ * stall the loop and recv threads shared by all the jobs.
+ *
+ * The loop thread sends one probe of each job in turn, under the global rate
+ * limit and the rate limit of each job. Every job has its own seed, so that
+ * its scripts only validate the cookies of their own probes, and the recv
+ * thread hands every reply to the scripts of each job in turn, until one of
+ * them claims it.
+ */
+
+#include <poll.h>
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include <fcntl.h>
+#include <pthread.h>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include <arpa/inet.h>
+
+#include <urcu-qsbr.h>
+
+#include "bucket.h"
+#include "count.h"
+#include "frag.h"
+#include "netdev.h"
+#include "queue.h"
+#include "ranges.h"
+#include "pkt.h"
+#include "shared.h"
+#include "shuffle.h"
+#include "printf.h"
+#include "util.h"
+#include "pktizr.h"
+#include "script.h"
+#include "daemon.h"
+
+#define DAEMON_POLL_MS 250
+#define DAEMON_TICK    64
+#define DAEMON_LINE    1024
+
+#define JOB_SHARED_SIZE (1 << 14)
+
+struct job {
+    unsigned id;
+
+    /* the client connection, results are written to it */
+    int fd;
+
+    /* the daemon's arguments, with the job's targets, ports, rate and seed */
+    struct pktizr_args args;
+
+    struct script *loop;
+    struct script *recv;
+
+    struct shuffle rnd;
+
+    size_t i;
+    size_t cnt;
+    size_t tgt_cnt;
+
+    uint64_t next_at;
+    uint64_t done_at;
+
+    /* some results couldn't be written to the client */
+    bool stalled;
+};
+
+static struct job *job_new(struct pktizr_args *args, char *line,
+                           const char **err) {
+    struct job *job;
+    char *save = NULL, *end;
+
+    char *cmd    = strtok_r(line, " \t\r\n", &save);
+    char *tgts   = strtok_r(NULL, " \t\r\n", &save);
+    char *prts   = strtok_r(NULL, " \t\r\n", &save);
+    char *script = strtok_r(NULL, " \t\r\n", &save);
+    char *rate   = strtok_r(NULL, " \t\r\n", &save);
+
+    if ((cmd == NULL) || strcmp(cmd, "scan")) {
+        *err = "unknown command";
+        return NULL;
+    }
+
+    if (script == NULL) {
+        *err = "usage: scan <targets> <ports> <script> [<rate>]";
+        return NULL;
+    }
+
+    /* script errors are fatal, so catch at least the missing ones */
+    if (access(strncmp(script, "plugin:", 7) ? script : script + 7, R_OK)) {
+        *err = "script not found";
+        return NULL;
+    }
+
+    job = calloc(1, sizeof(*job));
+    if (job == NULL)
+        fail_printf("OOM");
+
+    job->args = *args;
+
+    job->args.targets = NULL;
+    job->args.ports   = NULL;
+
+    if (range_parse_cidrs(tgts, &job->args.targets) < 0) {
+        *err = "invalid targets";
+        goto error;
+    }
+
+    if (range_parse_port_list(prts, &job->args.ports) < 0) {
+        *err = "invalid ports";
+        goto error;
+    }
+
+    job->args.rate = 0;
+
+    if (rate) {
+        job->args.rate = strtoull(rate, &end, 10);
+        if (*end != '\0') {
+            *err = "invalid rate";
+            goto error;
+        }
+    }
+
+    job->id = ++args->daemon->next_id;
+
+    /* replies carry the cookie of the job they belong to */
+    job->args.seed = pkt_cookie(job->id, 0, 0, 0, args->seed);
+
+    /* none of the single scan features are used by jobs */
+    job->args.tiers        = NULL;
+    job->args.ring         = NULL;
+    job->args.rtt          = NULL;
+    job->args.store        = NULL;
+    job->args.follow       = NULL;
+    job->args.prior        = NULL;
+    job->args.prior_cnt    = 0;
+    job->args.counters     = NULL;
+    job->args.scripts      = NULL;
+    job->args.script_cnt   = 1;
+    job->args.script_stats = NULL;
+    job->args.conf         = NULL;
+    job->args.perf         = NULL;
+    job->args.daemon       = NULL;
+
+    job->args.pkt_probe = 0;
+    job->args.pkt_recv  = 0;
+    job->args.pkt_sent  = 0;
+
+    pthread_mutex_init(&job->args.counters_mutex, NULL);
+
+    queue_init(&job->args.queue);
+
+    job->args.shared = shared_new(JOB_SHARED_SIZE);
+
+    job->tgt_cnt = range_list_count(job->args.targets);
+    job->cnt     = job->tgt_cnt * range_list_count(job->args.ports);
+
+    shuffle_init(&job->rnd, job->cnt, job->args.seed);
+
+    job->loop = script_load(&job->args, script);
+    job->recv = script_load(&job->args, script);
+
+    return job;
+
+error:
+    range_list_free(job->args.targets);
+    range_list_free(job->args.ports);
+    free(job);
+
+    return NULL;
+}
+
+static void job_free(struct job *job) {
+    struct queue_node *node;
+
+    script_close(job->loop);
+    script_close(job->recv);
+
+    while ((node = queue_dequeue(&job->args.queue)) != NULL)
+        pkt_free_all(caa_container_of(node, struct pkt, queue));
+
+    while (job->args.counters) {
+        struct count_table *t = job->args.counters;
+
+        job->args.counters = t->next;
+        count_free(t);
+    }
+
+    shared_free(job->args.shared);
+
+    range_list_free(job->args.targets);
+    range_list_free(job->args.ports);
+
+    close(job->fd);
+
+    free(job);
+}
+
+/*
+ * Send the results printed by the current thread to the job's client, until
+ * job_output_end() is called.
+ */
+static void job_output(struct job *job) {
+    ok_redirect(job->fd);
+}
+
+static void job_output_end(struct job *job) {
+    if (ok_redirect(-1) < 0)
+        CMM_STORE_SHARED(job->stalled, true);
+}
+
+static void job_report(struct job *job) {
+    size_t n = 0;
+    struct count_table *t, *merged;
+
+    /* the report is written by the daemon thread, it can wait for the client
+     * (up to the send timeout) */
+    fcntl(job->fd, F_SETFL, fcntl(job->fd, F_GETFL) & ~O_NONBLOCK);
+
+    FILE *out = fdopen(dup(job->fd), "w");
+    if (out == NULL)
+        return;
+
+    for (t = job->args.counters; t != NULL; t = t->next)
+        n += t->mask + 1;
+
+    if (n) {
+        merged = count_new(n);
+
+        for (t = job->args.counters; t != NULL; t = t->next)
+            count_merge(merged, t);
+
+        count_dump(merged, out);
+        count_free(merged);
+    }
+
+    fprintf(out, "done %zu probes, %zu sent, %zu replies\n",
+            job->args.pkt_probe, job->args.pkt_sent, job->args.pkt_recv);
+
+    fclose(out);
+}
+
+/*
+ * Replace the list of running jobs. The loop and recv threads only read it in
+ * between quiescent states, so the old one can be freed after a grace period.
+ */
+static void jobs_publish(struct daemon *d, struct daemon_jobs *new) {
+    struct daemon_jobs *old = d->jobs;
+
+    rcu_assign_pointer(d->jobs, new);
+
+    synchronize_rcu();
+
+    free(old);
+}
+
+static void jobs_remove(struct pktizr_args *args, struct job **done,
+                        size_t cnt, bool finished[]) {
+    struct daemon *d = args->daemon;
+
+    struct daemon_jobs *new = malloc(sizeof(*new));
+    if (new == NULL)
+        fail_printf("OOM");
+
+    new->cnt = 0;
+
+    for (size_t i = 0; i < d->jobs->cnt; i++) {
+        size_t j;
+
+        for (j = 0; (j < cnt) && (done[j] != d->jobs->job[i]); j++);
+
+        if (j == cnt)
+            new->job[new->cnt++] = d->jobs->job[i];
+    }
+
+    jobs_publish(d, new);
+
+    for (size_t j = 0; j < cnt; j++) {
+        if (finished[j])
+            job_report(done[j]);
+
+        job_free(done[j]);
+    }
+}
+
+static void daemon_accept(struct pktizr_args *args, int fd) {
+    struct daemon *d = args->daemon;
+    struct daemon_jobs *new;
+    struct job *job;
+    const char *err = NULL;
+
+    char line[DAEMON_LINE];
+    size_t len = 0;
+
+    /* don't let a slow client stall the other jobs */
+    struct timeval tv = { .tv_sec = 1 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    while ((len < sizeof(line) - 1) && !memchr(line, '\n', len)) {
+        ssize_t rc = recv(fd, line + len, sizeof(line) - 1 - len, 0);
+        if (rc <= 0)
+            break;
+
+        len += rc;
+    }
+
+    line[len] = '\0';
+
+    if (d->jobs->cnt == DAEMON_JOBS) {
+        err = "too many jobs";
+        goto error;
+    }
+
+    job = job_new(args, line, &err);
+    if (job == NULL)
+        goto error;
+
+    job->fd = fd;
+
+    dprintf(fd, "ok %u\n", job->id);
+
+    /* results are written by the loop and recv threads, which can't wait */
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    new = malloc(sizeof(*new));
+    if (new == NULL)
+        fail_printf("OOM");
+
+    memcpy(new, d->jobs, sizeof(*new));
+    new->job[new->cnt++] = job;
+
+    jobs_publish(d, new);
+
+    return;
+
+error:
+    dprintf(fd, "error: %s\n", err);
+    close(fd);
+}
+
+/*
+ * Accept new jobs, and remove the ones that are finished (once the replies to
+ * their last probe had the time to arrive) or whose client went away or
+ * stopped reading their results. This is
+ * the only thread that modifies the list of jobs, so it doesn't need locking.
+ */
+static void *daemon_cb(void *p) {
+    struct pktizr_args *args = p;
+    struct daemon *d = args->daemon;
+
+    if (pthread_setname_np(pthread_self(), "pktizr: daemon"))
+        fail_printf("Error setting thread name");
+
+    while (!args->done) {
+        struct pollfd pfd[1 + DAEMON_JOBS];
+        struct job *done[DAEMON_JOBS];
+        bool finished[DAEMON_JOBS];
+        size_t cnt = d->jobs->cnt, done_cnt = 0;
+        uint64_t now;
+
+        pfd[0].fd     = d->fd;
+        pfd[0].events = POLLIN;
+
+        for (size_t i = 0; i < cnt; i++) {
+            pfd[1 + i].fd     = d->jobs->job[i]->fd;
+            pfd[1 + i].events = POLLIN;
+        }
+
+        if (poll(pfd, 1 + cnt, DAEMON_POLL_MS) < 0)
+            continue;
+
+        now = time_now();
+
+        for (size_t i = 0; i < cnt; i++) {
+            struct job *job  = d->jobs->job[i];
+            uint64_t done_at = CMM_LOAD_SHARED(job->done_at);
+            bool hup = pfd[1 + i].revents & (POLLHUP | POLLERR);
+
+            hup |= CMM_LOAD_SHARED(job->stalled);
+
+            /* anything sent by the client after the job line is ignored */
+            if (pfd[1 + i].revents & POLLIN) {
+                char buf[64];
+
+                hup |= (recv(job->fd, buf, sizeof(buf), MSG_DONTWAIT) == 0);
+            }
+
+            if (hup || (done_at && (now >= done_at + args->wait * 1000000))) {
+                finished[done_cnt] = !hup;
+                done[done_cnt++]   = job;
+            }
+        }
+
+        if (done_cnt)
+            jobs_remove(args, done, done_cnt, finished);
+
+        if (pfd[0].revents & POLLIN) {
+            int fd = accept(d->fd, NULL, NULL);
+            if (fd >= 0)
+                daemon_accept(args, fd);
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Send the next packet of the job, if any: first the ones queued by its
+ * scripts, then its probes. Returns false if nothing was sent.
+ */
+static bool job_send(struct job *job, struct pktizr_conf *conf, uint64_t now) {
+    int rc;
+    uint64_t tgt;
+    uint32_t daddr;
+    uint16_t dport;
+
+    struct pkt *pkt;
+    struct queue_node *node;
+
+    node = queue_dequeue(&job->args.queue);
+    if (node) {
+        pkt = caa_container_of(node, struct pkt, queue);
+
+        pkt_send(&job->args, pkt);
+        pkt_free_all(pkt);
+
+        return true;
+    }
+
+    if (job->i >= job->cnt) {
+        if (!job->done_at)
+            CMM_STORE_SHARED(job->done_at, now);
+
+        return false;
+    }
+
+    if (job->args.rate && (now < job->next_at))
+        return false;
+
+    tgt = (job->args.shuffle) ? shuffle(&job->rnd, job->i) : job->i;
+
+    daddr = range_list_pick(job->args.targets, tgt % job->tgt_cnt);
+    dport = range_list_pick(job->args.ports, tgt / job->tgt_cnt);
+
+    job->i++;
+    job->args.pkt_probe++;
+
+    if (shared_skip(job->args.shared, daddr))
+        return false;
+
+    if (conf->exclude && range_list_has(conf->exclude, daddr))
+        return false;
+
+    job_output(job);
+    rc = script_loop(job->loop, &job->args, &pkt, daddr, dport);
+    job_output_end(job);
+
+    if (rc < 0)
+        return false;
+
+    /* raw frames returned by loop() have already been sent */
+    if (pkt) {
+        pkt_send(&job->args, pkt);
+        pkt_free_all(pkt);
+    }
+
+    if (job->args.rate)
+        job->next_at = now + 1000000 / job->args.rate;
+
+    return true;
+}
+
+static void *daemon_loop_cb(void *p) {
+    struct pktizr_args *args = p;
+    struct daemon *d = args->daemon;
+
+    size_t next = 0;
+    unsigned tick = 0;
+
+    struct bucket bucket;
+    bucket_init(&bucket, args->rate);
+
+    if (pthread_setname_np(pthread_self(), "pktizr: loop"))
+        fail_printf("Error setting thread name");
+
+    rcu_register_thread();
+
+    struct pktizr_conf *conf = rcu_dereference(args->conf);
+    struct daemon_jobs *jobs = rcu_dereference(d->jobs);
+
+    while (!args->done) {
+        size_t n;
+        uint64_t now;
+
+        if (!(++tick % DAEMON_TICK) || !jobs->cnt || conf->paused) {
+            rcu_quiescent_state();
+            conf = rcu_dereference(args->conf);
+            jobs = rcu_dereference(d->jobs);
+
+            if (conf->rate != args->rate) {
+                args->rate = conf->rate;
+                bucket_set_rate(&bucket, args->rate);
+            }
+        }
+
+        if (!jobs->cnt || conf->paused) {
+            time_sleep(1000);
+            continue;
+        }
+
+        bucket_consume(&bucket);
+
+        now = time_now();
+
+        /* the jobs take turns, the ones over their own rate are skipped */
+        for (n = 0; n < jobs->cnt; n++) {
+            struct job *job = jobs->job[(next + n) % jobs->cnt];
+
+            if (job_send(job, conf, now))
+                break;
+        }
+
+        if (n == jobs->cnt) {
+            time_sleep(100);
+            continue;
+        }
+
+        next = (next + n + 1) % jobs->cnt;
+
+        args->pkt_sent++;
+        bucket.tokens--;
+    }
+
+    rcu_unregister_thread();
+
+    return NULL;
+}
+
+static void *daemon_recv_cb(void *p) {
+    struct recv_ctx    *ctx  = p;
+    struct pktizr_args *args = ctx->args;
+    struct daemon      *d    = args->daemon;
+
+    unsigned tick = 0;
+
+    ctx->frags = malloc(sizeof(*ctx->frags));
+    if (ctx->frags == NULL)
+        fail_printf("OOM");
+
+    frag_table_init(ctx->frags, FRAG_SLOTS, FRAG_TIMEOUT);
+
+    if (pthread_setname_np(pthread_self(), "pktizr: recv"))
+        fail_printf("Error setting thread name");
+
+    rcu_register_thread();
+
+    struct pktizr_conf *conf = rcu_dereference(args->conf);
+    struct daemon_jobs *jobs = rcu_dereference(d->jobs);
+
+    while (!args->done) {
+        int rc = -1, len;
+        uint32_t saddr = 0;
+        uint16_t sport = 0;
+
+        for (size_t j = 0; j < jobs->cnt; j++) {
+            job_output(jobs->job[j]);
+            script_expire(jobs->job[j]->recv, &jobs->job[j]->args);
+            job_output_end(jobs->job[j]);
+        }
+
+        const uint8_t *buf = netdev_capture(ctx->netdev, &len);
+
+        if ((buf == NULL) || !(++tick % DAEMON_TICK)) {
+            rcu_quiescent_state();
+            conf = rcu_dereference(args->conf);
+            jobs = rcu_dereference(d->jobs);
+        }
+
+        if (buf == NULL)
+            continue;
+
+        CMM_STORE_SHARED(ctx->frames, ctx->frames + 1);
+
+        if (frag_is_fragment(buf, len)) {
+            size_t frag_len;
+
+            rc = frag_add(ctx->frags, buf, len, time_now(), &buf, &frag_len);
+            if (rc <= 0)
+                goto done;
+
+            len = frag_len;
+        }
+
+        if (conf->exclude && reply_key(buf, len, &saddr, &sport) &&
+            range_list_has(conf->exclude, saddr))
+            goto done;
+
+        rc = -1;
+
+        /* only the job that sent the probe can validate its cookie */
+        for (size_t j = 0; j < jobs->cnt; j++) {
+            struct job *job = jobs->job[j];
+
+            job_output(job);
+            rc = script_recv(job->recv, &job->args, buf, len);
+            job_output_end(job);
+
+            if (rc >= 0) {
+                uatomic_inc(&job->args.pkt_recv);
+                break;
+            }
+        }
+
+        if (rc >= 0)
+            uatomic_inc(&args->pkt_recv);
+
+done:
+        netdev_release(ctx->netdev);
+    }
+
+    rcu_unregister_thread();
+
+    return NULL;
+}
+
+void daemon_start(struct pktizr_args *args, const char *path) {
+    struct sockaddr_un addr;
+    struct daemon *d;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+        fail_printf("Daemon socket path too long: %s", path);
+
+    d = calloc(1, sizeof(*d));
+    if (d == NULL)
+        fail_printf("OOM");
+
+    d->jobs = calloc(1, sizeof(*d->jobs));
+    if (d->jobs == NULL)
+        fail_printf("OOM");
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    d->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (d->fd < 0)
+        sysf_printf("socket(AF_UNIX)");
+
+    unlink(path);
+
+    if (bind(d->fd, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+        sysf_printf("bind(%s)", path);
+
+    if (listen(d->fd, 16) < 0)
+        sysf_printf("listen()");
+
+    d->path = strdup(path);
+
+    args->daemon = d;
+
+    /* clients going away must not kill the daemon */
+    signal(SIGPIPE, SIG_IGN);
+
+    if (pthread_create(&args->recv[0].thread, NULL, daemon_recv_cb,
+                       &args->recv[0]))
+        fail_printf("Error creating recv thread");
+
+    if (pthread_create(&args->loop_thread, NULL, daemon_loop_cb, args))
+        fail_printf("Error creating loop thread");
+
+    if (pthread_create(&d->thread, NULL, daemon_cb, args))
+        fail_printf("Error creating daemon thread");
+}
+
+/*
+ * Cancel the jobs still running. Must be called after the loop and recv
+ * threads have been stopped.
+ */
+void daemon_stop(struct pktizr_args *args) {
+    struct daemon *d = args->daemon;
+
+    if (d == NULL)
+        return;
+
+    pthread_join(d->thread, NULL);
+
+    for (size_t i = 0; i < d->jobs->cnt; i++) {
+        dprintf(d->jobs->job[i]->fd, "error: daemon stopped\n");
+        job_free(d->jobs->job[i]);
+    }
+
+    free(d->jobs);
+
+    closep(&d->fd);
+
+    unlink(d->path);
+    freep(&d->path);
+
+    freep(&args->daemon);
+}
@@ -0,0 +1,178 @@
+/*
+ * Scriptable, asynchronous network packet generator/analyzer.
+ *
+ * Copyright (c) 2015, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "flow.h"
+#include "hash.h"
+#include "printf.h"
+#include "util.h"
+
+static inline size_t flow_hash(struct flow_table *t, struct flow_key *key) {
+    uint32_t buf[4];
+    uint64_t seed[2] = { 0, 0 };
+
+    buf[0] = key->raddr;
+    buf[1] = key->laddr;
+    buf[2] = (key->rport << 16) | key->lport;
+    buf[3] = key->proto;
+
+    return pyrhash((const uint8_t *) seed, (const uint8_t *) buf,
+                   sizeof(buf)) & (t->size - 1);
+}
+
+static inline bool flow_key_eq(struct flow_key *a, struct flow_key *b) {
+    return (a->raddr == b->raddr) && (a->laddr == b->laddr) &&
+           (a->rport == b->rport) && (a->lport == b->lport) &&
+           (a->proto == b->proto);
+}
+
+void flow_table_init(struct flow_table *t, size_t max) {
+    t->size = 1;
+
+    /* keep the load factor below 0.5 so that probe sequences stay short */
+    while (t->size < max * 2)
+        t->size <<= 1;
+
+    t->flows = calloc(t->size, sizeof(*t->flows));
+    if (t->flows == NULL)
+        fail_printf("OOM");
+
+    t->pool = calloc(max, sizeof(*t->pool));
+    if (t->pool == NULL)
+        fail_printf("OOM");
+
+    t->count     = 0;
+    t->max       = max;
+    t->pool_cnt  = 0;
+    t->next_tick = 0;
+}
+
+void flow_table_free(struct flow_table *t) {
+    freep(&t->flows);
+    freep(&t->pool);
+
+    t->size  = 0;
+    t->count = 0;
+}
+
+struct flow *flow_lookup(struct flow_table *t, struct flow_key *key) {
+    size_t i = flow_hash(t, key);
+
+    while (t->flows[i].used) {
+        if (flow_key_eq(&t->flows[i].key, key))
+            return &t->flows[i];
+
+        i = (i + 1) & (t->size - 1);
+    }
+
+    return NULL;
+}
+
+struct flow *flow_insert(struct flow_table *t, struct flow_key *key) {
+    size_t i;
+
+    if (t->count >= t->max)
+        return NULL;
+
+    i = flow_hash(t, key);
+
+    while (t->flows[i].used)
+        i = (i + 1) & (t->size - 1);
+
+    t->flows[i].key      = *key;
+    t->flows[i].used     = true;
+    t->flows[i].ref      = -1;
+    t->flows[i].deadline = 0;
+
+    t->count++;
+
+    return &t->flows[i];
+}
+
+void flow_remove(struct flow_table *t, struct flow *f) {
+    size_t i = f - t->flows, j = i;
+
+    /*
+     * Backward shift deletion: move later entries of the same probe
+     * sequence into the hole, so that lookups never need tombstones.
+     */
+    while (1) {
+        size_t k;
+
+        j = (j + 1) & (t->size - 1);
+
+        if (!t->flows[j].used)
+            break;
+
+        k = flow_hash(t, &t->flows[j].key);
+
+        if ((i <= j) ? ((i < k) && (k <= j)) : ((i < k) || (k <= j)))
+            continue;
+
+        t->flows[i] = t->flows[j];
+        i = j;
+    }
+
+    t->flows[i].used = false;
+    t->count--;
+}
+
+size_t flow_expired(struct flow_table *t, uint64_t now,
+                    struct flow_key *keys, size_t max) {
+    size_t n = 0;
+
+    for (size_t i = 0; (i < t->size) && (n < max); i++) {
+        struct flow *f = &t->flows[i];
+
+        if (f->used && (f->deadline <= now))
+            keys[n++] = f->key;
+    }
+
+    return n;
+}
+
+int flow_pool_get(struct flow_table *t) {
+    if (t->pool_cnt == 0)
+        return -1;
+
+    return t->pool[--t->pool_cnt];
+}
+
+bool flow_pool_put(struct flow_table *t, int ref) {
+    if (t->pool_cnt >= t->max)
+        return false;
+
+    t->pool[t->pool_cnt++] = ref;
+    return true;
+}
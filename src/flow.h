@@ -0,0 +1,70 @@
+/*
+ * Scriptable, asynchronous network packet generator/analyzer.
+ *
+ * Copyright (c) 2015, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+struct flow_key {
+    uint32_t raddr;
+    uint32_t laddr;
+    uint16_t rport;
+    uint16_t lport;
+    uint8_t  proto;
+};
+
+struct flow {
+    struct flow_key key;
+
+    bool     used;
+    int      ref;
+    uint64_t deadline;
+};
+
+struct flow_table {
+    struct flow *flows;
+    size_t       size;
+    size_t       count;
+    size_t       max;
+
+    int    *pool;
+    size_t  pool_cnt;
+
+    uint64_t next_tick;
+};
+
+void flow_table_init(struct flow_table *t, size_t max);
+void flow_table_free(struct flow_table *t);
+
+struct flow *flow_lookup(struct flow_table *t, struct flow_key *key);
+struct flow *flow_insert(struct flow_table *t, struct flow_key *key);
+void flow_remove(struct flow_table *t, struct flow *f);
+
+size_t flow_expired(struct flow_table *t, uint64_t now,
+                    struct flow_key *keys, size_t max);
+
+int flow_pool_get(struct flow_table *t);
+bool flow_pool_put(struct flow_table *t, int ref);
@@ -0,0 +1,253 @@
+/*
+ * Scriptable, asynchronous network packet generator/analyzer.
+ *
+ * Copyright (c) 2015, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * IPv4 fragment reassembly.
+ *
+ * Fragments are collected in a fixed number of preallocated slots, so memory
+ * usage is bounded: when all the slots are taken, the oldest datagram is
+ * dropped. The missing parts of every datagram are tracked as a list of holes,
+ * as described in RFC 815, and a datagram is complete once no hole is left.
+ *
+ * Frames (and the reassembled datagrams) include the Ethernet header, so that
+ * the result can be passed to pkt_unpack() like any other frame.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <arpa/inet.h>
+
+#include "queue.h"
+#include "pkt.h"
+#include "frag.h"
+#include "printf.h"
+#include "util.h"
+
+#define ETH_LEN      14
+
+#define IP_MF        0x2000
+#define IP_OFFSET    0x1fff
+
+#define HOLE_INF     0xffff
+
+void frag_table_init(struct frag_table *t, size_t count, uint64_t timeout) {
+    t->slots = calloc(count, sizeof(*t->slots));
+    if (t->slots == NULL)
+        fail_printf("OOM");
+
+    t->count   = count;
+    t->timeout = timeout;
+
+    t->frags   = 0;
+    t->done    = 0;
+    t->dropped = 0;
+}
+
+void frag_table_free(struct frag_table *t) {
+    freep(&t->slots);
+}
+
+bool frag_is_fragment(const uint8_t *frame, size_t len) {
+    const struct eth_hdr *eth = (const struct eth_hdr *) frame;
+    const struct ip4_hdr *ip4 = (const struct ip4_hdr *) (frame + ETH_LEN);
+
+    if (len < ETH_LEN + 20)
+        return false;
+
+    if (ntohs(eth->type) != ETHERTYPE_IP)
+        return false;
+
+    return (ntohs(ip4->frag_off) & (IP_MF | IP_OFFSET)) != 0;
+}
+
+static struct frag_slot *get_slot(struct frag_table *t,
+                                  const struct ip4_hdr *ip4, uint64_t now) {
+    struct frag_slot *free_slot = NULL, *old_slot = NULL;
+
+    for (size_t i = 0; i < t->count; i++) {
+        struct frag_slot *s = &t->slots[i];
+
+        if (s->used && (s->deadline <= now)) {
+            s->used = false;
+            t->dropped++;
+        }
+
+        if (!s->used) {
+            if (free_slot == NULL)
+                free_slot = s;
+
+            continue;
+        }
+
+        if ((s->src == ip4->src) && (s->dst == ip4->dst) &&
+            (s->id == ip4->id) && (s->proto == ip4->proto))
+            return s;
+
+        if ((old_slot == NULL) || (s->deadline < old_slot->deadline))
+            old_slot = s;
+    }
+
+    if (free_slot == NULL) {
+        free_slot = old_slot;
+        t->dropped++;
+    }
+
+    free_slot->used     = true;
+    free_slot->deadline = now + t->timeout;
+
+    free_slot->src   = ip4->src;
+    free_slot->dst   = ip4->dst;
+    free_slot->id    = ip4->id;
+    free_slot->proto = ip4->proto;
+
+    free_slot->hdr_len  = 0;
+    free_slot->data_len = 0;
+
+    free_slot->holes[0].first = 0;
+    free_slot->holes[0].last  = HOLE_INF;
+    free_slot->hole_cnt       = 1;
+
+    return free_slot;
+}
+
+/* RFC 815, steps 1 to 6 */
+static int fill_holes(struct frag_slot *s, size_t first, size_t last, bool mf) {
+    /* a fragment can split at most one hole into two */
+    struct frag_hole holes[FRAG_HOLES + 1];
+    size_t n = 0;
+
+    for (size_t i = 0; i < s->hole_cnt; i++) {
+        struct frag_hole *h = &s->holes[i];
+
+        if ((first > h->last) || (last < h->first)) {
+            holes[n++] = *h;
+            continue;
+        }
+
+        if (first > h->first) {
+            holes[n].first = h->first;
+            holes[n].last  = first - 1;
+            n++;
+        }
+
+        if ((last < h->last) && mf) {
+            holes[n].first = last + 1;
+            holes[n].last  = h->last;
+            n++;
+        }
+    }
+
+    if (n > FRAG_HOLES)
+        return -1;
+
+    memcpy(s->holes, holes, n * sizeof(*holes));
+    s->hole_cnt = n;
+
+    return 0;
+}
+
+int frag_add(struct frag_table *t, const uint8_t *frame, size_t len,
+             uint64_t now, const uint8_t **out, size_t *out_len) {
+    const struct ip4_hdr *ip4 = (const struct ip4_hdr *) (frame + ETH_LEN);
+
+    size_t hdr_len, tot_len, first, last;
+    uint16_t frag_off;
+    bool mf;
+
+    struct frag_slot *s;
+
+    t->frags++;
+
+    hdr_len  = ip4->ihl * 4;
+    tot_len  = ntohs(ip4->len);
+    frag_off = ntohs(ip4->frag_off);
+
+    mf    = frag_off & IP_MF;
+    first = (frag_off & IP_OFFSET) * 8;
+
+    if ((hdr_len < 20) || (tot_len <= hdr_len) ||
+        (ETH_LEN + tot_len > len))
+        goto drop;
+
+    last = first + (tot_len - hdr_len) - 1;
+
+    /* all fragments but the last must carry a multiple of 8 bytes */
+    if ((last >= FRAG_MAX_LEN) || (mf && ((last + 1) % 8)))
+        goto drop;
+
+    s = get_slot(t, ip4, now);
+
+    if (fill_holes(s, first, last, mf) < 0) {
+        s->used = false;
+        goto drop;
+    }
+
+    memcpy(s->buf + ETH_LEN + FRAG_HDR_LEN + first,
+           (const uint8_t *) ip4 + hdr_len, last - first + 1);
+
+    if (!mf)
+        s->data_len = last + 1;
+
+    if (first == 0) {
+        memcpy(s->buf, frame, ETH_LEN);
+        memcpy(s->buf + ETH_LEN, ip4, hdr_len);
+        s->hdr_len = hdr_len;
+    }
+
+    /* the last hole ends at "infinity" until the last fragment arrives */
+    if (s->hole_cnt > 0)
+        return 0;
+
+    s->used = false;
+    t->done++;
+
+    /* move the Ethernet and IPv4 headers right before the payload */
+    uint8_t *start = s->buf + FRAG_HDR_LEN - s->hdr_len;
+    memmove(start + ETH_LEN, s->buf + ETH_LEN, s->hdr_len);
+    memmove(start, s->buf, ETH_LEN);
+
+    struct ip4_hdr *hdr = (struct ip4_hdr *) (start + ETH_LEN);
+    hdr->len      = htons(s->hdr_len + s->data_len);
+    hdr->frag_off = 0;
+    hdr->chksum   = 0;
+    hdr->chksum   = pkt_chksum((uint8_t *) hdr, s->hdr_len, 0);
+
+    *out     = start;
+    *out_len = ETH_LEN + s->hdr_len + s->data_len;
+
+    return 1;
+
+drop:
+    t->dropped++;
+    return -1;
+}
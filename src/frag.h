@@ -0,0 +1,77 @@
+/*
+ * Scriptable, asynchronous network packet generator/analyzer.
+ *
+ * Copyright (c) 2015, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define FRAG_SLOTS   64
+#define FRAG_TIMEOUT 5000000
+#define FRAG_HOLES   16
+#define FRAG_MAX_LEN 16384
+#define FRAG_HDR_LEN 60
+
+struct frag_hole {
+    uint16_t first;
+    uint16_t last;
+};
+
+struct frag_slot {
+    bool     used;
+    uint64_t deadline;
+
+    uint32_t src;
+    uint32_t dst;
+    uint16_t id;
+    uint8_t  proto;
+
+    size_t hdr_len;
+    size_t data_len;
+
+    struct frag_hole holes[FRAG_HOLES];
+    size_t           hole_cnt;
+
+    /* Ethernet header + room for the IPv4 header + payload */
+    uint8_t buf[14 + FRAG_HDR_LEN + FRAG_MAX_LEN];
+};
+
+struct frag_table {
+    struct frag_slot *slots;
+    size_t count;
+
+    uint64_t timeout;
+
+    uint64_t frags;
+    uint64_t done;
+    uint64_t dropped;
+};
+
+void frag_table_init(struct frag_table *t, size_t count, uint64_t timeout);
+void frag_table_free(struct frag_table *t);
+
+bool frag_is_fragment(const uint8_t *frame, size_t len);
+int frag_add(struct frag_table *t, const uint8_t *frame, size_t len,
+             uint64_t now, const uint8_t **out, size_t *out_len);
@@ -65,6 +65,8 @@ struct netdev *netdev_open(const char *name, const char *dev_name) {
             dev->driver = cur;
             dev->priv   = calloc(1, cur->priv_size);
 
+            dev->prefix_len = 0;
+
             dev->driver->open(dev->priv, dev_name);
             return dev;
         }
@@ -82,6 +84,20 @@ void netdev_inject(struct netdev *dev, uint8_t *buf, size_t len) {
     dev->driver->inject(dev->priv, buf, len);
 }
 
+int netdev_set_prefix(struct netdev *dev, const uint8_t *prefix, size_t len) {
+    if (!dev->driver->set_prefix || (len > NETDEV_PREFIX_MAX))
+        return -1;
+
+    dev->driver->set_prefix(dev->priv, prefix, len);
+    dev->prefix_len = len;
+
+    return 0;
+}
+
+uint8_t *netdev_get_prefixed_buf(struct netdev *dev, size_t *len) {
+    return dev->driver->get_prefixed_buf(dev->priv, len);
+}
+
 const uint8_t *netdev_capture(struct netdev *dev, int *len) {
     return dev->driver->capture(dev->priv, len);
 }
@@ -90,6 +106,20 @@ void netdev_release(struct netdev *dev) {
     dev->driver->release(dev->priv);
 }
 
+int netdev_fanout(struct netdev *dev, uint16_t group) {
+    if (!dev->driver->fanout)
+        return -1;
+
+    return dev->driver->fanout(dev->priv, group);
+}
+
+int netdev_filter(struct netdev *dev, const char *expr) {
+    if (!dev->driver->filter)
+        return -1;
+
+    return dev->driver->filter(dev->priv, expr);
+}
+
 void netdev_close(struct netdev *dev) {
     dev->driver->close(dev->priv);
 
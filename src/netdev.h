@@ -28,9 +28,14 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#define NETDEV_PREFIX_MAX 64
+
 struct netdev {
     const struct netdev_driver *driver;
     void *priv;
+
+    /* length of the frame prefix, 0 if none is set */
+    size_t prefix_len;
 };
 
 struct netdev_driver {
@@ -42,9 +47,16 @@ struct netdev_driver {
     uint8_t *(*get_buf)(void *, size_t *);
     void (*inject)(void *, uint8_t *, size_t);
 
+    /* optional, keep a frame prefix in the TX buffers */
+    void (*set_prefix)(void *, const uint8_t *, size_t);
+    uint8_t *(*get_prefixed_buf)(void *, size_t *);
+
     const uint8_t *(*capture)(void *, int *);
     void (*release)(void *);
 
+    int (*fanout)(void *, uint16_t);
+    int (*filter)(void *, const char *);
+
     void (*close)(void *);
 };
 
@@ -53,7 +65,19 @@ struct netdev *netdev_open(const char *name, const char *dev_name);
 uint8_t *netdev_get_buf(struct netdev *n, size_t *len);
 void netdev_inject(struct netdev *n, uint8_t *buf, size_t len);
 
+/*
+ * Declare the leading bytes shared by most frames sent on the device (e.g. the
+ * Ethernet header of a scan). The driver writes them in its TX buffers once,
+ * and buffers from netdev_get_prefixed_buf() start with them, so that they can
+ * be filled from prefix_len on. Returns -1 if the driver doesn't support it.
+ */
+int netdev_set_prefix(struct netdev *n, const uint8_t *prefix, size_t len);
+uint8_t *netdev_get_prefixed_buf(struct netdev *n, size_t *len);
+
 const uint8_t *netdev_capture(struct netdev *n, int *len);
 void netdev_release(struct netdev *n);
 
+int netdev_fanout(struct netdev *n, uint16_t group);
+int netdev_filter(struct netdev *n, const char *expr);
+
 void netdev_close(struct netdev *n);
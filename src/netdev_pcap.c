@@ -102,6 +102,24 @@ static const uint8_t *netdev_capture_pcap(void *p, int *len) {
 static void netdev_release_pcap(void *p) {
 }
 
+static int netdev_filter_pcap(void *p, const char *expr) {
+    int rc;
+    struct bpf_program prog;
+
+    struct priv *priv = p;
+
+    rc = pcap_compile(priv->p, &prog, expr, 1, PCAP_NETMASK_UNKNOWN);
+    if (rc < 0) {
+        err_printf("Error compiling filter: %s", pcap_geterr(priv->p));
+        return -1;
+    }
+
+    rc = pcap_setfilter(priv->p, &prog);
+    pcap_freecode(&prog);
+
+    return rc;
+}
+
 static void netdev_close_pcap(void *p) {
     struct priv *priv = p;
 
@@ -124,5 +142,7 @@ const struct netdev_driver netdev_pcap = {
     .capture = netdev_capture_pcap,
     .release = netdev_release_pcap,
 
+    .filter  = netdev_filter_pcap,
+
     .close   = netdev_close_pcap,
 };
@@ -29,6 +29,7 @@
  */
 
 #include <string.h>
+#include <stdbool.h>
 #include <errno.h>
 
 #include <sys/mman.h>
@@ -38,6 +39,11 @@
 #include <arpa/inet.h>
 #include <linux/if_packet.h>
 #include <netinet/if_ether.h>
+#include <linux/filter.h>
+
+#ifdef HAVE_PCAP_H
+# include <pcap/pcap.h>
+#endif
 
 #include "netdev.h"
 #include "printf.h"
@@ -58,6 +64,11 @@ struct priv {
     int tx_ring_off;
 
     int ring_hdrlen;
+
+    /* frame prefix, rewritten only in the slots other frames overwrote */
+    uint8_t prefix[NETDEV_PREFIX_MAX];
+    size_t  prefix_len;
+    bool    tx_dirty[RING_FRAME_NR];
 };
 
 static void netdev_open_sock(void *p, const char *dev_name) {
@@ -124,13 +135,11 @@ static void netdev_open_sock(void *p, const char *dev_name) {
     priv->fd = fd;
 }
 
-static uint8_t *netdev_get_buf_sock(void *p, size_t *len) {
+static uint8_t *tx_next(struct priv *priv, int *slot, size_t *len) {
     int rc;
 
     struct pollfd pfd;
 
-    struct priv *priv = p;
-
     uint8_t *base = priv->tx_ring + (priv->tx_ring_off * RING_FRAME_SIZE);
     struct tpacket2_hdr *hdr = (struct tpacket2_hdr *) base;
 
@@ -145,6 +154,8 @@ static uint8_t *netdev_get_buf_sock(void *p, size_t *len) {
             sysf_printf("poll()");
     }
 
+    *slot = priv->tx_ring_off;
+
     priv->tx_ring_off = (priv->tx_ring_off + 1) % RING_FRAME_NR;
 
     *len = RING_FRAME_SIZE;
@@ -152,6 +163,34 @@ static uint8_t *netdev_get_buf_sock(void *p, size_t *len) {
     return base + TPACKET_ALIGN(priv->ring_hdrlen);
 }
 
+static uint8_t *netdev_get_buf_sock(void *p, size_t *len) {
+    int slot;
+
+    struct priv *priv = p;
+
+    uint8_t *buf = tx_next(priv, &slot, len);
+
+    /* the frame may overwrite the prefix */
+    priv->tx_dirty[slot] = true;
+
+    return buf;
+}
+
+static uint8_t *netdev_get_prefixed_buf_sock(void *p, size_t *len) {
+    int slot;
+
+    struct priv *priv = p;
+
+    uint8_t *buf = tx_next(priv, &slot, len);
+
+    if (priv->tx_dirty[slot]) {
+        memcpy(buf, priv->prefix, priv->prefix_len);
+        priv->tx_dirty[slot] = false;
+    }
+
+    return buf;
+}
+
 static void netdev_inject_sock(void *p, uint8_t *buf, size_t len) {
     int rc;
 
@@ -168,6 +207,26 @@ static void netdev_inject_sock(void *p, uint8_t *buf, size_t len) {
         sysf_printf("sendto()");
 }
 
+static void netdev_set_prefix_sock(void *p, const uint8_t *prefix,
+                                   size_t len) {
+    struct priv *priv = p;
+
+    memcpy(priv->prefix, prefix, len);
+    priv->prefix_len = len;
+
+    /* slots still owned by the kernel are fixed up when they are reused */
+    for (int i = 0; i < RING_FRAME_NR; i++) {
+        uint8_t *base = priv->tx_ring + (i * RING_FRAME_SIZE);
+        struct tpacket2_hdr *hdr = (struct tpacket2_hdr *) base;
+
+        priv->tx_dirty[i] = (hdr->tp_status != TP_STATUS_AVAILABLE);
+        if (priv->tx_dirty[i])
+            continue;
+
+        memcpy(base + TPACKET_ALIGN(priv->ring_hdrlen), prefix, len);
+    }
+}
+
 static const uint8_t *netdev_capture_sock(void *p, int *len) {
     int rc;
 
@@ -214,6 +273,39 @@ static void netdev_release_sock(void *p) {
     priv->rx_ring_off = (priv->rx_ring_off + 1) & (RING_FRAME_NR - 1);
 }
 
+static int netdev_fanout_sock(void *p, uint16_t group) {
+    struct priv *priv = p;
+
+    int arg = group | (PACKET_FANOUT_HASH << 16);
+
+    return setsockopt(priv->fd, SOL_PACKET, PACKET_FANOUT, &arg, sizeof(arg));
+}
+
+#ifdef HAVE_PCAP_H
+static int netdev_filter_sock(void *p, const char *expr) {
+    int rc;
+    struct bpf_program prog;
+    struct sock_fprog fprog;
+
+    struct priv *priv = p;
+
+    rc = pcap_compile_nopcap(RING_FRAME_SIZE, DLT_EN10MB, &prog, expr, 1,
+                             PCAP_NETMASK_UNKNOWN);
+    if (rc < 0)
+        return -1;
+
+    fprog.len    = prog.bf_len;
+    fprog.filter = (struct sock_filter *) prog.bf_insns;
+
+    rc = setsockopt(priv->fd, SOL_SOCKET, SO_ATTACH_FILTER,
+                    &fprog, sizeof(fprog));
+
+    pcap_freecode(&prog);
+
+    return rc;
+}
+#endif
+
 static void netdev_close_sock(void *p) {
     struct priv *priv = p;
     closep(&priv->fd);
@@ -229,8 +321,16 @@ const struct netdev_driver netdev_sock = {
     .get_buf = netdev_get_buf_sock,
     .inject  = netdev_inject_sock,
 
+    .set_prefix       = netdev_set_prefix_sock,
+    .get_prefixed_buf = netdev_get_prefixed_buf_sock,
+
     .capture = netdev_capture_sock,
     .release = netdev_release_sock,
 
+    .fanout  = netdev_fanout_sock,
+#ifdef HAVE_PCAP_H
+    .filter  = netdev_filter_sock,
+#endif
+
     .close   = netdev_close_sock,
 };
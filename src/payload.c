@@ -0,0 +1,205 @@
+/*
+ * Scriptable, asynchronous network packet generator/analyzer.
+ *
+ * Copyright (c) 2015, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Port-indexed database of UDP probe payloads. The database is built once with
+ * the pktizr-payloads tool, and then mapped read-only and shared by all the
+ * scripts, so that payloads can be copied directly into frames.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <arpa/inet.h>
+
+#include "queue.h"
+#include "pkt.h"
+#include "payload.h"
+#include "printf.h"
+#include "util.h"
+
+#define PAYLOAD_DATA_OFF \
+    (sizeof(struct payload_hdr) + PAYLOAD_PORTS * sizeof(struct payload_ent))
+
+static void payload_set(struct payload_db *db, void *p, size_t size) {
+    db->hdr  = p;
+    db->ents = (struct payload_ent *) ((uint8_t *) p + sizeof(*db->hdr));
+    db->size = size;
+}
+
+struct payload_db *payload_new(void) {
+    struct payload_db *db = malloc(sizeof(*db));
+    if (db == NULL)
+        fail_printf("OOM");
+
+    void *p = calloc(1, PAYLOAD_DATA_OFF);
+    if (p == NULL)
+        fail_printf("OOM");
+
+    payload_set(db, p, PAYLOAD_DATA_OFF);
+
+    memcpy(db->hdr->magic, PAYLOAD_MAGIC, sizeof(db->hdr->magic));
+
+    db->hdr->version = PAYLOAD_VERSION;
+    db->hdr->count   = 0;
+    db->hdr->size    = db->size;
+
+    db->mapped = false;
+
+    return db;
+}
+
+int payload_add(struct payload_db *db, uint16_t port_min, uint16_t port_max,
+                const uint8_t *buf, size_t len) {
+    void *p;
+    uint32_t off = db->size;
+    uint16_t csum;
+
+    if ((len == 0) || (len > PAYLOAD_MAX_LEN) || (port_min > port_max))
+        return -1;
+
+    p = realloc(db->hdr, db->size + len);
+    if (p == NULL)
+        fail_printf("OOM");
+
+    payload_set(db, p, db->size + len);
+
+    memcpy((uint8_t *) p + off, buf, len);
+
+    /* pkt_chksum() returns the complement of the folded sum */
+    csum = ~pkt_chksum((uint8_t *) p + off, len, 0);
+
+    for (uint32_t port = port_min; port <= port_max; port++) {
+        if (db->ents[port].off == 0)
+            db->hdr->count++;
+
+        db->ents[port].off  = off;
+        db->ents[port].len  = len;
+        db->ents[port].csum = htons(csum);
+    }
+
+    db->hdr->size = db->size;
+
+    return 0;
+}
+
+int payload_save(struct payload_db *db, const char *path) {
+    size_t done = 0;
+
+    _close_ int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return -1;
+
+    while (done < db->size) {
+        ssize_t rc = write(fd, (uint8_t *) db->hdr + done, db->size - done);
+        if (rc < 0)
+            return -1;
+
+        done += rc;
+    }
+
+    return 0;
+}
+
+struct payload_db *payload_open(const char *path) {
+    int rc;
+    struct stat st;
+
+    struct payload_db *db;
+
+    _close_ int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        sysf_printf("open(%s)", path);
+
+    rc = fstat(fd, &st);
+    if (rc < 0)
+        sysf_printf("fstat(%s)", path);
+
+    if ((size_t) st.st_size < PAYLOAD_DATA_OFF)
+        fail_printf("Invalid payload database %s", path);
+
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+        sysf_printf("mmap()");
+
+    db = malloc(sizeof(*db));
+    if (db == NULL)
+        fail_printf("OOM");
+
+    payload_set(db, p, st.st_size);
+    db->mapped = true;
+
+    if (memcmp(db->hdr->magic, PAYLOAD_MAGIC, sizeof(db->hdr->magic)) ||
+        (db->hdr->version != PAYLOAD_VERSION) ||
+        (db->hdr->size != db->size))
+        fail_printf("Invalid payload database %s", path);
+
+    for (size_t i = 0; i < PAYLOAD_PORTS; i++) {
+        struct payload_ent *e = &db->ents[i];
+
+        if (e->off == 0)
+            continue;
+
+        if ((e->off < PAYLOAD_DATA_OFF) || (e->len == 0) ||
+            (e->len > PAYLOAD_MAX_LEN) || ((size_t) e->off + e->len > db->size))
+            fail_printf("Invalid payload database %s", path);
+    }
+
+    return db;
+}
+
+void payload_free(struct payload_db *db) {
+    if (db->mapped)
+        munmap(db->hdr, db->size);
+    else
+        free(db->hdr);
+
+    free(db);
+}
+
+const uint8_t *payload_get(struct payload_db *db, uint16_t port,
+                           size_t *len, uint16_t *csum) {
+    struct payload_ent *e = &db->ents[port];
+
+    if (e->off == 0)
+        return NULL;
+
+    *len  = e->len;
+    *csum = ntohs(e->csum);
+
+    return (const uint8_t *) db->hdr + e->off;
+}
@@ -0,0 +1,79 @@
+/*
+ * Scriptable, asynchronous network packet generator/analyzer.
+ *
+ * Copyright (c) 2015, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define PAYLOAD_MAGIC   "PKTZPLDB"
+#define PAYLOAD_VERSION 1
+
+#define PAYLOAD_PORTS   65536
+#define PAYLOAD_MAX_LEN 1472
+
+/*
+ * On-disk layout of the UDP payload database:
+ *
+ *   struct payload_hdr
+ *   struct payload_ent[PAYLOAD_PORTS]     (indexed by destination port)
+ *   payload data
+ *
+ * Entries point to their payload by offset from the start of the file (0 means
+ * no payload for that port), and ports sharing the same payload share the same
+ * data. The checksum is the folded 16-bit one's complement sum of the payload,
+ * stored in network byte order. All other integers are in host byte order.
+ */
+struct payload_hdr {
+    char     magic[8];
+    uint32_t version;
+    uint32_t count;
+    uint64_t size;
+};
+
+struct payload_ent {
+    uint32_t off;
+    uint16_t len;
+    uint16_t csum;
+};
+
+struct payload_db {
+    struct payload_hdr *hdr;
+    struct payload_ent *ents;
+
+    size_t size;
+    bool   mapped;
+};
+
+struct payload_db *payload_new(void);
+int payload_add(struct payload_db *db, uint16_t port_min, uint16_t port_max,
+                const uint8_t *buf, size_t len);
+int payload_save(struct payload_db *db, const char *path);
+
+struct payload_db *payload_open(const char *path);
+void payload_free(struct payload_db *db);
+
+const uint8_t *payload_get(struct payload_db *db, uint16_t port,
+                           size_t *len, uint16_t *csum);
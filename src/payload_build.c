@@ -0,0 +1,251 @@
+/*
+ * Scriptable, asynchronous network packet generator/analyzer.
+ *
+ * Copyright (c) 2015, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Builds a UDP payload database (see --udp-payloads) from a text file, or lists
+ * the contents of an existing database. Every non-empty line of the text file
+ * contains a comma-separated list of ports or port ranges, followed by one or
+ * more double-quoted strings that are concatenated to form the payload:
+ *
+ *   # DNS version.bind
+ *   53,5353 "\x00\x00\x00\x00\x00\x01\x00\x00\x00\x00\x00\x00"
+ *           "\x07version\x04bind\x00\x00\x10\x00\x03"
+ *
+ * Strings support the \xHH, \n, \r, \t, \0, \\ and \" escapes, and lines
+ * starting with a quote continue the payload of the previous line.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "payload.h"
+#include "printf.h"
+#include "util.h"
+
+struct entry {
+    char    ports[256];
+    uint8_t buf[PAYLOAD_MAX_LEN];
+    size_t  len;
+    size_t  line;
+};
+
+static int parse_string(const char **str, struct entry *e) {
+    const char *p = *str + 1;
+
+    while (*p != '"') {
+        int c = *p++;
+
+        if (c == '\0')
+            return -1;
+
+        if (c == '\\') {
+            c = *p++;
+
+            switch (c) {
+            case 'x': {
+                char hex[3] = { 0 };
+
+                if (!isxdigit(p[0]) || !isxdigit(p[1]))
+                    return -1;
+
+                hex[0] = *p++;
+                hex[1] = *p++;
+
+                c = strtoul(hex, NULL, 16);
+                break;
+            }
+
+            case 'n':  c = '\n'; break;
+            case 'r':  c = '\r'; break;
+            case 't':  c = '\t'; break;
+            case '0':  c = '\0'; break;
+            case '\\': c = '\\'; break;
+            case '"':  c = '"';  break;
+
+            default:
+                return -1;
+            }
+        }
+
+        if (e->len >= sizeof(e->buf))
+            return -1;
+
+        e->buf[e->len++] = c;
+    }
+
+    *str = p + 1;
+
+    return 0;
+}
+
+static int parse_strings(const char *p, struct entry *e) {
+    while (1) {
+        while (isspace(*p))
+            p++;
+
+        if ((*p == '\0') || (*p == '#'))
+            return 0;
+
+        if ((*p != '"') || (parse_string(&p, e) < 0))
+            return -1;
+    }
+}
+
+static int add_entry(struct payload_db *db, struct entry *e) {
+    char *save = NULL;
+
+    for (char *tok = strtok_r(e->ports, ",", &save); tok;
+               tok = strtok_r(NULL, ",", &save)) {
+        char *end;
+        unsigned long min, max;
+
+        min = max = strtoul(tok, &end, 10);
+
+        if (*end == '-')
+            max = strtoul(end + 1, &end, 10);
+
+        if ((end == tok) || (*end != '\0') || (max > 65535))
+            return -1;
+
+        if (payload_add(db, min, max, e->buf, e->len) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+static void build(const char *input, const char *output) {
+    char line[4096];
+    size_t n = 0;
+
+    struct entry e;
+    struct payload_db *db;
+
+    FILE *f = fopen(input, "r");
+    if (f == NULL)
+        sysf_printf("fopen(%s)", input);
+
+    db = payload_new();
+
+    e.len = 0;
+
+    while (fgets(line, sizeof(line), f)) {
+        char *p = line;
+
+        n++;
+
+        while (isspace(*p))
+            p++;
+
+        if ((*p == '\0') || (*p == '#'))
+            continue;
+
+        if (*p == '"') {
+            if (e.len == 0)
+                fail_printf("%s:%zu: payload without ports", input, n);
+
+            if (parse_strings(p, &e) < 0)
+                fail_printf("%s:%zu: invalid payload", input, n);
+
+            continue;
+        }
+
+        if ((e.len > 0) && (add_entry(db, &e) < 0))
+            fail_printf("%s:%zu: invalid entry", input, e.line);
+
+        size_t len = strcspn(p, " \t");
+        if (len >= sizeof(e.ports))
+            fail_printf("%s:%zu: invalid ports", input, n);
+
+        memcpy(e.ports, p, len);
+        e.ports[len] = '\0';
+
+        e.len  = 0;
+        e.line = n;
+
+        if ((parse_strings(p + len, &e) < 0) || (e.len == 0))
+            fail_printf("%s:%zu: invalid payload", input, n);
+    }
+
+    if ((e.len > 0) && (add_entry(db, &e) < 0))
+        fail_printf("%s:%zu: invalid entry", input, e.line);
+
+    fclose(f);
+
+    if (payload_save(db, output) < 0)
+        sysf_printf("Error writing %s", output);
+
+    fprintf(stderr, "Wrote %u ports (%zu bytes)\n", db->hdr->count, db->size);
+
+    payload_free(db);
+}
+
+static void list(const char *path) {
+    struct payload_db *db = payload_open(path);
+
+    for (size_t port = 0; port < PAYLOAD_PORTS; port++) {
+        size_t len;
+        uint16_t csum;
+
+        const uint8_t *buf = payload_get(db, port, &len, &csum);
+        if (buf == NULL)
+            continue;
+
+        printf("%zu ", port);
+
+        for (size_t i = 0; i < len; i++)
+            printf("%02x", buf[i]);
+
+        printf("\n");
+    }
+
+    payload_free(db);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 2) {
+        list(argv[1]);
+        return 0;
+    }
+
+    if (argc != 3) {
+        fprintf(stderr, "Usage: pktizr-payloads <input> <output>\n");
+        fprintf(stderr, "       pktizr-payloads <database>\n");
+        return 1;
+    }
+
+    build(argv[1], argv[2]);
+
+    return 0;
+}
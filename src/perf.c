@@ -0,0 +1,152 @@
+/*
+ * Scriptable, asynchronous network packet generator/analyzer.
+ *
+ * Copyright (c) 2015, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/syscall.h>
+
+#ifdef HAVE_LINUX_PERF_EVENT_H
+#include <linux/perf_event.h>
+#endif
+
+#include "perf.h"
+#include "printf.h"
+#include "util.h"
+
+const char *perf_event_names[PERF_EVENT_MAX] = {
+    [PERF_CYCLES]        = "cycles",
+    [PERF_INSTRUCTIONS]  = "instructions",
+    [PERF_CACHE_MISSES]  = "cache-misses",
+    [PERF_BRANCH_MISSES] = "branch-misses",
+};
+
+#ifdef HAVE_LINUX_PERF_EVENT_H
+static const uint64_t perf_configs[PERF_EVENT_MAX] = {
+    [PERF_CYCLES]        = PERF_COUNT_HW_CPU_CYCLES,
+    [PERF_INSTRUCTIONS]  = PERF_COUNT_HW_INSTRUCTIONS,
+    [PERF_CACHE_MISSES]  = PERF_COUNT_HW_CACHE_MISSES,
+    [PERF_BRANCH_MISSES] = PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+static int open_event(uint64_t config, bool user_only) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+
+    attr.size   = sizeof(attr);
+    attr.type   = PERF_TYPE_HARDWARE;
+    attr.config = config;
+
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    attr.exclude_kernel = user_only;
+    attr.exclude_hv     = 1;
+
+    /* count the calling thread, on any CPU */
+    return syscall(__NR_perf_event_open, &attr, 0, -1, -1,
+                   PERF_FLAG_FD_CLOEXEC);
+}
+#endif
+
+void perf_init(struct perf_ctr *c) {
+    for (size_t i = 0; i < PERF_EVENT_MAX; i++)
+        c->fd[i] = -1;
+}
+
+/*
+ * Open the hardware counters for the calling thread, and return how many of
+ * them could be opened. Kernel time is counted too when perf_event_paranoid
+ * allows it, otherwise only user space is counted.
+ */
+int perf_open(struct perf_ctr *c) {
+    int cnt = 0;
+
+    perf_init(c);
+
+#ifdef HAVE_LINUX_PERF_EVENT_H
+    bool user_only = false;
+
+    for (size_t i = 0; i < PERF_EVENT_MAX; i++) {
+        c->fd[i] = open_event(perf_configs[i], user_only);
+
+        if ((c->fd[i] < 0) && !user_only &&
+            ((errno == EACCES) || (errno == EPERM))) {
+            user_only = true;
+
+            c->fd[i] = open_event(perf_configs[i], user_only);
+        }
+
+        if (c->fd[i] >= 0)
+            cnt++;
+    }
+#endif
+
+    return cnt;
+}
+
+/*
+ * Read the current value of the counters, which can be done from any thread.
+ * Counters that are not available read as 0, the ones that were multiplexed
+ * with other events are scaled to the whole time they were enabled.
+ */
+void perf_read(struct perf_ctr *c, uint64_t *val) {
+    for (size_t i = 0; i < PERF_EVENT_MAX; i++) {
+        uint64_t buf[3];
+
+        val[i] = 0;
+
+        if (c->fd[i] < 0)
+            continue;
+
+        if (read(c->fd[i], buf, sizeof(buf)) != sizeof(buf))
+            continue;
+
+        /* buf[0]: value, buf[1]: time enabled, buf[2]: time running */
+        if (buf[2] == 0)
+            continue;
+
+        if (buf[2] < buf[1])
+            val[i] = (double) buf[0] * buf[1] / buf[2];
+        else
+            val[i] = buf[0];
+    }
+}
+
+void perf_close(struct perf_ctr *c) {
+    for (size_t i = 0; i < PERF_EVENT_MAX; i++) {
+        if (c->fd[i] >= 0)
+            closep(&c->fd[i]);
+    }
+}
@@ -91,6 +91,16 @@ struct pkt *pkt_new(enum pkt_type type) {
 }
 
 int pkt_pack(uint8_t *buf, size_t len, struct pkt *p) {
+    return pkt_pack_prefix(buf, len, p, 0);
+}
+
+/*
+ * Like pkt_pack(), but the caller guarantees that the first prefix_len bytes
+ * of buf already hold the outermost headers (e.g. a buffer from
+ * netdev_get_prefixed_buf()), so these are not written again.
+ */
+int pkt_pack_prefix(uint8_t *buf, size_t len, struct pkt *p,
+                    size_t prefix_len) {
     struct pkt *cur;
     size_t plen = 0, i = 0;
     enum pkt_type prev_type = TYPE_NONE;
@@ -155,6 +165,9 @@ int pkt_pack(uint8_t *buf, size_t len, struct pkt *p) {
     DL_FOREACH(p, cur) {
         i -= cur->length;
 
+        if (i + cur->length <= prefix_len)
+            continue;
+
         switch (cur->type) {
         case TYPE_ETH:
             pkt_pack_eth(cur, buf + i, plen - i);
@@ -189,6 +202,109 @@ int pkt_pack(uint8_t *buf, size_t len, struct pkt *p) {
     return plen;
 }
 
+/*
+ * Copy a raw frame to buf, fixing up its IPv4 length and checksums if flags has
+ * PKT_FRAME_FIXUP. L3 frames are copied as they are, the caller is in charge of
+ * their Ethernet header. Returns the frame length, or -1 if it doesn't fit.
+ */
+int pkt_pack_frame(uint8_t *buf, size_t len, const uint8_t *frame,
+                   size_t frame_len, unsigned flags) {
+    if (len < frame_len)
+        return -1;
+
+    memcpy(buf, frame, frame_len);
+
+    if (flags & PKT_FRAME_FIXUP) {
+        uint8_t *l3     = buf;
+        size_t   l3_len = frame_len;
+
+        /* L2 frames are fixed up only if they carry an IPv4 packet */
+        if (flags & PKT_FRAME_L2) {
+            struct eth_hdr *eth = (struct eth_hdr *) buf;
+
+            if ((frame_len < 14) || (ntohs(eth->type) != ETHERTYPE_IP)) {
+                l3_len = 0;
+            } else {
+                l3     += 14;
+                l3_len -= 14;
+            }
+        }
+
+        pkt_fixup(l3, l3_len);
+    }
+
+    return frame_len;
+}
+
+int pkt_fixup(uint8_t *buf, size_t len) {
+    size_t hlen;
+    uint8_t *l4;
+    uint32_t csum;
+
+    struct ip4_hdr *out = (struct ip4_hdr *) buf;
+    struct ip4_hdr  hdr;
+
+    if ((len < 20) || (out->version != 4))
+        return -1;
+
+    hlen = out->ihl * 4;
+    if ((hlen < 20) || (hlen > len))
+        return -1;
+
+    out->len    = htons(len);
+    out->chksum = 0;
+    out->chksum = pkt_chksum(buf, hlen, 0);
+
+    /* pkt_pseudo_chksum() wants the header fields in host order */
+    memcpy(&hdr, out, 20);
+    hdr.len = len;
+
+    l4  = buf + hlen;
+    len = len - hlen;
+
+    switch (out->proto) {
+    case PROTO_ICMP: {
+        struct icmp_hdr *icmp = (struct icmp_hdr *) l4;
+
+        if (len < 8)
+            return -1;
+
+        icmp->chksum = 0;
+        icmp->chksum = pkt_chksum(l4, len, 0);
+        break;
+    }
+
+    case PROTO_UDP: {
+        struct udp_hdr *udp = (struct udp_hdr *) l4;
+
+        if (len < 8)
+            return -1;
+
+        csum = pkt_pseudo_chksum(&hdr);
+
+        udp->len    = htons(len);
+        udp->chksum = 0;
+        udp->chksum = pkt_chksum(l4, len, csum);
+        break;
+    }
+
+    case PROTO_TCP: {
+        struct tcp_hdr *tcp = (struct tcp_hdr *) l4;
+
+        if (len < 20)
+            return -1;
+
+        csum = pkt_pseudo_chksum(&hdr);
+
+        tcp->chksum = 0;
+        tcp->chksum = pkt_chksum(l4, len, csum);
+        break;
+    }
+    }
+
+    return 0;
+}
+
 int pkt_unpack(uint8_t *buf, size_t len, struct pkt **p) {
     int n = 0;
     size_t i = 0;
@@ -265,7 +381,8 @@ void pkt_free(struct pkt *pkt) {
         break;
 
     case TYPE_RAW:
-        freep(&pkt->p.raw.payload);
+        if (!pkt->p.raw.ref)
+            freep(&pkt->p.raw.payload);
         break;
     }
 
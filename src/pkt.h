@@ -39,6 +39,13 @@ enum pkt_type {
     TYPE_RAW,
 };
 
+enum {
+    PKT_FRAME       = 1 << 0,
+    PKT_FRAME_L2    = 1 << 1,
+    PKT_FRAME_FIXUP = 1 << 2,
+    PKT_ETH_PREFIX  = 1 << 3, /* same Ethernet header as the TX prefix */
+};
+
 enum {
     ETHERTYPE_IP   = 0x0800,
     ETHERTYPE_ARP  = 0x0806,
@@ -81,6 +88,35 @@ enum {
     ICMPOP_ADDRESSREPLY   = 18,
 };
 
+enum {
+    OPT_EOL       = 0,
+    OPT_NOP       = 1,
+    OPT_MSS       = 2,
+    OPT_WSCALE    = 3,
+    OPT_SACK_PERM = 4,
+    OPT_SACK      = 5,
+    OPT_TS        = 8,
+};
+
+#define OPT_MAX_LEN 40
+#define OPT_MAX_CNT 16
+
+/* option bytes are kept as they appear on the wire, and each option is
+ * indexed by its kind and its offset/length (including the kind and length
+ * bytes) inside buf */
+struct pkt_opt {
+    uint8_t kind;
+    uint8_t off;
+    uint8_t len;
+};
+
+struct pkt_opts {
+    uint8_t cnt;
+    uint8_t len;
+    struct pkt_opt opt[OPT_MAX_CNT];
+    uint8_t buf[OPT_MAX_LEN];
+};
+
 struct eth_hdr {
     uint8_t  dst[6];
     uint8_t  src[6];
@@ -118,6 +154,8 @@ struct ip4_hdr {
     uint16_t chksum;
     uint32_t src;
     uint32_t dst;
+
+    struct pkt_opts opts;
 };
 
 struct icmp_hdr {
@@ -170,17 +208,24 @@ struct tcp_hdr {
     uint16_t window;
     uint16_t chksum;
     uint16_t urg_ptr;
+
+    struct pkt_opts opts;
 };
 
 struct raw_hdr {
     uint8_t *payload;
     size_t  len;
+
+    /* payload points into the payload database, with a precomputed sum */
+    bool     ref;
+    uint16_t csum;
 };
 
 struct pkt {
     size_t   length;
     uint16_t type;
     uint16_t refcnt;
+    uint16_t flags;
 
     union {
         struct eth_hdr  eth;
@@ -225,7 +270,22 @@ int pkt_unpack_udp(struct pkt *p, uint8_t *buf, size_t len);
 int pkt_unpack_tcp(struct pkt *p, uint8_t *buf, size_t len);
 int pkt_unpack_raw(struct pkt *p, uint8_t *buf, size_t len);
 
+int pkt_opts_parse(struct pkt_opts *o, const uint8_t *buf, size_t len);
+size_t pkt_opts_size(const struct pkt_opts *o);
+void pkt_opts_truncate(struct pkt_opts *o, size_t len);
+size_t pkt_opts_pack(const struct pkt_opts *o, uint8_t *buf);
+const uint8_t *pkt_opts_find(const struct pkt_opts *o, uint8_t kind,
+                             size_t *len);
+int pkt_opts_set(struct pkt_opts *o, uint8_t kind,
+                 const uint8_t *data, size_t len);
+int pkt_opts_del(struct pkt_opts *o, uint8_t kind);
+
 int pkt_pack(uint8_t *buf, size_t len, struct pkt *p);
+int pkt_pack_prefix(uint8_t *buf, size_t len, struct pkt *p,
+                    size_t prefix_len);
+int pkt_pack_frame(uint8_t *buf, size_t len, const uint8_t *frame,
+                   size_t frame_len, unsigned flags);
+int pkt_fixup(uint8_t *buf, size_t len);
 int pkt_unpack(uint8_t *buf, size_t len, struct pkt **p);
 void pkt_free(struct pkt *pkt);
 void pkt_free_all(struct pkt *pkt);
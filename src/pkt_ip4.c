@@ -38,6 +38,7 @@
 #include "pkt.h"
 
 void pkt_pack_ip4(struct pkt *p, uint8_t *buf, size_t len) {
+    size_t hlen = 20;
     struct ip4_hdr *out = (struct ip4_hdr *) buf;
 
     out->version  = p->p.ip4.version;
@@ -52,14 +53,19 @@ void pkt_pack_ip4(struct pkt *p, uint8_t *buf, size_t len) {
     out->src      = p->p.ip4.src;
     out->dst      = p->p.ip4.dst;
 
-    out->chksum   = pkt_chksum(buf, sizeof(*out), 0);
+    if (p->length >= 20 + pkt_opts_size(&p->p.ip4.opts))
+        hlen += pkt_opts_pack(&p->p.ip4.opts, buf + 20);
+
+    out->chksum   = pkt_chksum(buf, hlen, 0);
 }
 
 int pkt_unpack_ip4(struct pkt *p, uint8_t *buf, size_t len) {
+    size_t hlen;
+
     if (len < 20)
         return -1;
 
-    memcpy(&p->p.ip4, buf, sizeof(p->p.ip4));
+    memcpy(&p->p.ip4, buf, 20);
 
     if (p->p.ip4.version != 4)
         return -1;
@@ -76,10 +82,13 @@ int pkt_unpack_ip4(struct pkt *p, uint8_t *buf, size_t len) {
     p->p.ip4.src      = p->p.ip4.src;
     p->p.ip4.dst      = p->p.ip4.dst;
 
-    /* TODO: unpack IP options */
+    hlen = p->p.ip4.ihl * 4;
+
+    if ((hlen > 20) && (hlen <= len))
+        pkt_opts_parse(&p->p.ip4.opts, buf + 20, hlen - 20);
 
     p->type   = TYPE_IP4;
-    p->length = p->p.ip4.ihl * 4;
+    p->length = hlen;
 
     switch (p->p.ip4.proto) {
     case PROTO_ICMP:
@@ -0,0 +1,212 @@
+/*
+ * Scriptable, asynchronous network packet generator/analyzer.
+ *
+ * Copyright (c) 2015, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "queue.h"
+#include "pkt.h"
+
+static void opts_index(struct pkt_opts *o) {
+    size_t i = 0;
+
+    o->cnt = 0;
+
+    while ((i < o->len) && (o->cnt < OPT_MAX_CNT)) {
+        size_t len;
+        uint8_t kind = o->buf[i];
+
+        switch (kind) {
+        case OPT_EOL:
+            /* everything after the end of list is padding */
+            len = o->len - i;
+            break;
+
+        case OPT_NOP:
+            len = 1;
+            break;
+
+        default:
+            if (i + 1 >= o->len)
+                return;
+
+            len = o->buf[i + 1];
+            if ((len < 2) || (i + len > o->len))
+                return;
+        }
+
+        o->opt[o->cnt].kind = kind;
+        o->opt[o->cnt].off  = i;
+        o->opt[o->cnt].len  = len;
+        o->cnt++;
+
+        if (kind == OPT_EOL)
+            return;
+
+        i += len;
+    }
+}
+
+int pkt_opts_parse(struct pkt_opts *o, const uint8_t *buf, size_t len) {
+    if (len > OPT_MAX_LEN)
+        return -1;
+
+    memcpy(o->buf, buf, len);
+    o->len = len;
+
+    opts_index(o);
+
+    return 0;
+}
+
+/*
+ * Drop the option bytes past len, e.g. when the header length is explicitly
+ * set to a smaller value. Options cut in half are dropped entirely.
+ */
+void pkt_opts_truncate(struct pkt_opts *o, size_t len) {
+    if (len >= o->len)
+        return;
+
+    o->len = len;
+
+    opts_index(o);
+
+    if (o->cnt > 0) {
+        const struct pkt_opt *last = &o->opt[o->cnt - 1];
+
+        o->len = last->off + last->len;
+    } else {
+        o->len = 0;
+    }
+}
+
+size_t pkt_opts_size(const struct pkt_opts *o) {
+    return (o->len + 3) & ~3;
+}
+
+size_t pkt_opts_pack(const struct pkt_opts *o, uint8_t *buf) {
+    size_t size = pkt_opts_size(o);
+
+    memcpy(buf, o->buf, o->len);
+    memset(buf + o->len, OPT_EOL, size - o->len);
+
+    return size;
+}
+
+static int opts_lookup(const struct pkt_opts *o, uint8_t kind) {
+    for (int i = 0; i < o->cnt; i++) {
+        if (o->opt[i].kind == kind)
+            return i;
+    }
+
+    return -1;
+}
+
+const uint8_t *pkt_opts_find(const struct pkt_opts *o, uint8_t kind,
+                             size_t *len) {
+    int i = opts_lookup(o, kind);
+    if (i < 0)
+        return NULL;
+
+    if ((kind == OPT_EOL) || (kind == OPT_NOP)) {
+        *len = 0;
+        return o->buf + o->opt[i].off;
+    }
+
+    *len = o->opt[i].len - 2;
+    return o->buf + o->opt[i].off + 2;
+}
+
+static void opts_remove(struct pkt_opts *o, int i) {
+    size_t off = o->opt[i].off;
+    size_t len = o->opt[i].len;
+
+    memmove(o->buf + off, o->buf + off + len, o->len - off - len);
+    o->len -= len;
+
+    for (int j = i + 1; j < o->cnt; j++) {
+        o->opt[j - 1]      = o->opt[j];
+        o->opt[j - 1].off -= len;
+    }
+
+    o->cnt--;
+}
+
+int pkt_opts_set(struct pkt_opts *o, uint8_t kind,
+                 const uint8_t *data, size_t len) {
+    int i;
+    size_t total = len + 2;
+
+    if ((kind == OPT_EOL) || (kind == OPT_NOP))
+        return -1;
+
+    i = opts_lookup(o, kind);
+
+    /* same size, rewrite the option data in place */
+    if ((i >= 0) && (o->opt[i].len == total)) {
+        memcpy(o->buf + o->opt[i].off + 2, data, len);
+        return 0;
+    }
+
+    if (i >= 0)
+        opts_remove(o, i);
+
+    /* new options go before the end of list, which is re-added as padding
+     * when the options are packed */
+    if ((o->cnt > 0) && (o->opt[o->cnt - 1].kind == OPT_EOL))
+        opts_remove(o, o->cnt - 1);
+
+    if ((o->len + total > OPT_MAX_LEN) || (o->cnt >= OPT_MAX_CNT))
+        return -1;
+
+    o->buf[o->len]     = kind;
+    o->buf[o->len + 1] = total;
+    memcpy(o->buf + o->len + 2, data, len);
+
+    o->opt[o->cnt].kind = kind;
+    o->opt[o->cnt].off  = o->len;
+    o->opt[o->cnt].len  = total;
+
+    o->cnt++;
+    o->len += total;
+
+    return 0;
+}
+
+int pkt_opts_del(struct pkt_opts *o, uint8_t kind) {
+    int i = opts_lookup(o, kind);
+    if (i < 0)
+        return -1;
+
+    opts_remove(o, i);
+
+    return 0;
+}
@@ -59,6 +59,9 @@ void pkt_pack_tcp(struct pkt *p, uint8_t *buf, size_t len) {
     out->chksum  = 0;
     out->urg_ptr = htons(p->p.tcp.urg_ptr);
 
+    if (p->length >= 20 + pkt_opts_size(&p->p.tcp.opts))
+        pkt_opts_pack(&p->p.tcp.opts, buf + 20);
+
     if (p->next && (p->next->type == TYPE_IP4))
         csum = pkt_pseudo_chksum(&p->next->p.ip4);
 
@@ -66,10 +69,12 @@ void pkt_pack_tcp(struct pkt *p, uint8_t *buf, size_t len) {
 }
 
 int pkt_unpack_tcp(struct pkt *p, uint8_t *buf, size_t len) {
+    size_t hlen;
+
     if (len < 20)
         return -1;
 
-    memcpy(&p->p.tcp, buf, sizeof(p->p.tcp));
+    memcpy(&p->p.tcp, buf, 20);
 
     p->p.tcp.sport   = ntohs(p->p.tcp.sport);
     p->p.tcp.dport   = ntohs(p->p.tcp.dport);
@@ -86,10 +91,13 @@ int pkt_unpack_tcp(struct pkt *p, uint8_t *buf, size_t len) {
     p->p.tcp.chksum  = ntohs(p->p.tcp.chksum);
     p->p.tcp.urg_ptr = ntohs(p->p.tcp.urg_ptr);
 
-    /* TODO: unpack TCP extensions */
+    hlen = p->p.tcp.doff * 4;
+
+    if ((hlen > 20) && (hlen <= len))
+        pkt_opts_parse(&p->p.tcp.opts, buf + 20, hlen - 20);
 
     p->type   = TYPE_TCP;
-    p->length = p->p.tcp.doff * 4;
+    p->length = hlen;
 
     return TYPE_RAW;
 }
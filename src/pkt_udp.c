@@ -40,6 +40,7 @@
 void pkt_pack_udp(struct pkt *p, uint8_t *buf, size_t len) {
     uint32_t csum = 0;
     struct udp_hdr *out = (struct udp_hdr *) buf;
+    struct pkt *raw = p->prev;
 
     out->sport  = htons(p->p.udp.sport);
     out->dport  = htons(p->p.udp.dport);
@@ -49,6 +50,13 @@ void pkt_pack_udp(struct pkt *p, uint8_t *buf, size_t len) {
     if (p->next && (p->next->type == TYPE_IP4))
         csum = pkt_pseudo_chksum(&p->next->p.ip4);
 
+    /* only sum the header when the payload sum is already known */
+    if (raw && (raw->type == TYPE_RAW) && raw->p.raw.ref &&
+        (len == 8 + raw->p.raw.len)) {
+        csum += raw->p.raw.csum;
+        len   = 8;
+    }
+
     out->chksum = pkt_chksum(buf, len, csum);
 }
 
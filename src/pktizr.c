@@ -28,12 +28,14 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <math.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <getopt.h>
 #include <fcntl.h>
+#include <time.h>
 
 #include <pthread.h>
 #include <signal.h>
@@ -42,40 +44,91 @@
 #include <net/if.h>
 
 #include <urcu/uatomic.h>
+#include <urcu-qsbr.h>
 
 #include "bucket.h"
+#include "count.h"
+#include "frag.h"
 #include "netdev.h"
+#include "payload.h"
 #include "shuffle.h"
 #include "ranges.h"
 #include "resolv.h"
 #include "routes.h"
 #include "queue.h"
+#include "ring.h"
+#include "rtt.h"
+#include "shared.h"
+#include "store.h"
+#include "tiers.h"
+#include "scan_map.h"
+#include "perf.h"
 #include "pkt.h"
 #include "printf.h"
 #include "util.h"
 #include "pktizr.h"
+#include "control.h"
+#include "daemon.h"
 #include "script.h"
 
-static const char *short_opts = "S:p:r:s:w:c:l:g:n:Roqh?";
+#define SHARED_SIZE (1 << 18)
+
+#define RATE_TICK   100000
+
+#define RING_SIZE   (1 << 16)
+
+#define RTT_SIZE    (1 << 16)
+#define RTT_MIN     16
+
+#define RECV_MAX    64
+
+/* iterations between RCU quiescent states (and configuration reloads) */
+#define CONF_TICK   64
+
+static const char *short_opts = "S:p:r:d:D:s:w:A:c:F:O:I:P:t:f:i:l:g:n:U:W:X:B:E:C:T:J:N:LMRoqh?";
 
 static bool stop = false;
+static bool perf_dump = false;
 
 static struct option long_opts[] = {
     { "script",      required_argument, NULL, 'S' },
     { "ports",       required_argument, NULL, 'p' },
     { "rate",        required_argument, NULL, 'r' },
+    { "duration",    required_argument, NULL, 'd' },
+    { "deadline",    required_argument, NULL, 'D' },
     { "seed",        required_argument, NULL, 's' },
     { "wait",        required_argument, NULL, 'w' },
+    { "adaptive-wait", required_argument, NULL, 'A' },
     { "count",       required_argument, NULL, 'c' },
+    { "sample",      required_argument, NULL, 'F' },
 
     { "local-addr",  required_argument, NULL, 'l' },
     { "gateway-addr",required_argument, NULL, 'g' },
 
     { "netdev",      required_argument, NULL, 'n' },
 
+    { "source-ports", required_argument, NULL, 'P' },
+    { "recv-threads", required_argument, NULL, 't' },
+    { "filter",      required_argument, NULL, 'f' },
+    { "interface",   required_argument, NULL, 'i' },
+    { "idle",        no_argument,       NULL, 'L' },
+    { "perf",        no_argument,       NULL, 'M' },
+
     { "shuffle",     no_argument,       NULL, 'R' },
     { "offline",     no_argument,       NULL, 'o' },
 
+    { "output-ring", required_argument, NULL, 'O' },
+    { "udp-payloads", required_argument, NULL, 'U' },
+    { "output-store", required_argument, NULL, 'W' },
+    { "follow",      required_argument, NULL, 'X' },
+    { "prior",       required_argument, NULL, 'B' },
+    { "exclude",     required_argument, NULL, 'E' },
+    { "control",     required_argument, NULL, 'C' },
+    { "daemon",      required_argument, NULL, 'J' },
+    { "port-order",  required_argument, NULL, 'T' },
+    { "shard",       required_argument, NULL, 'N' },
+    { "count-interval", required_argument, NULL, 'I' },
+
     { "quiet",       no_argument,       NULL, 'q' },
 
     { "help",        no_argument,       NULL, 'h' },
@@ -86,23 +139,40 @@ static void *recv_cb(void *p);
 static void *loop_cb(void *p);
 
 static void status_line(struct pktizr_args *args);
+static void idle_line(struct pktizr_args *args);
+static void sample_estimate(struct pktizr_args *args, double *est, double *err);
+static double expected_replies(struct pktizr_args *args, uint64_t elapsed);
+static void dump_counters(struct pktizr_args *args);
+static void dump_perf(struct pktizr_args *args);
 static void setup_signals(void);
 
 static uint64_t get_entropy(void);
+static uint64_t parse_deadline(const char *str);
+static void follow_ranges(struct pktizr_args *args, bool targets, bool ports);
+static void prior_load(struct pktizr_args *args, const char *path);
+static ssize_t prior_find(struct pktizr_args *args, uint32_t addr,
+                          uint16_t port);
+static void prior_report(struct pktizr_args *args);
+static void tiers_setup(struct pktizr_args *args, const char *rank_file);
+static void setup_tx_prefix(struct pktizr_args *args);
+static struct scan_map *map_setup(struct pktizr_args *args);
 
 static inline void help(void);
 
-#define START_THREAD(MUTEX, COND, THREAD, FUNC, ARGS)   \
-    pthread_mutex_init(&ARGS->MUTEX, NULL);     \
-    pthread_cond_init(&ARGS->COND, NULL);       \
+#define START_THREAD(MUTEX, COND, THREAD, FUNC, ARGS, DATA)  \
     pthread_mutex_lock(&ARGS->MUTEX);       \
-    pthread_create(&ARGS->THREAD, NULL, FUNC, ARGS);\
+    pthread_create(&THREAD, NULL, FUNC, DATA);  \
     pthread_cond_wait(&ARGS->COND, &ARGS->MUTEX);   \
     pthread_mutex_unlock(&ARGS->MUTEX);     \
 
 int main(int argc, char *argv[]) {
     int rc, i;
 
+    bool rate_set = false;
+    bool ports_set = false;
+    bool seed_set = false;
+    bool perf = false;
+
     _free_ struct pktizr_args *args = NULL;
 
     _free_ char *local_addr = NULL;
@@ -110,22 +180,49 @@ int main(int argc, char *argv[]) {
 
     _free_ char *netdev = NULL;
 
-    if (argc < 4) {
+    _free_ char *output_ring = NULL;
+    _free_ char *udp_payloads = NULL;
+    _free_ char *output_store = NULL;
+    _free_ char *follow = NULL;
+    _free_ char *prior = NULL;
+    _free_ char *control = NULL;
+    _free_ char *port_order = NULL;
+    _free_ char *daemon_path = NULL;
+
+    struct range *exclude = NULL;
+
+    _free_ char *filter = NULL;
+    _free_ char *interface = NULL;
+
+    if (argc < 2) {
         help();
         return 0;
     }
 
     args = malloc(sizeof(*args));
 
-    /* TODO: add --exclude option */
-
-    args->targets = range_parse_targets(args, argv[1]);
+    args->targets = NULL;
     args->ports   = range_parse_ports(args, "1");
     args->rate    = 100;
+    args->deadline = 0;
     args->seed    = get_entropy();
     args->wait    = 5;
+    args->adaptive_wait = 0;
     args->count   = 1;
-    args->script  = NULL;
+    args->sample  = 0;
+    args->recv_cnt  = 1;
+    args->counters  = NULL;
+    args->counters_interval = 0;
+    args->sport_min = 0;
+    args->sport_max = 0;
+    args->scripts = NULL;
+    args->script_cnt = 0;
+    args->shuffle = false;
+    args->shard   = 0;
+    args->shard_cnt = 1;
+    args->offline = false;
+    args->idle    = false;
+    args->perf    = NULL;
     args->quiet   = !isatty(STDERR_FILENO);
     args->done    = false;
     args->stop    = false;
@@ -135,7 +232,12 @@ int main(int argc, char *argv[]) {
 
         switch (rc) {
         case 'S':
-            args->script = strdup(optarg);
+            args->scripts = realloc(args->scripts, (args->script_cnt + 1) *
+                                                   sizeof(*args->scripts));
+            if (args->scripts == NULL)
+                fail_printf("OOM");
+
+            args->scripts[args->script_cnt++] = strdup(optarg);
             break;
 
         case 'p':
@@ -143,18 +245,36 @@ int main(int argc, char *argv[]) {
             free(args->ports);
 
             args->ports = range_parse_ports(args, optarg);
+            ports_set = true;
             break;
 
         case 'r':
             args->rate = strtoull(optarg, &end, 10);
             if (*end != '\0')
                 fail_printf("Invalid rate value");
+
+            rate_set = true;
+            break;
+
+        case 'd': {
+            uint64_t duration = strtoull(optarg, &end, 10);
+            if ((*end != '\0') || (duration == 0))
+                fail_printf("Invalid duration value");
+
+            args->deadline = time_now() + duration * 1000000;
+            break;
+        }
+
+        case 'D':
+            args->deadline = parse_deadline(optarg);
             break;
 
         case 's':
             args->seed = strtoull(optarg, &end, 10);
             if (*end != '\0')
                 fail_printf("Invalid seed value");
+
+            seed_set = true;
             break;
 
         case 'w':
@@ -163,12 +283,27 @@ int main(int argc, char *argv[]) {
                 fail_printf("Invalid wait value");
             break;
 
+        case 'A':
+            args->adaptive_wait = strtod(optarg, &end);
+            if ((*end != '\0') || (args->adaptive_wait <= 0))
+                fail_printf("Invalid adaptive wait value");
+            break;
+
         case 'c':
             args->count = strtoull(optarg, &end, 10);
             if (*end != '\0')
                 fail_printf("Invalid wait value");
             break;
 
+        case 'F':
+            args->sample = strtod(optarg, &end);
+            if ((*end != '\0') || (args->sample <= 0) || (args->sample > 1))
+                fail_printf("Invalid sample value");
+
+            /* only a shuffled prefix of the scan is a uniform sample */
+            args->shuffle = true;
+            break;
+
         case 'R':
             args->shuffle = true;
             break;
@@ -192,6 +327,120 @@ int main(int argc, char *argv[]) {
             netdev = strdup(optarg);
             break;
 
+        case 'P': {
+            unsigned long min, max;
+
+            min = max = strtoul(optarg, &end, 10);
+            if (*end == '-')
+                max = strtoul(end + 1, &end, 10);
+
+            if ((*end != '\0') || (min == 0) || (min > max) || (max > 65535))
+                fail_printf("Invalid source ports value");
+
+            args->sport_min = min;
+            args->sport_max = max;
+            break;
+        }
+
+        case 't':
+            args->recv_cnt = strtoull(optarg, &end, 10);
+            if ((*end != '\0') || (args->recv_cnt == 0) ||
+                (args->recv_cnt > RECV_MAX))
+                fail_printf("Invalid recv threads value");
+            break;
+
+        case 'f':
+            freep(&filter);
+            filter = strdup(optarg);
+            break;
+
+        case 'i':
+            freep(&interface);
+            interface = strdup(optarg);
+            break;
+
+        case 'L':
+            args->idle = true;
+            break;
+
+        case 'M':
+            perf = true;
+            break;
+
+        case 'O':
+            freep(&output_ring);
+            output_ring = strdup(optarg);
+            break;
+
+        case 'U':
+            freep(&udp_payloads);
+            udp_payloads = strdup(optarg);
+            break;
+
+        case 'W':
+            freep(&output_store);
+            output_store = strdup(optarg);
+            break;
+
+        case 'X':
+            freep(&follow);
+            follow = strdup(optarg);
+            break;
+
+        case 'B':
+            freep(&prior);
+            prior = strdup(optarg);
+            break;
+
+        case 'E': {
+            struct range *list, *cur;
+
+            validate_optlist("--exclude", optarg);
+
+            list = range_parse_targets(args, optarg);
+
+            for (cur = list; cur != NULL; cur = cur->next)
+                range_list_add(args, &exclude, cur->start, cur->end);
+
+            range_list_free(list);
+            break;
+        }
+
+        case 'C':
+            freep(&control);
+            control = strdup(optarg);
+            break;
+
+        case 'T':
+            freep(&port_order);
+            port_order = strdup(optarg);
+            break;
+
+        case 'N':
+            /* "<k>/<n>", with k starting at 1 */
+            args->shard = strtoull(optarg, &end, 10);
+            if ((end == optarg) || (*end != '/'))
+                fail_printf("Invalid shard value");
+
+            args->shard_cnt = strtoull(end + 1, &end, 10);
+            if ((*end != '\0') || !args->shard ||
+                (args->shard > args->shard_cnt))
+                fail_printf("Invalid shard value");
+
+            args->shard--;
+            break;
+
+        case 'J':
+            freep(&daemon_path);
+            daemon_path = strdup(optarg);
+            break;
+
+        case 'I':
+            args->counters_interval = strtoull(optarg, &end, 10);
+            if (*end != '\0')
+                fail_printf("Invalid count interval value");
+            break;
+
         case 'q':
             args->quiet = true;
             break;
@@ -203,112 +452,481 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    if (!args->script)
+    /* "pktizrd <socket>" is the same as "pktizr --daemon <socket>" */
+    const char *prog = strrchr(argv[0], '/');
+    prog = prog ? prog + 1 : argv[0];
+
+    if (!daemon_path && !strcmp(prog, "pktizrd")) {
+        if (optind >= argc)
+            fail_printf("No daemon socket provided");
+
+        daemon_path = strdup(argv[optind++]);
+    }
+
+    /* jobs bring their own targets, ports and scripts */
+    if (daemon_path) {
+        if (args->idle || follow || prior || output_store || output_ring ||
+            port_order || (args->sample > 0) || args->deadline ||
+            (args->shard_cnt > 1))
+            fail_printf("Option not supported with --daemon");
+
+        if (args->recv_cnt > 1)
+            fail_printf("--daemon requires a single recv thread");
+    }
+
+    if (!args->script_cnt && !daemon_path)
         fail_printf("No script provided");
 
+    args->follow = follow ? store_open(follow) : NULL;
+
+    if (!args->idle && !daemon_path && (optind < argc))
+        args->targets = range_parse_targets(args, argv[optind]);
+
+    if (args->follow)
+        follow_ranges(args, !args->targets, !ports_set);
+
+    if (!args->idle && !daemon_path && !args->targets)
+        fail_printf("No targets provided");
+
+    if (prior && (args->sample > 0))
+        fail_printf("--prior can't be combined with --sample");
+
+    /* the shards of a scan only partition it if they are permuted the same */
+    if ((args->shard_cnt > 1) && args->shuffle && !seed_set)
+        fail_printf("--shard requires --seed when shuffling");
+
+    args->tiers = NULL;
+
+    /* "tiered" or "tiered:<file>" */
+    if (port_order && strcmp(port_order, "linear")) {
+        if (strncmp(port_order, "tiered", 6) ||
+            ((port_order[6] != '\0') && (port_order[6] != ':')))
+            fail_printf("Invalid port order '%s'", port_order);
+
+        if (args->sample > 0)
+            fail_printf("--port-order can't be combined with --sample");
+
+        if (!args->idle)
+            tiers_setup(args, port_order[6] ? port_order + 7 : NULL);
+    }
+
+    args->prior         = NULL;
+    args->prior_cnt     = 0;
+    args->prior_seen    = NULL;
+    args->prior_changes = 0;
+
+    if (prior && !args->idle)
+        prior_load(args, prior);
+
+    args->map = daemon_path ? NULL : map_setup(args);
+
+    args->script_stats = calloc(args->script_cnt + 1,
+                                sizeof(*args->script_stats));
+    if (args->script_stats == NULL)
+        fail_printf("OOM");
+
+    /* with a deadline the rate is computed dynamically, -r is only the cap */
+    if (args->deadline && !rate_set)
+        args->rate = 0;
+
+    args->conf = conf_new(args->rate, exclude);
+
     struct route route;
-    rc = routes_get_default(&route);
-    if (rc < 0)
-        fail_printf("Error getting routes");
+    char *if_name = interface;
 
-    if (gateway_addr)
-        args->local_addr = ntohl(inet_addr(gateway_addr));
-    else
-        args->gateway_addr = ntohl(route.gate_addr);
+    /* in idle mode the default route is only needed to pick the interface */
+    if (!args->idle || !interface) {
+        rc = routes_get_default(&route);
+        if (rc < 0)
+            fail_printf("Error getting routes");
+
+        if (gateway_addr)
+            args->local_addr = ntohl(inet_addr(gateway_addr));
+        else
+            args->gateway_addr = ntohl(route.gate_addr);
+
+        if (!if_name)
+            if_name = route.if_name;
+    }
 
-    rc = resolve_ifname_to_mac(route.if_name, args->local_mac);
+    rc = resolve_ifname_to_mac(if_name, args->local_mac);
     if (rc < 0)
         fail_printf("Error resolving local MAC");
 
     if (local_addr) {
         args->local_addr = ntohl(inet_addr(local_addr));
     } else {
-        rc = resolve_ifname_to_ip(route.if_name, &args->local_addr);
-        if (rc < 0)
+        rc = resolve_ifname_to_ip(if_name, &args->local_addr);
+        if ((rc < 0) && !args->idle)
             fail_printf("Error resolving local IP");
     }
 
-    args->netdev = netdev_open(netdev, route.if_name);
+    args->netdev = netdev_open(netdev, if_name);
     if (!args->netdev)
         fail_printf("Error opening netdev");
 
-    rc = resolv_addr_to_mac(args->netdev,
-                            args->local_mac, args->local_addr,
-                            args->gateway_mac, args->gateway_addr);
-    if (rc < 0)
-        fail_printf("Error resolving local MAC");
+    if (!args->idle) {
+        rc = resolv_addr_to_mac(args->netdev,
+                                args->local_mac, args->local_addr,
+                                args->gateway_mac, args->gateway_addr);
+        if (rc < 0)
+            fail_printf("Error resolving local MAC");
+
+        setup_tx_prefix(args);
+    }
+
+    args->recv = calloc(args->recv_cnt, sizeof(*args->recv));
+    if (args->recv == NULL)
+        fail_printf("OOM");
+
+    for (size_t r = 0; r < args->recv_cnt; r++) {
+        args->recv[r].args   = args;
+        args->recv[r].netdev = args->netdev;
+
+        if (args->recv_cnt == 1)
+            break;
+
+        /* the first receive socket is shared with the TX path */
+        if (r > 0) {
+            args->recv[r].netdev = netdev_open(netdev, if_name);
+            if (!args->recv[r].netdev)
+                fail_printf("Error opening netdev");
+        }
+
+        rc = netdev_fanout(args->recv[r].netdev, getpid() & 0xffff);
+        if (rc < 0)
+            fail_printf("Netdev doesn't support multiple recv threads");
+    }
+
+    for (size_t r = 0; filter && (r < args->recv_cnt); r++) {
+        rc = netdev_filter(args->recv[r].netdev, filter);
+        if (rc < 0)
+            fail_printf("Error setting capture filter");
+    }
+
+    /* the result ring only supports a single writer */
+    if (output_ring && (args->recv_cnt > 1))
+        fail_printf("--output-ring requires a single recv thread");
 
     queue_init(&args->queue);
 
-    START_THREAD(recv_mutex, recv_started, recv_thread, recv_cb, args);
-    START_THREAD(loop_mutex, loop_started, loop_thread, loop_cb, args);
+    args->shared = shared_new(SHARED_SIZE);
+
+    args->ring = output_ring ? ring_create(output_ring, RING_SIZE) : NULL;
+
+    args->payloads = udp_payloads ? payload_open(udp_payloads) : NULL;
+
+    args->store = output_store ? store_new() : NULL;
+
+    args->rtt = NULL;
+
+    if (args->adaptive_wait > 0) {
+        args->rtt = malloc(sizeof(*args->rtt));
+        if (args->rtt == NULL)
+            fail_printf("OOM");
+
+        rtt_init(args->rtt, RTT_SIZE);
+    }
+
+    args->pkt_recv = 0;
+
+    pthread_mutex_init(&args->recv_mutex, NULL);
+    pthread_cond_init(&args->recv_started, NULL);
+
+    pthread_mutex_init(&args->loop_mutex, NULL);
+    pthread_cond_init(&args->loop_started, NULL);
+
+    pthread_mutex_init(&args->counters_mutex, NULL);
+
+    pthread_mutex_init(&args->store_mutex, NULL);
+
+    if (perf) {
+        args->perf = malloc((args->recv_cnt + 1) * sizeof(*args->perf));
+        if (args->perf == NULL)
+            fail_printf("OOM");
+
+        for (size_t r = 0; r < args->recv_cnt + 1; r++)
+            perf_init(&args->perf[r]);
+    }
+
+    args->daemon = NULL;
+
+    if (daemon_path) {
+        daemon_start(args, daemon_path);
+    } else {
+        for (size_t r = 0; r < args->recv_cnt; r++) {
+            START_THREAD(recv_mutex, recv_started, args->recv[r].thread,
+                         recv_cb, args, &args->recv[r]);
+        }
+
+        START_THREAD(loop_mutex, loop_started, args->loop_thread,
+                     loop_cb, args, args);
+    }
+
+    args->control_fd = -1;
+
+    if (control)
+        control_start(args, control);
 
     setup_signals();
 
-    status_line(args);
+    if (args->daemon) {
+        while (!stop)
+            time_sleep(250000);
+    } else if (args->idle) {
+        idle_line(args);
+    } else {
+        status_line(args);
+    }
 
     args->done = true;
 
-    pthread_join(args->recv_thread, NULL);
+    for (size_t r = 0; r < args->recv_cnt; r++)
+        pthread_join(args->recv[r].thread, NULL);
+
     pthread_join(args->loop_thread, NULL);
 
+    control_stop(args);
+
+    daemon_stop(args);
+
+    conf_free(args->conf);
+
+    if (args->perf) {
+        dump_perf(args);
+
+        for (size_t r = 0; r < args->recv_cnt + 1; r++)
+            perf_close(&args->perf[r]);
+
+        free(args->perf);
+    }
+
+    for (size_t r = 1; r < args->recv_cnt; r++)
+        netdev_close(args->recv[r].netdev);
+
     netdev_close(args->netdev);
 
+    uint64_t frags = 0, frags_done = 0, frags_dropped = 0;
+
+    for (size_t r = 0; r < args->recv_cnt; r++) {
+        frags         += args->recv[r].frags->frags;
+        frags_done    += args->recv[r].frags->done;
+        frags_dropped += args->recv[r].frags->dropped;
+
+        frag_table_free(args->recv[r].frags);
+        free(args->recv[r].frags);
+    }
+
+    if (frags)
+        fprintf(stderr, "Fragments: %zu received, %zu reassembled, "
+                        "%zu dropped\n", frags, frags_done, frags_dropped);
+
+    free(args->recv);
+
+    shared_free(args->shared);
+
+    if (args->ring) {
+        ring_finish(args->ring);
+        ring_close(args->ring);
+    }
+
+    if (args->payloads)
+        payload_free(args->payloads);
+
+    if (args->store) {
+        if (store_save(args->store, output_store) < 0)
+            err_printf("Error writing result store %s", output_store);
+
+        store_free(args->store);
+    }
+
+    if (args->follow)
+        store_close(args->follow);
+
+    if (args->rtt) {
+        rtt_free(args->rtt);
+        free(args->rtt);
+    }
+
+    if (args->prior) {
+        prior_report(args);
+
+        free(args->prior);
+        free(args->prior_seen);
+    }
+
+    if (args->counters)
+        dump_counters(args);
+
+    while (args->counters) {
+        struct count_table *t = args->counters;
+
+        args->counters = t->next;
+        count_free(t);
+    }
+
+    if (args->script_cnt > 1) {
+        for (size_t s = 0; s < args->script_cnt; s++)
+            fprintf(stderr, "%s: %zu probes, %zu replies\n", args->scripts[s],
+                    args->script_stats[s].probe, args->script_stats[s].recv);
+    }
+
+    if (args->tiers) {
+        tiers_free(args->tiers);
+        free(args->tiers);
+    }
+
+    free(args->map);
+
     range_list_free(args->targets);
     range_list_free(args->ports);
-    free(args->script);
+
+    for (size_t s = 0; s < args->script_cnt; s++)
+        free(args->scripts[s]);
+
+    free(args->scripts);
+    free(args->script_stats);
 
     return 0;
 }
 
 static void *recv_cb(void *p) {
-    struct pktizr_args *args = p;
+    struct recv_ctx    *ctx  = p;
+    struct pktizr_args *args = ctx->args;
 
-    void *L = script_load(args);
+    struct script *L[args->script_cnt];
 
-    args->pkt_recv = 0;
+    for (size_t s = 0; s < args->script_cnt; s++)
+        L[s] = script_load(args, args->scripts[s]);
+
+    ctx->frags = malloc(sizeof(*ctx->frags));
+    if (ctx->frags == NULL)
+        fail_printf("OOM");
+
+    frag_table_init(ctx->frags, FRAG_SLOTS, FRAG_TIMEOUT);
 
     if (pthread_setname_np(pthread_self(), "pktizr: recv"))
         fail_printf("Error setting thread name");
 
+    if (args->perf)
+        perf_open(&args->perf[1 + (ctx - args->recv)]);
+
+    rcu_register_thread();
+
+    struct pktizr_conf *conf = rcu_dereference(args->conf);
+    unsigned tick = 0;
+
     pthread_mutex_lock(&args->recv_mutex);
     pthread_cond_signal(&args->recv_started);
     pthread_mutex_unlock(&args->recv_mutex);
 
     while (!args->done) {
         int rc, len;
-        struct pkt *pkt = NULL;
+        size_t s;
+
+        for (s = 0; s < args->script_cnt; s++)
+            script_expire(L[s], args);
+
+        const uint8_t *buf = netdev_capture(ctx->netdev, &len);
+
+        if ((buf == NULL) || !(++tick % CONF_TICK)) {
+            rcu_quiescent_state();
+            conf = rcu_dereference(args->conf);
+        }
 
-        const uint8_t *buf = netdev_capture(args->netdev, &len);
         if (buf == NULL)
             continue;
 
-        rc = pkt_unpack((uint8_t *) buf, len, &pkt);
-        if (!rc)
+        CMM_STORE_SHARED(ctx->frames, ctx->frames + 1);
+
+        /* scripts only get to see complete datagrams */
+        if (frag_is_fragment(buf, len)) {
+            size_t frag_len;
+
+            rc = frag_add(ctx->frags, buf, len, time_now(), &buf, &frag_len);
+            if (rc <= 0)
+                goto done;
+
+            len = frag_len;
+        }
+
+        uint32_t saddr = 0;
+        uint16_t sport = 0;
+        if (args->rtt || args->store || args->prior || conf->exclude)
+            reply_key(buf, len, &saddr, &sport);
+
+        if (conf->exclude && saddr && range_list_has(conf->exclude, saddr))
             goto done;
 
-        rc = script_recv(L, args, pkt);
-        if (rc < 0)
+        /* unchanged replies are only recorded, not reported by scripts */
+        ssize_t prior_idx = -1;
+        if (args->prior && saddr)
+            prior_idx = prior_find(args, saddr, sport);
+
+        /*
+         * Dispatch the reply to each script in turn, until one of them claims
+         * it. Every script driver parses the frame on its own, e.g. Lua
+         * scripts take ownership of the unpacked packets.
+         */
+        for (s = 0; s < args->script_cnt; s++) {
+            if (args->prior)
+                script_mute(L[s], prior_idx >= 0);
+
+            rc = script_recv(L[s], args, buf, len);
+            if (rc >= 0)
+                break;
+        }
+
+        if (s == args->script_cnt)
             goto done;
 
-        args->pkt_recv++;
+        if (prior_idx >= 0)
+            args->prior_seen[prior_idx] = 1;
+        else if (args->prior)
+            uatomic_inc(&args->prior_changes);
+
+        if (args->rtt && saddr)
+            rtt_recv(args->rtt, saddr, sport, time_now());
+
+        if (args->store && saddr) {
+            pthread_mutex_lock(&args->store_mutex);
+            store_add(args->store, saddr, sport);
+            pthread_mutex_unlock(&args->store_mutex);
+        }
+
+        uatomic_inc(&args->script_stats[s].recv);
+        uatomic_inc(&args->pkt_recv);
 
 done:
-        netdev_release(args->netdev);
+        netdev_release(ctx->netdev);
     }
 
-    script_close(L);
+    for (size_t s = 0; s < args->script_cnt; s++)
+        script_close(L[s]);
+
+    rcu_unregister_thread();
 
     return NULL;
 }
 
 int pkt_send(struct pktizr_args *args, struct pkt *pkt) {
     uint8_t *buf;
-    size_t   len;
+    size_t   len, prefix_len = 0;
+
+    if (pkt->flags & PKT_FRAME)
+        return pkt_send_frame(args, pkt->p.raw.payload, pkt->p.raw.len,
+                              pkt->flags);
 
-    buf = netdev_get_buf(args->netdev, &len);
+    /* the outermost header is the last one */
+    if (pkt->prev->flags & PKT_ETH_PREFIX)
+        prefix_len = args->netdev->prefix_len;
+
+    if (prefix_len)
+        buf = netdev_get_prefixed_buf(args->netdev, &len);
+    else
+        buf = netdev_get_buf(args->netdev, &len);
 
-    int pkt_len = pkt_pack(buf, len, pkt);
+    int pkt_len = pkt_pack_prefix(buf, len, pkt, prefix_len);
     if (pkt_len < 0)
         return -1;
 
@@ -320,52 +938,209 @@ int pkt_send(struct pktizr_args *args, struct pkt *pkt) {
     return 0;
 }
 
-static void *loop_cb(void *p) {
-    struct pktizr_args *args = p;
+/*
+ * Derive the source port for a probe from the cookie of its destination, so
+ * that replies can be validated without keeping any state.
+ */
+uint16_t pkt_source_port(struct pktizr_args *args, uint32_t daddr,
+                         uint16_t dport) {
+    uint64_t cookie;
+    uint32_t range = args->sport_max - args->sport_min + 1;
 
-    int rc;
+    if (!args->sport_min)
+        return 0;
 
-    size_t i = 0;
+    cookie = pkt_cookie(htonl(args->local_addr), htonl(daddr), 0, dport,
+                        args->seed);
 
-    struct pkt *pkt;
-    struct queue_node *node;
+    return args->sport_min + (cookie % range);
+}
 
-    void *L = script_load(args);
+int pkt_send_frame(struct pktizr_args *args, const uint8_t *frame, size_t len,
+                   unsigned flags) {
+    uint8_t *buf;
+    size_t   buf_len, off = 0;
 
-    size_t tgt_cnt = range_list_count(args->targets);
-    size_t prt_cnt = range_list_count(args->ports);
-    size_t tot_cnt = tgt_cnt * prt_cnt * args->count;
+    /* the Ethernet header of L3 frames is the TX prefix, when there's one */
+    if (!(flags & PKT_FRAME_L2) && args->netdev->prefix_len) {
+        buf = netdev_get_prefixed_buf(args->netdev, &buf_len);
+        off = args->netdev->prefix_len;
+    } else {
+        buf = netdev_get_buf(args->netdev, &buf_len);
+    }
 
-    struct bucket bucket;
-    bucket_init(&bucket, args->rate);
+    if (!(flags & PKT_FRAME_L2) && !off) {
+        struct pkt eth;
 
-    struct shuffle rnd;
-    shuffle_init(&rnd, tot_cnt, args->seed);
+        pkt_build_eth(&eth, args->local_mac, args->gateway_mac,
+                      ETHERTYPE_IP);
 
-    args->pkt_count = tot_cnt;
-    args->pkt_sent  = 0;
-    args->pkt_probe = 0;
+        if (buf_len < eth.length)
+            return -1;
 
-    if (pthread_setname_np(pthread_self(), "pktizr: loop"))
-        fail_printf("Error setting thread name");
+        pkt_pack_eth(&eth, buf, eth.length);
+        off = eth.length;
+    }
 
-    if (!args->quiet)
-        printf("Scanning %zu ports on %zu hosts...\n",
-               prt_cnt, tgt_cnt);
+    if (pkt_pack_frame(buf + off, buf_len - off, frame, len, flags) < 0)
+        return -1;
 
-    pthread_mutex_lock(&args->loop_mutex);
-    pthread_cond_signal(&args->loop_started);
-    pthread_mutex_unlock(&args->loop_mutex);
+    if (caa_likely(!args->offline))
+        netdev_inject(args->netdev, buf, off + len);
 
-    while (!args->done) {
-        uint64_t tgt;
+    args->pkt_sent++;
 
-        uint32_t daddr;
-        uint16_t dport;
+    return 0;
+}
 
-        bucket_consume(&bucket);
+/*
+ * Compute the rate needed to send the remaining probes before the deadline,
+ * based on the actual time left, so that any drift from the expected throughput
+ * is compensated for. The rate given with --rate (if any) is an upper bound.
+ */
+static uint64_t deadline_rate(struct pktizr_args *args, size_t left,
+                              uint64_t now) {
+    uint64_t rate;
 
-        node = queue_dequeue(&args->queue);
+    if (now >= args->deadline)
+        return args->rate;
+
+    rate = ceil(left / ((args->deadline - now) / 1e6));
+    if (rate == 0)
+        rate = 1;
+
+    if (args->rate && (rate > args->rate))
+        rate = args->rate;
+
+    return rate;
+}
+
+/*
+ * Return the port the replies to a probe are expected to come from, as found
+ * by reply_key(): the destination port of its TCP or UDP header, 0 if it has
+ * none (e.g. ICMP probes). Raw frames are assumed to be sent to dport.
+ */
+static uint16_t probe_port(struct pkt *pkt, uint16_t dport) {
+    if ((pkt == NULL) || (pkt->flags & PKT_FRAME))
+        return dport;
+
+    for (struct pkt *cur = pkt; cur != NULL; cur = cur->next) {
+        if (cur->type == TYPE_TCP)
+            return cur->p.tcp.dport;
+
+        if (cur->type == TYPE_UDP)
+            return cur->p.udp.dport;
+    }
+
+    return 0;
+}
+
+static void *loop_cb(void *p) {
+    struct pktizr_args *args = p;
+
+    int rc;
+
+    size_t i = 0;
+
+    struct pkt *pkt;
+    struct queue_node *node;
+
+    struct script *L[args->script_cnt];
+
+    for (size_t s = 0; s < args->script_cnt; s++)
+        L[s] = script_load(args, args->scripts[s]);
+
+    size_t scr_cnt = args->script_cnt;
+    size_t tgt_cnt = range_list_count(args->targets);
+    size_t prt_cnt = range_list_count(args->ports);
+
+    /* the --prior pairs are mapped as targets with a single port */
+    size_t pri_end = 1;
+    struct scan_map pri_map;
+
+    scan_map_init(&pri_map, args->prior_cnt, &pri_end, 1,
+                  args->count * scr_cnt, args->shuffle, args->seed);
+    scan_map_shard(&pri_map, args->shard, args->shard_cnt);
+
+    size_t pri_cnt = scan_map_count(&pri_map);
+    size_t scn_cnt = scan_map_count(args->map);
+    size_t tot_cnt = pri_cnt + scn_cnt;
+    size_t max_cnt = tot_cnt;
+
+    struct bucket bucket;
+    bucket_init(&bucket, args->rate);
+
+    if (args->sample > 0)
+        max_cnt = ceil(tot_cnt * args->sample);
+
+    args->pkt_total = tot_cnt;
+    args->pkt_count = max_cnt;
+
+    uint64_t rate_tick = 0;
+
+    if (args->deadline) {
+        uint64_t now = time_now();
+        double   left = (args->deadline > now) ?
+                          (args->deadline - now) / 1e6 : 0;
+
+        if (args->rate && (max_cnt > left * args->rate))
+            err_printf("Deadline can't be met at %zu pps (%.0f seconds needed, %.0f left)",
+                       args->rate, (double) max_cnt / args->rate, left);
+    }
+    args->pkt_sent  = 0;
+    args->pkt_probe = 0;
+
+    if (pthread_setname_np(pthread_self(), "pktizr: loop"))
+        fail_printf("Error setting thread name");
+
+    if (args->perf && !perf_open(&args->perf[0]))
+        err_printf("Hardware counters not available, "
+                   "check /proc/sys/kernel/perf_event_paranoid");
+
+    rcu_register_thread();
+
+    struct pktizr_conf *conf = rcu_dereference(args->conf);
+    unsigned tick = 0;
+
+    if (!args->quiet && !args->idle)
+        printf("Scanning %zu ports on %zu hosts...\n",
+               prt_cnt, tgt_cnt);
+
+    pthread_mutex_lock(&args->loop_mutex);
+    pthread_cond_signal(&args->loop_started);
+    pthread_mutex_unlock(&args->loop_mutex);
+
+    while (!args->done) {
+        struct scan_probe probe;
+        size_t scr;
+
+        uint32_t daddr;
+        uint16_t dport;
+
+        /* pick up the configuration published by the control socket */
+        if (!(++tick % CONF_TICK) || conf->paused) {
+            rcu_quiescent_state();
+            conf = rcu_dereference(args->conf);
+
+            if (conf->rate != args->rate) {
+                args->rate = conf->rate;
+                bucket_set_rate(&bucket, args->rate);
+                rate_tick = 0;
+            }
+        }
+
+        if (args->deadline) {
+            uint64_t now = time_now();
+
+            if (now >= rate_tick) {
+                bucket_set_rate(&bucket, deadline_rate(args, max_cnt - i, now));
+                rate_tick = now + RATE_TICK;
+            }
+        }
+
+        bucket_consume(&bucket);
+
+        node = queue_dequeue(&args->queue);
         if (!node)
             goto script;
 
@@ -377,24 +1152,79 @@ static void *loop_cb(void *p) {
         goto done;
 
 script:
-        if (caa_unlikely((i >= tot_cnt) || args->stop))
+        if (caa_unlikely((i >= max_cnt) || args->stop))
+            continue;
+
+        if (caa_unlikely(conf->paused)) {
+            time_sleep(1000);
             continue;
+        }
+
+        /* the pairs that responded to the --prior scan go first */
+        if (i < pri_cnt) {
+            scan_map_pick(&pri_map, i, &probe);
+
+            scr = probe.rep % scr_cnt;
+
+            daddr = args->prior[probe.addr] >> 16;
+            dport = args->prior[probe.addr] & 0xffff;
 
-        tgt = (args->shuffle) ? shuffle(&rnd, i) : i;
+            i++;
+            goto probe;
+        }
+
+        scan_map_pick(args->map, i - pri_cnt, &probe);
+
+        /* interleave the probes of all the scripts */
+        scr = probe.rep % scr_cnt;
 
-        daddr = range_list_pick(args->targets,
-                                (tgt % tgt_cnt) / args->count);
-        dport = range_list_pick(args->ports,
-                                (tgt / tgt_cnt) / args->count);
+        daddr = range_list_pick(args->targets, probe.addr);
+
+        if (args->tiers)
+            dport = args->tiers->ports[probe.port];
+        else
+            dport = range_list_pick(args->ports, probe.port);
 
         i++;
 
-        rc = script_loop(L, args, &pkt, daddr, dport);
+        if (args->prior_cnt && (prior_find(args, daddr, dport) >= 0)) {
+            args->pkt_probe++;
+            continue;
+        }
+
+probe:
+
+        if (shared_skip(args->shared, daddr)) {
+            args->pkt_probe++;
+            continue;
+        }
+
+        if (conf->exclude && range_list_has(conf->exclude, daddr)) {
+            args->pkt_probe++;
+            continue;
+        }
+
+        if (args->follow) {
+            const struct store_host *h = store_find(args->follow, daddr);
+
+            if (!h || !store_has(args->follow, h, dport)) {
+                args->pkt_probe++;
+                continue;
+            }
+        }
+
+        rc = script_loop(L[scr], args, &pkt, daddr, dport);
         if (caa_unlikely(rc < 0))
             continue;
 
-        pkt_send(args, pkt);
+        /* raw frames returned by loop() have already been sent */
+        if (pkt)
+            pkt_send(args, pkt);
 
+        if (args->rtt)
+            rtt_sent(args->rtt, daddr, probe_port(pkt, dport), time_now());
+
+        args->script_stats[scr].probe++;
         args->pkt_probe++;
         bucket.tokens--;
 
@@ -402,7 +1232,10 @@ done:
         pkt_free_all(pkt);
     }
 
-    script_close(L);
+    for (size_t s = 0; s < args->script_cnt; s++)
+        script_close(L[s]);
+
+    rcu_unregister_thread();
 
     return NULL;
 }
@@ -411,6 +1244,8 @@ static void status_line(struct pktizr_args *args) {
     uint64_t tot      = args->pkt_count;
     uint64_t now_old  = time_now();
     uint64_t sent_old = args->pkt_sent;
+    uint64_t chg_old  = args->prior_changes;
+    uint64_t dump_at  = now_old + args->counters_interval * 1000000;
 
     stop = false;
 
@@ -421,6 +1256,7 @@ static void status_line(struct pktizr_args *args) {
         uint64_t now   = time_now();
         uint64_t sent  = args->pkt_sent;
         uint64_t probe = args->pkt_probe;
+        uint64_t chg   = args->prior_changes;
 
         double rate    = (sent - sent_old) / ((now - now_old) / 1e6);
         double percent = (double) probe * 100 / tot;
@@ -431,11 +1267,44 @@ static void status_line(struct pktizr_args *args) {
             fprintf(stderr, "Rate: %3.2fkpps ", rate / 1000);
             fprintf(stderr, "Sent: %zu ", sent);
             fprintf(stderr, "Replies: %zu ", args->pkt_recv);
+
+            if (args->prior)
+                fprintf(stderr, "Changes: %zu (%3.2f/s) ", chg,
+                        (chg - chg_old) / ((now - now_old) / 1e6));
+
+            if (args->sample > 0) {
+                double est, err;
+
+                sample_estimate(args, &est, &err);
+
+                fprintf(stderr, "Estimate: %3.4f%% (+/- %3.4f%%) ",
+                        est * 100, err * 100);
+            }
+
             fprintf(stderr, "\r");
         }
 
         now_old  = now;
         sent_old = sent;
+        chg_old  = chg;
+
+        if (args->counters_interval && (now >= dump_at)) {
+            if (!args->quiet)
+                fprintf(stderr, LINE_CLEAR);
+
+            dump_counters(args);
+
+            dump_at = now + args->counters_interval * 1000000;
+        }
+
+        if (perf_dump && args->perf) {
+            if (!args->quiet)
+                fprintf(stderr, LINE_CLEAR);
+
+            dump_perf(args);
+        }
+
+        perf_dump = false;
 
         if (probe == tot)
             break;
@@ -450,29 +1319,243 @@ static void status_line(struct pktizr_args *args) {
 
     args->stop = stop = false;
 
-    for (; args->wait > 0 && !stop; args->wait--) {
+    uint64_t wait_start = time_now();
+    uint64_t wait_end   = wait_start + args->wait * 1000000;
+
+    while (!stop) {
+        uint64_t now = time_now();
+
+        if (now >= wait_end)
+            break;
+
+        if (args->rtt &&
+            (expected_replies(args, now - wait_start) < args->adaptive_wait))
+            break;
+
         if (!args->quiet) {
             fprintf(stderr, LINE_CLEAR);
             fprintf(stderr, "Waiting for %zu seconds...",
-                    args->wait);
+                    (wait_end - now + 999999) / 1000000);
+            fprintf(stderr, "\r");
         }
 
-        time_sleep(1e6);
+        time_sleep((wait_end - now < 250000) ? wait_end - now : 250000);
+    }
+
+    args->stop = true;
+
+    if (!args->quiet)
+        fprintf(stderr, "\r" LINE_CLEAR CURSOR_SHOW);
+
+    if (args->sample > 0) {
+        double est, err;
+
+        sample_estimate(args, &est, &err);
+
+        fprintf(stderr, "Sampled %zu of %zu probes, %zu replies\n",
+                args->pkt_probe, args->pkt_total, args->pkt_recv);
+        fprintf(stderr, "Estimate: %3.4f%% (+/- %3.4f%%, 95%% CI), "
+                        "~%.0f replies over the full scan\n",
+                est * 100, err * 100, est * args->pkt_total);
+    }
+}
+
+/* print one line of hardware counters, normalized per unit */
+static void perf_line(const char *stage, const uint64_t *val, uint64_t n,
+                      const char *unit) {
+    double ipc = val[PERF_CYCLES] ?
+                   (double) val[PERF_INSTRUCTIONS] / val[PERF_CYCLES] : 0;
+
+    fprintf(stderr, "%s: IPC %.2f, per %s:", stage, ipc, unit);
+
+    for (size_t i = 0; i < PERF_EVENT_MAX; i++)
+        fprintf(stderr, " %.1f %s", n ? (double) val[i] / n : 0,
+                perf_event_names[i]);
+
+    fprintf(stderr, "\n");
+}
+
+/*
+ * Print the hardware counters of the loop thread normalized per probe, and the
+ * ones of the recv threads (summed) normalized per frame and per reply.
+ */
+static void dump_perf(struct pktizr_args *args) {
+    uint64_t loop[PERF_EVENT_MAX];
+    uint64_t recv[PERF_EVENT_MAX] = { 0 };
+    uint64_t frames = 0;
+
+    perf_read(&args->perf[0], loop);
+
+    for (size_t r = 0; r < args->recv_cnt; r++) {
+        uint64_t val[PERF_EVENT_MAX];
+
+        perf_read(&args->perf[r + 1], val);
+
+        for (size_t i = 0; i < PERF_EVENT_MAX; i++)
+            recv[i] += val[i];
+
+        frames += CMM_LOAD_SHARED(args->recv[r].frames);
+    }
+
+    if (!args->idle)
+        perf_line("loop", loop, args->pkt_sent, "probe");
+
+    perf_line("recv", recv, frames, "frame");
+    perf_line("recv", recv, args->pkt_recv, "reply");
+}
+
+/*
+ * Merge the counters of all the threads and print them. This can be done while
+ * the threads are running, as the tables can be read concurrently.
+ */
+static void dump_counters(struct pktizr_args *args) {
+    size_t n = 0;
+    struct count_table *t, *merged;
+
+    pthread_mutex_lock(&args->counters_mutex);
+
+    for (t = args->counters; t != NULL; t = t->next)
+        n += t->mask + 1;
+
+    if (n == 0) {
+        pthread_mutex_unlock(&args->counters_mutex);
+        return;
+    }
+
+    merged = count_new(n);
+
+    for (t = args->counters; t != NULL; t = t->next)
+        count_merge(merged, t);
+
+    pthread_mutex_unlock(&args->counters_mutex);
+
+    count_dump(merged, stdout);
+    fflush(stdout);
+
+    count_free(merged);
+}
+
+/*
+ * Estimate how many replies are still to come, given the RTT distribution
+ * observed so far. All probes are assumed to have been sent at the end of the
+ * scan, which overestimates the replies still in flight.
+ */
+static double expected_replies(struct pktizr_args *args, uint64_t elapsed) {
+    double f;
+
+    if (uatomic_read(&args->rtt->samples) < RTT_MIN)
+        return INFINITY;
 
-        if (!args->quiet)
+    f = rtt_cdf(args->rtt, elapsed);
+    if (f <= 0)
+        return INFINITY;
+
+    return args->pkt_recv * (1 - f) / f;
+}
+
+/*
+ * Estimate the fraction of probes that get a reply, based on the probes sent so
+ * far. Since the probe order is a uniform random permutation, the probes sent
+ * are a sample without replacement, hence the finite population correction.
+ */
+static void sample_estimate(struct pktizr_args *args, double *est, double *err) {
+    double n = args->pkt_probe;
+    double N = args->pkt_total;
+    double p, fpc;
+
+    *est = *err = 0;
+
+    if (n == 0)
+        return;
+
+    p = fmin((double) args->pkt_recv / n, 1);
+
+    fpc = (N > 1) ? (N - n) / (N - 1) : 0;
+
+    *est = p;
+    *err = 1.96 * sqrt(p * (1 - p) / n * fpc);
+}
+
+static uint64_t idle_frames(struct pktizr_args *args) {
+    uint64_t frames = 0;
+
+    for (size_t r = 0; r < args->recv_cnt; r++)
+        frames += CMM_LOAD_SHARED(args->recv[r].frames);
+
+    return frames;
+}
+
+/*
+ * Status line for --idle mode: there's no scan to track progress of, so show
+ * the capture throughput until interrupted.
+ */
+static void idle_line(struct pktizr_args *args) {
+    uint64_t start      = time_now();
+    uint64_t now_old    = start;
+    uint64_t frames_old = idle_frames(args);
+    uint64_t dump_at    = now_old + args->counters_interval * 1000000;
+
+    stop = false;
+
+    if (!args->quiet)
+        fprintf(stderr, CURSOR_HIDE);
+
+    while (!stop) {
+        time_sleep(250000);
+
+        uint64_t now    = time_now();
+        uint64_t frames = idle_frames(args);
+
+        double rate = (frames - frames_old) / ((now - now_old) / 1e6);
+
+        if (!args->quiet) {
+            fprintf(stderr, LINE_CLEAR);
+            fprintf(stderr, "Rate: %3.2fkfps ", rate / 1000);
+            fprintf(stderr, "Frames: %zu ", frames);
+            fprintf(stderr, "Replies: %zu ", args->pkt_recv);
             fprintf(stderr, "\r");
+        }
+
+        now_old    = now;
+        frames_old = frames;
+
+        if (args->counters_interval && (now >= dump_at)) {
+            if (!args->quiet)
+                fprintf(stderr, LINE_CLEAR);
+
+            dump_counters(args);
+
+            dump_at = now + args->counters_interval * 1000000;
+        }
+
+        if (perf_dump && args->perf) {
+            if (!args->quiet)
+                fprintf(stderr, LINE_CLEAR);
+
+            dump_perf(args);
+        }
+
+        perf_dump = false;
     }
 
     args->stop = true;
 
     if (!args->quiet)
         fprintf(stderr, "\r" LINE_CLEAR CURSOR_SHOW);
+
+    fprintf(stderr, "Captured %zu frames in %.2f seconds (%3.2fkfps)\n",
+            idle_frames(args), (time_now() - start) / 1e6,
+            idle_frames(args) / ((time_now() - start) / 1e6) / 1000);
 }
 
 static void handle_term_sig(int sig) {
     stop = true;
 }
 
+static void handle_perf_sig(int sig) {
+    perf_dump = true;
+}
+
 static void setup_signals(void) {
     struct sigaction sa;
 
@@ -486,6 +1569,9 @@ static void setup_signals(void) {
     sigaction(SIGHUP, &sa, NULL);
     sigaction(SIGINT, &sa, NULL);
     sigaction(SIGTERM, &sa, NULL);
+
+    sa.sa_handler = handle_perf_sig;
+    sigaction(SIGUSR1, &sa, NULL);
 }
 
 static uint64_t get_entropy(void) {
@@ -502,33 +1588,362 @@ static uint64_t get_entropy(void) {
     return entropy;
 }
 
+/*
+ * Parse a wall-clock deadline, either as "HH:MM[:SS]" (the next occurrence of
+ * that local time) or as "@SECONDS" since the epoch, and convert it to the
+ * monotonic clock used by time_now().
+ */
+static uint64_t parse_deadline(const char *str) {
+    time_t now = time(NULL), when;
+
+    if (str[0] == '@') {
+        char *end;
+
+        when = strtoll(str + 1, &end, 10);
+        if (*end != '\0')
+            fail_printf("Invalid deadline value");
+    } else {
+        char *end;
+        struct tm tm;
+
+        localtime_r(&now, &tm);
+        tm.tm_sec = 0;
+
+        end = strptime(str, "%H:%M", &tm);
+        if (end && (*end == ':'))
+            end = strptime(end + 1, "%S", &tm);
+
+        if (!end || (*end != '\0'))
+            fail_printf("Invalid deadline value");
+
+        when = mktime(&tm);
+        if (when <= now) {
+            tm.tm_mday++;
+            when = mktime(&tm);
+        }
+    }
+
+    if (when <= now)
+        fail_printf("Deadline is in the past");
+
+    return time_now() + (uint64_t) (when - now) * 1000000;
+}
+
+/*
+ * Extract the (address, port) key identifying the remote end of a reply: the
+ * IPv4 source address and, for TCP and UDP, the source port.
+ */
+bool reply_key(const uint8_t *buf, size_t len, uint32_t *addr,
+               uint16_t *port) {
+    const struct eth_hdr *eth = (const struct eth_hdr *) buf;
+    const struct ip4_hdr *ip4 = (const struct ip4_hdr *) (buf + 14);
+    size_t hlen;
+    uint16_t sport;
+
+    if ((len < 14 + 20) || (ntohs(eth->type) != ETHERTYPE_IP))
+        return false;
+
+    *addr = ntohl(ip4->src);
+
+    hlen = ip4->ihl * 4;
+    if ((hlen < 20) || (len < 14 + hlen + sizeof(sport)))
+        return true;
+
+    if ((ip4->proto == IPPROTO_TCP) || (ip4->proto == IPPROTO_UDP)) {
+        memcpy(&sport, buf + 14 + hlen, sizeof(sport));
+        *port = ntohs(sport);
+    }
+
+    return true;
+}
+
+/*
+ * Derive the target and/or port ranges from the --follow store, when not given
+ * on the command line: the stored hosts, and the union of their ports. The
+ * pairs not in the store are then skipped by loop().
+ */
+static void follow_ranges(struct pktizr_args *args, bool targets, bool ports) {
+    struct store_file *f = args->follow;
+    uint32_t host_cnt = f->hdr->host_count;
+
+    if (!host_cnt)
+        fail_printf("Empty result store");
+
+    /* one range per run of adjacent hosts, built from the last one */
+    if (targets) {
+        uint32_t end = f->hosts[host_cnt - 1].addr, start = end;
+
+        for (uint32_t i = host_cnt - 1; i > 0; i--) {
+            uint32_t addr = f->hosts[i - 1].addr;
+
+            if (addr + 1 == start) {
+                start = addr;
+                continue;
+            }
+
+            range_list_prepend(&args->targets, start, end);
+            start = end = addr;
+        }
+
+        range_list_prepend(&args->targets, start, end);
+    }
+
+    /* the union of the stored ports, as runs of adjacent ports */
+    if (ports) {
+        _free_ uint16_t *buf = malloc(65536 * sizeof(*buf));
+        _free_ uint8_t  *set = calloc(65536, sizeof(*set));
+        bool empty = true;
+
+        if ((buf == NULL) || (set == NULL))
+            fail_printf("OOM");
+
+        for (uint32_t i = 0; i < host_cnt; i++) {
+            size_t cnt = store_ports(f, &f->hosts[i], buf);
+
+            for (size_t j = 0; j < cnt; j++)
+                set[buf[j]] = 1;
+
+            empty = empty && !cnt;
+        }
+
+        if (empty)
+            fail_printf("Empty result store");
+
+        range_list_free(args->ports);
+        args->ports = NULL;
+
+        for (uint32_t port = 65536; port > 0; ) {
+            uint32_t end;
+
+            if (!set[--port])
+                continue;
+
+            end = port;
+
+            while ((port > 0) && set[port - 1])
+                port--;
+
+            range_list_prepend(&args->ports, port, end);
+        }
+    }
+}
+
+/*
+ * Load the (address, port) pairs of a previous scan's result store that fall
+ * within the current targets and ports. They are kept sorted, as "addr << 16 |
+ * port" keys, so that replies and the rest of the scan can be matched against
+ * them with a binary search.
+ */
+static void prior_load(struct pktizr_args *args, const char *path) {
+    struct store_file *f = store_open(path);
+    _free_ uint16_t *buf = malloc(65536 * sizeof(*buf));
+    size_t size = 1024;
+
+    /* grow the array as needed, rather than trusting the store's counts */
+    args->prior = malloc(size * sizeof(*args->prior));
+    if ((buf == NULL) || (args->prior == NULL))
+        fail_printf("OOM");
+
+    for (uint32_t i = 0; i < f->hdr->host_count; i++) {
+        const struct store_host *h = &f->hosts[i];
+
+        if (!range_list_has(args->targets, h->addr))
+            continue;
+
+        size_t cnt = store_ports(f, h, buf);
+
+        for (size_t j = 0; j < cnt; j++) {
+            if (!range_list_has(args->ports, buf[j]))
+                continue;
+
+            if (args->prior_cnt == size) {
+                size *= 2;
+
+                args->prior = realloc(args->prior,
+                                      size * sizeof(*args->prior));
+                if (args->prior == NULL)
+                    fail_printf("OOM");
+            }
+
+            args->prior[args->prior_cnt++] = (uint64_t) h->addr << 16 | buf[j];
+        }
+    }
+
+    store_close(f);
+
+    args->prior_seen = calloc(args->prior_cnt + 1, 1);
+    if (args->prior_seen == NULL)
+        fail_printf("OOM");
+}
+
+/*
+ * Split the ports in popularity tiers, according to the ranking in the given
+ * file (one port per line) or to the built-in one.
+ */
+static void tiers_setup(struct pktizr_args *args, const char *rank_file) {
+    _free_ uint16_t *rank = NULL;
+    _free_ uint16_t *ports = NULL;
+    size_t rank_cnt, cnt = 0;
+    struct range *cur;
+
+    args->tiers = malloc(sizeof(*args->tiers));
+    ports = malloc(range_list_count(args->ports) * sizeof(*ports));
+    if ((args->tiers == NULL) || (ports == NULL))
+        fail_printf("OOM");
+
+    for (cur = args->ports; cur != NULL; cur = cur->next) {
+        for (uint32_t p = cur->start; p <= cur->end; p++)
+            ports[cnt++] = p;
+    }
+
+    if (rank_file) {
+        rank_cnt = tiers_load_rank(rank_file, &rank);
+
+        tiers_build(args->tiers, ports, cnt, rank, rank_cnt);
+    } else {
+        tiers_build(args->tiers, ports, cnt, tiers_default_rank,
+                    tiers_default_rank_cnt);
+    }
+}
+
+static struct scan_map *map_setup(struct pktizr_args *args) {
+    size_t prt_cnt = range_list_count(args->ports);
+
+    struct scan_map *m = malloc(sizeof(*m));
+    if (m == NULL)
+        fail_printf("OOM");
+
+    if (args->tiers)
+        scan_map_init(m, range_list_count(args->targets),
+                      args->tiers->tier_end, args->tiers->tier_cnt,
+                      args->count * args->script_cnt, args->shuffle,
+                      args->seed);
+    else
+        scan_map_init(m, range_list_count(args->targets), &prt_cnt, 1,
+                      args->count * args->script_cnt, args->shuffle,
+                      args->seed);
+
+    scan_map_shard(m, args->shard, args->shard_cnt);
+
+    return m;
+}
+
+/*
+ * The Ethernet header of IPv4 frames towards the gateway is the same for every
+ * probe: have the netdev keep it in its TX buffers, so it isn't rewritten on
+ * every send. Drivers that don't support it keep getting whole frames.
+ */
+static void setup_tx_prefix(struct pktizr_args *args) {
+    uint8_t prefix[14];
+    struct pkt eth;
+
+    pkt_build_eth(&eth, args->local_mac, args->gateway_mac, ETHERTYPE_IP);
+    pkt_pack_eth(&eth, prefix, sizeof(prefix));
+
+    netdev_set_prefix(args->netdev, prefix, sizeof(prefix));
+}
+
+static ssize_t prior_find(struct pktizr_args *args, uint32_t addr,
+                          uint16_t port) {
+    uint64_t key = (uint64_t) addr << 16 | port;
+    size_t lo = 0, hi = args->prior_cnt;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (args->prior[mid] < key)
+            lo = mid + 1;
+        else if (args->prior[mid] > key)
+            hi = mid;
+        else
+            return mid;
+    }
+
+    return -1;
+}
+
+/*
+ * Report the pairs that responded to the --prior scan but not to this one. The
+ * new ones have already been reported by the scripts as they were found.
+ */
+static void prior_report(struct pktizr_args *args) {
+    size_t gone = 0;
+
+    if (args->pkt_probe < args->pkt_count) {
+        err_printf("Scan interrupted, not reporting closed ports");
+        return;
+    }
+
+    for (size_t i = 0; i < args->prior_cnt; i++) {
+        struct in_addr addr;
+
+        if (args->prior_seen[i])
+            continue;
+
+        addr.s_addr = htonl(args->prior[i] >> 16);
+
+        ok_printf("Port %u at %s is no longer responsive",
+                  (unsigned) (args->prior[i] & 0xffff), inet_ntoa(addr));
+        gone++;
+    }
+
+    fprintf(stderr, "Changes: %zu new, %zu gone (of %zu previous)\n",
+            args->prior_changes, gone, args->prior_cnt);
+}
+
 static inline void help(void) {
     #define CMD_HELP(CMDL, CMDS, MSG) printf("  %s, %-15s \t%s.\n", COLOR_YELLOW CMDS, CMDL COLOR_OFF, MSG);
 
     printf(COLOR_RED "Usage: " COLOR_OFF);
     printf(COLOR_GREEN "pktizr " COLOR_OFF);
-    puts("<targets> [options]\n");
+    puts("<targets> [options]");
+    printf(COLOR_RED "       " COLOR_OFF);
+    printf(COLOR_GREEN "pktizr " COLOR_OFF);
+    puts("--idle [options]\n");
 
     puts(COLOR_RED " Options:" COLOR_OFF);
 
-    CMD_HELP("--script", "-S", "Load and run the given script");
+    CMD_HELP("--script", "-S", "Load and run the given script (can be repeated)");
 
     puts("");
 
     CMD_HELP("--ports", "-p", "Use the specified port ranges");
     CMD_HELP("--rate",  "-r", "Send packets no faster than the specified rate");
+    CMD_HELP("--duration", "-d", "Adjust the rate to complete the scan in the given seconds");
+    CMD_HELP("--deadline", "-D", "Adjust the rate to complete the scan by the given time");
     CMD_HELP("--seed",  "-s", "Use the given number as seed value");
     CMD_HELP("--wait",  "-w", "Wait the given amount of seconds after the scan is complete");
+    CMD_HELP("--adaptive-wait", "-A", "Stop waiting when less than the given replies are expected");
     CMD_HELP("--count", "-c", "Send the given amount of duplicate packets");
+    CMD_HELP("--sample", "-F", "Only probe a random sample of the given fraction of targets");
 
     CMD_HELP("--local-addr", "-l", "Use the given IP address as source");
     CMD_HELP("--gateway-addr", "-g", "Route the packets to the given gateway");
 
     CMD_HELP("--netdev", "-n", "Use the specified netdev driver");
+    CMD_HELP("--interface", "-i", "Use the given network interface");
+    CMD_HELP("--filter", "-f", "Only capture packets matching the given BPF filter");
+    CMD_HELP("--idle", "-L", "Don't send probes, only process received packets");
+    CMD_HELP("--perf", "-M", "Report hardware performance counters per thread");
+
+    CMD_HELP("--source-ports", "-P", "Spread probes over the given source port range");
+    CMD_HELP("--recv-threads", "-t", "Process replies with the given number of threads");
 
     CMD_HELP("--shuffle", "-R", "Shuffle the target address/port order");
+    CMD_HELP("--port-order", "-T", "Probe the most popular ports first (tiered[:<file>])");
+    CMD_HELP("--shard", "-N", "Only send the k-th of n slices of the scan (<k>/<n>)");
+    CMD_HELP("--exclude", "-E", "Don't probe the given addresses (can be repeated)");
+    CMD_HELP("--control", "-C", "Accept runtime commands on the given UNIX socket");
+    CMD_HELP("--daemon", "-J", "Run scan jobs submitted on the given UNIX socket");
     CMD_HELP("--offline", "-o", "Don't transmit packets");
 
+    CMD_HELP("--output-ring", "-O", "Publish std.emit() results to the given ring file");
+    CMD_HELP("--udp-payloads", "-U", "Load the given UDP payload database");
+    CMD_HELP("--output-store", "-W", "Write the responsive address/port pairs to the given file");
+    CMD_HELP("--follow", "-X", "Only probe the address/port pairs in the given result store");
+    CMD_HELP("--prior", "-B", "Probe the pairs of the given result store first, report changes");
+    CMD_HELP("--count-interval", "-I", "Print the std.count() counters every given seconds");
+
     CMD_HELP("--quiet", "-q", "Don't show the status line");
 
     puts("");
@@ -28,28 +28,103 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+struct script_stats {
+    uint64_t probe;
+    uint64_t recv;
+};
+
+struct recv_ctx {
+    struct pktizr_args *args;
+    struct netdev *netdev;
+
+    uint64_t frames;
+
+    struct frag_table *frags;
+
+    pthread_t thread;
+};
+
+/* runtime configuration, updated through the control socket */
+struct pktizr_conf {
+    uint64_t rate;
+    bool     paused;
+
+    struct range *exclude;
+};
+
 struct pktizr_args {
     struct range *targets;
     struct range *ports;
 
+    struct port_tiers *tiers;
+
+    /* the probes of the scan, without the --prior pairs */
+    struct scan_map *map;
+    uint64_t         shard;
+    uint64_t         shard_cnt;
+
     struct netdev *netdev;
 
-    char *script;
+    struct shared *shared;
+
+    struct ring *ring;
 
+    struct payload_db *payloads;
+
+    struct rtt *rtt;
+
+    struct store      *store;
+    pthread_mutex_t    store_mutex;
+    struct store_file *follow;
+
+    uint64_t *prior;
+    size_t    prior_cnt;
+    uint8_t  *prior_seen;
+    uint64_t  prior_changes;
+
+    struct count_table *counters;
+    pthread_mutex_t     counters_mutex;
+    uint64_t            counters_interval;
+
+    char  **scripts;
+    size_t  script_cnt;
+
+    struct script_stats *script_stats;
+
+    uint64_t pkt_total;
     uint64_t pkt_count;
     uint64_t pkt_probe;
     uint64_t pkt_recv;
     uint64_t pkt_sent;
 
     uint64_t rate;
+    uint64_t deadline;
     uint64_t seed;
     uint64_t wait;
     uint64_t count;
 
+    double sample;
+    double adaptive_wait;
+
     bool shuffle;
     bool offline;
+    bool idle;
+
+    struct pktizr_conf *conf;
+
+    /* set in daemon mode */
+    struct daemon *daemon;
+
+    int        control_fd;
+    char      *control_path;
+    pthread_t  control_thread;
+
+    /* hardware counters of the loop thread, followed by the recv ones */
+    struct perf_ctr *perf;
+
+    struct recv_ctx *recv;
+    size_t           recv_cnt;
 
-    pthread_t       recv_thread;
     pthread_mutex_t recv_mutex;
     pthread_cond_t  recv_started;
 
@@ -60,6 +135,8 @@ struct pktizr_args {
     struct queue queue;
 
     uint32_t local_addr;
+    uint16_t sport_min;
+    uint16_t sport_max;
     uint32_t gateway_addr;
 
     uint8_t local_mac[6];
@@ -67,3 +144,12 @@ struct pktizr_args {
 
     bool done, stop, quiet;
 };
+
+int pkt_send(struct pktizr_args *args, struct pkt *pkt);
+int pkt_send_frame(struct pktizr_args *args, const uint8_t *frame, size_t len,
+                   unsigned flags);
+uint16_t pkt_source_port(struct pktizr_args *args, uint32_t daddr,
+                         uint16_t dport);
+
+bool reply_key(const uint8_t *buf, size_t len, uint32_t *addr,
+               uint16_t *port);
@@ -0,0 +1,107 @@
+/*
+ * Scriptable, asynchronous network packet generator/analyzer.
+ *
+ * Copyright (c) 2015, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Plugin interface for native probe modules, loaded with "-S plugin:<path>".
+ *
+ * A plugin is a shared object exporting a "pktizr_plugin" symbol of type
+ * struct pktizr_plugin. pktizr refuses to load plugins built against a
+ * different PKTIZR_PLUGIN_ABI version. Just like Lua scripts, every loop and
+ * recv thread gets its own instance of the plugin, created by init(), so the
+ * callbacks of an instance are never called concurrently.
+ *
+ * Plugins only see raw frames: all addresses passed to and from them are in
+ * network byte order, ports are in host byte order.
+ *
+ * This header is installed for out-of-tree plugins, so unlike the rest of the
+ * headers in pktizr, it is self-contained.
+ */
+
+#ifndef PKTIZR_PLUGIN_H
+#define PKTIZR_PLUGIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PKTIZR_PLUGIN_ABI 1
+
+/* the frame starts with the Ethernet header, instead of the IPv4 one */
+#define PKTIZR_FRAME_L2    (1 << 1)
+/* recalculate the IPv4 length and checksums of the frame */
+#define PKTIZR_FRAME_FIXUP (1 << 2)
+
+/* services provided by pktizr to a plugin instance */
+struct pktizr_host {
+    uint32_t abi;
+
+    uint32_t local_addr;
+
+    /* queue a frame for transmission, can be called from any callback */
+    int (*send)(const struct pktizr_host *host, const uint8_t *frame,
+                size_t len, unsigned flags);
+
+    /* print a result, unless muted (e.g. by --prior) */
+    void (*print)(const struct pktizr_host *host, const char *fmt, ...)
+        __attribute__((format(printf, 2, 3)));
+
+    /* same as pkt.cookie() in Lua scripts */
+    uint64_t (*cookie)(const struct pktizr_host *host,
+                       uint32_t saddr, uint32_t daddr,
+                       uint16_t sport, uint16_t dport);
+
+    void *priv;
+};
+
+struct pktizr_plugin {
+    uint32_t abi;
+
+    const char *name;
+
+    /* create a new instance, returning its context or NULL on error */
+    void *(*init)(const struct pktizr_host *host);
+    void (*fini)(void *ctx);
+
+    /*
+     * Build the probe for the given target into buf, which can hold *len
+     * bytes, and set *len to its length and *flags to a set of PKTIZR_FRAME_*
+     * values. The source port is 0 unless --source-ports is used. Return 0 to
+     * send the probe, or -1 to skip the target.
+     */
+    int (*loop)(void *ctx, uint32_t addr, uint16_t port, uint16_t sport,
+                uint8_t *buf, size_t *len, unsigned *flags);
+
+    /*
+     * Process a received frame, starting with its Ethernet header. Return 1
+     * if the frame was a reply to one of the plugin's probes, 0 otherwise.
+     */
+    int (*recv)(void *ctx, const uint8_t *frame, size_t len);
+};
+
+#endif
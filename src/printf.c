@@ -42,13 +42,42 @@
 
 int use_syslog = 0;
 
+/* results printed by the current thread are sent here, if set */
+static __thread int ok_fd = -1;
+
+/* whether a result could not be written to ok_fd */
+static __thread bool ok_err = false;
+
 static void do_log(const char *prefix, const char *fmt, va_list args, bool c);
 
+/*
+ * Returns -1 if some of the results printed since the previous call could not
+ * be written to the fd they were redirected to (e.g. because it would block).
+ */
+int ok_redirect(int fd) {
+    int rc = ok_err ? -1 : 0;
+
+    ok_fd  = fd;
+    ok_err = false;
+
+    return rc;
+}
+
 void ok_printf(const char *fmt, ...) {
     va_list args;
 
     va_start(args, fmt);
-    do_log("[" COLOR_GREEN "✔" COLOR_OFF "] ", fmt, args, false);
+
+    if (ok_fd >= 0) {
+        char format[LINE_MAX];
+
+        snprintf(format, LINE_MAX, "%s\n", fmt);
+        if (vdprintf(ok_fd, format, args) < 0)
+            ok_err = true;
+    } else {
+        do_log("[" COLOR_GREEN "✔" COLOR_OFF "] ", fmt, args, false);
+    }
+
     va_end(args);
 }
 
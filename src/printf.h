@@ -42,6 +42,7 @@
 int use_syslog;
 
 void ok_printf(const char *fmt, ...);
+int ok_redirect(int fd);
 void debug_printf(const char *fmt, ...);
 void err_printf(const char *fmt, ...);
 void fail_printf(const char *fmt, ...);
@@ -30,6 +30,8 @@
 
 #include <assert.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <arpa/inet.h>
@@ -116,6 +118,64 @@ struct range *range_parse_ports(void *ta, char *spec) {
     return list;
 }
 
+/*
+ * Parse a comma-separated list of addresses and CIDR subnets. Unlike
+ * range_parse_targets() this doesn't resolve names, and errors are not fatal.
+ */
+int range_parse_cidrs(char *spec, struct range **list) {
+    char *save = NULL;
+
+    for (char *tok = strtok_r(spec, ",", &save); tok != NULL;
+         tok = strtok_r(NULL, ",", &save)) {
+        struct in_addr a;
+
+        int bits = inet_net_pton(AF_INET, tok, &a, sizeof(a));
+        if (bits < 0)
+            return -1;
+
+        uint32_t mask  = 0xffffffff00000000ull >> bits;
+        uint32_t start = ntohl(a.s_addr) & mask;
+
+        range_list_add(NULL, list, start, start | ~mask);
+    }
+
+    return *list ? 0 : -1;
+}
+
+/*
+ * Same as range_parse_ports(), but errors are not fatal.
+ */
+int range_parse_port_list(char *spec, struct range **list) {
+    char *save = NULL;
+
+    for (char *tok = strtok_r(spec, ",", &save); tok != NULL;
+         tok = strtok_r(NULL, ",", &save)) {
+        char *e;
+        long x, y;
+
+        x = strtol(tok, &e, 10);
+        if ((e == tok) || (x < 1) || (x > 65535))
+            return -1;
+
+        y = x;
+
+        if (*e == '-') {
+            tok = e + 1;
+
+            y = strtol(tok, &e, 10);
+            if ((e == tok) || (y < x) || (y > 65535))
+                return -1;
+        }
+
+        if (*e != '\0')
+            return -1;
+
+        range_list_add(NULL, list, x, y);
+    }
+
+    return *list ? 0 : -1;
+}
+
 uint32_t range_list_pick(struct range *list, uint32_t index) {
     struct range *cur;
 
@@ -132,6 +192,17 @@ uint32_t range_list_pick(struct range *list, uint32_t index) {
     return 0;
 }
 
+bool range_list_has(struct range *list, uint32_t value) {
+    struct range *cur;
+
+    LL_FOREACH(list, cur) {
+        if ((value >= cur->start) && (value <= cur->end))
+            return true;
+    }
+
+    return false;
+}
+
 uint32_t range_list_min(struct range *list) {
     return range_list_pick(list, 0);
 }
@@ -180,6 +251,21 @@ void range_list_add(void *ta, struct range **list, uint32_t start, uint32_t end)
     LL_APPEND(*list, new);
 }
 
+/*
+ * Add a range in front of the list, without merging. Only for ranges added in
+ * descending order, not overlapping nor adjacent to the existing ones.
+ */
+void range_list_prepend(struct range **list, uint32_t start, uint32_t end) {
+    struct range *new = malloc(sizeof(*new));
+    if (new == NULL)
+        fail_printf("OOM");
+
+    new->start = start;
+    new->end   = end;
+
+    LL_PREPEND(*list, new);
+}
+
 void range_list_dump(struct range *list) {
     struct range *cur;
 
@@ -38,11 +38,16 @@ struct range {
 struct range *range_parse_targets(void *ta, char *spec);
 struct range *range_parse_ports(void *ta, char *spec);
 
+int range_parse_cidrs(char *spec, struct range **list);
+int range_parse_port_list(char *spec, struct range **list);
+
 void range_list_free(struct range *list);
 
 void range_list_add(void *ta, struct range **list, uint32_t start, uint32_t end);
+void range_list_prepend(struct range **list, uint32_t start, uint32_t end);
 
 uint32_t range_list_pick(struct range *list, uint32_t index);
 uint32_t range_list_min(struct range *list);
+bool range_list_has(struct range *list, uint32_t value);
 
 size_t range_list_count(struct range *list);
@@ -0,0 +1,202 @@
+/*
+ * Scriptable, asynchronous network packet generator/analyzer.
+ *
+ * Copyright (c) 2015, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Single-producer single-consumer ring of fixed-size result records, stored in
+ * a shared memory mapped file so that a separate process can consume results
+ * without copies or system calls.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <urcu/uatomic.h>
+
+#include "ring.h"
+#include "printf.h"
+#include "util.h"
+
+static struct ring *ring_map(int fd, size_t size) {
+    struct ring *r = malloc(sizeof(*r));
+    if (r == NULL)
+        fail_printf("OOM");
+
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+        sysf_printf("mmap()");
+
+    r->hdr  = p;
+    r->recs = (struct ring_rec *) ((uint8_t *) p + RING_HDR_SIZE);
+    r->size = size;
+
+    return r;
+}
+
+struct ring *ring_create(const char *path, size_t count) {
+    int rc;
+    size_t size;
+    uint64_t rec_count = 1;
+
+    struct ring *r;
+
+    while (rec_count < count)
+        rec_count <<= 1;
+
+    size = RING_HDR_SIZE + rec_count * sizeof(struct ring_rec);
+
+    _close_ int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        sysf_printf("open(%s)", path);
+
+    rc = ftruncate(fd, size);
+    if (rc < 0)
+        sysf_printf("ftruncate(%s)", path);
+
+    r = ring_map(fd, size);
+
+    memset(r->hdr, 0, sizeof(*r->hdr));
+
+    r->hdr->version   = RING_VERSION;
+    r->hdr->rec_size  = sizeof(struct ring_rec);
+    r->hdr->rec_count = rec_count;
+
+    r->mask = rec_count - 1;
+    r->head = r->tail = 0;
+
+    /* publish the magic last, so that readers never see a partial header */
+    cmm_smp_wmb();
+    memcpy(r->hdr->magic, RING_MAGIC, sizeof(r->hdr->magic));
+
+    return r;
+}
+
+struct ring *ring_open(const char *path) {
+    int rc;
+    struct stat st;
+    struct ring_hdr *hdr;
+
+    struct ring *r;
+
+    _close_ int fd = open(path, O_RDWR);
+    if (fd < 0)
+        sysf_printf("open(%s)", path);
+
+    rc = fstat(fd, &st);
+    if (rc < 0)
+        sysf_printf("fstat(%s)", path);
+
+    if ((size_t) st.st_size < RING_HDR_SIZE)
+        fail_printf("Invalid ring file %s", path);
+
+    r   = ring_map(fd, st.st_size);
+    hdr = r->hdr;
+
+    if (memcmp(hdr->magic, RING_MAGIC, sizeof(hdr->magic)) ||
+        (hdr->version != RING_VERSION) ||
+        (hdr->rec_size != sizeof(struct ring_rec)) ||
+        (hdr->rec_count & (hdr->rec_count - 1)) ||
+        (RING_HDR_SIZE + hdr->rec_count * hdr->rec_size > r->size))
+        fail_printf("Invalid ring file %s", path);
+
+    r->mask = hdr->rec_count - 1;
+    r->tail = CMM_LOAD_SHARED(hdr->tail);
+    r->head = CMM_LOAD_SHARED(hdr->head);
+
+    return r;
+}
+
+void ring_close(struct ring *r) {
+    munmap(r->hdr, r->size);
+    free(r);
+}
+
+struct ring_rec *ring_reserve(struct ring *r) {
+    if (r->head - r->tail > r->mask) {
+        r->tail = CMM_LOAD_SHARED(r->hdr->tail);
+
+        if (r->head - r->tail > r->mask) {
+            /* never block the writer, drop the record instead */
+            CMM_STORE_SHARED(r->hdr->dropped, r->hdr->dropped + 1);
+            return NULL;
+        }
+
+        /* don't overwrite the slot before the reader is done with it */
+        cmm_smp_mb();
+    }
+
+    return &r->recs[r->head & r->mask];
+}
+
+void ring_commit(struct ring *r) {
+    cmm_smp_wmb();
+
+    CMM_STORE_SHARED(r->hdr->head, ++r->head);
+}
+
+void ring_finish(struct ring *r) {
+    cmm_smp_wmb();
+
+    CMM_STORE_SHARED(r->hdr->done, 1);
+}
+
+const struct ring_rec *ring_peek(struct ring *r) {
+    if (r->tail == r->head) {
+        r->head = CMM_LOAD_SHARED(r->hdr->head);
+
+        if (r->tail == r->head)
+            return NULL;
+
+        cmm_smp_rmb();
+    }
+
+    return &r->recs[r->tail & r->mask];
+}
+
+void ring_consume(struct ring *r) {
+    cmm_smp_mb();
+
+    CMM_STORE_SHARED(r->hdr->tail, ++r->tail);
+}
+
+bool ring_done(struct ring *r) {
+    if (!CMM_LOAD_SHARED(r->hdr->done))
+        return false;
+
+    cmm_smp_rmb();
+
+    return CMM_LOAD_SHARED(r->hdr->head) == r->tail;
+}
@@ -0,0 +1,93 @@
+/*
+ * Scriptable, asynchronous network packet generator/analyzer.
+ *
+ * Copyright (c) 2015, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define RING_MAGIC    "PKTZRING"
+#define RING_VERSION  1
+
+#define RING_DATA_LEN 104
+
+/*
+ * On-disk layout of the result ring:
+ *
+ *   struct ring_hdr                (RING_HDR_SIZE bytes)
+ *   struct ring_rec[rec_count]     (rec_size bytes each)
+ *
+ * The writer owns head, the reader owns tail, both are free-running counters of
+ * records written/consumed (the slot index is counter & (rec_count - 1)). A
+ * record is only visible to the reader once head has been advanced past it.
+ * All integers are in host byte order, except for the address.
+ */
+#define RING_HDR_SIZE 4096
+
+struct ring_hdr {
+    char     magic[8];
+    uint32_t version;
+    uint32_t rec_size;
+    uint64_t rec_count;
+
+    uint64_t head     __attribute__((aligned(64)));
+    uint64_t dropped;
+    uint32_t done;
+
+    uint64_t tail     __attribute__((aligned(64)));
+};
+
+struct ring_rec {
+    uint64_t time;     /* microseconds since the epoch */
+    uint32_t addr;     /* network byte order */
+    uint16_t port;
+    uint16_t status;
+    uint16_t len;      /* length of data */
+    uint8_t  pad[6];
+    uint8_t  data[RING_DATA_LEN];
+};
+
+struct ring {
+    struct ring_hdr *hdr;
+    struct ring_rec *recs;
+
+    size_t   size;
+    uint64_t mask;
+
+    uint64_t head;
+    uint64_t tail;
+};
+
+struct ring *ring_create(const char *path, size_t count);
+struct ring *ring_open(const char *path);
+void ring_close(struct ring *r);
+
+struct ring_rec *ring_reserve(struct ring *r);
+void ring_commit(struct ring *r);
+void ring_finish(struct ring *r);
+
+const struct ring_rec *ring_peek(struct ring *r);
+void ring_consume(struct ring *r);
+bool ring_done(struct ring *r);
@@ -0,0 +1,93 @@
+/*
+ * Scriptable, asynchronous network packet generator/analyzer.
+ *
+ * Copyright (c) 2015, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Reference consumer for the pktizr result ring (see --output-ring). Prints one
+ * line per record, and exits once pktizr is done and the ring has been drained.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <arpa/inet.h>
+
+#include <urcu/compiler.h>
+
+#include "ring.h"
+#include "printf.h"
+#include "util.h"
+
+int main(int argc, char *argv[]) {
+    uint64_t count = 0;
+
+    struct ring *r;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: pktizr-ring <file>\n");
+        return 1;
+    }
+
+    r = ring_open(argv[1]);
+
+    while (1) {
+        char addr[INET_ADDRSTRLEN];
+        const struct ring_rec *rec = ring_peek(r);
+
+        if (rec == NULL) {
+            if (ring_done(r))
+                break;
+
+            time_sleep(1000);
+            continue;
+        }
+
+        inet_ntop(AF_INET, &rec->addr, addr, sizeof(addr));
+
+        printf("%zu.%06zu %s %u %u ",
+               rec->time / 1000000, rec->time % 1000000,
+               addr, rec->port, rec->status);
+
+        for (size_t i = 0; i < rec->len && i < RING_DATA_LEN; i++)
+            printf("%02x", rec->data[i]);
+
+        printf("\n");
+
+        ring_consume(r);
+        count++;
+    }
+
+    fprintf(stderr, "Read %zu records (%zu dropped)\n",
+            count, CMM_LOAD_SHARED(r->hdr->dropped));
+
+    ring_close(r);
+
+    return 0;
+}
@@ -0,0 +1,163 @@
+/*
+ * Scriptable, asynchronous network packet generator/analyzer.
+ *
+ * Copyright (c) 2015, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Sampled round-trip time tracking.
+ *
+ * The loop thread records the send time of the probes for a deterministic
+ * sample of the target addresses and ports (1 every RTT_SAMPLE) in a table
+ * indexed by their hash, and the recv thread matches replies against it,
+ * collecting the RTTs in a histogram of power-of-two microsecond buckets.
+ * Keying by port too keeps a probe to another port of the same host from
+ * overwriting the send time of a probe still waiting for its reply.
+ *
+ * Every slot packs the 32-bit hash of the address and port and the low 32 bits
+ * of the send time in a single 64-bit word, so that the two threads never need
+ * to lock. Two pairs with the same hash could be mistaken for each other, but
+ * that's rare enough not to skew the distribution.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include <urcu/uatomic.h>
+
+#include "rtt.h"
+#include "printf.h"
+#include "util.h"
+
+#define RTT_SAMPLE 16
+
+static inline uint32_t rtt_hash(uint32_t addr, uint16_t port) {
+    uint64_t key = ((uint64_t) addr << 16) | port;
+
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ull;
+    key ^= key >> 33;
+
+    return (uint32_t) key;
+}
+
+static inline uint64_t *rtt_slot(struct rtt *r, uint32_t hash) {
+    if (hash % RTT_SAMPLE)
+        return NULL;
+
+    return &r->slots[(hash / RTT_SAMPLE) & r->mask];
+}
+
+void rtt_init(struct rtt *r, size_t size) {
+    size_t slots = 1;
+
+    while (slots < size)
+        slots <<= 1;
+
+    r->slots = calloc(slots, sizeof(*r->slots));
+    if (r->slots == NULL)
+        fail_printf("OOM");
+
+    r->mask    = slots - 1;
+    r->samples = 0;
+
+    for (size_t i = 0; i < RTT_BUCKETS; i++)
+        r->hist[i] = 0;
+}
+
+void rtt_free(struct rtt *r) {
+    freep(&r->slots);
+}
+
+void rtt_sent(struct rtt *r, uint32_t addr, uint16_t port, uint64_t now) {
+    uint32_t hash = rtt_hash(addr, port);
+
+    uint64_t *slot = rtt_slot(r, hash);
+    if (slot == NULL)
+        return;
+
+    uatomic_set(slot, ((uint64_t) hash << 32) | (uint32_t) now);
+}
+
+void rtt_recv(struct rtt *r, uint32_t addr, uint16_t port, uint64_t now) {
+    size_t   b = 0;
+    uint32_t rtt;
+    uint32_t hash = rtt_hash(addr, port);
+
+    uint64_t *slot = rtt_slot(r, hash);
+    if (slot == NULL)
+        return;
+
+    uint64_t val = uatomic_read(slot);
+    if ((val == 0) || ((val >> 32) != hash))
+        return;
+
+    /* only the first reply to a probe is a valid sample */
+    if (uatomic_cmpxchg(slot, val, 0) != val)
+        return;
+
+    rtt = (uint32_t) now - (uint32_t) val;
+
+    while ((b < RTT_BUCKETS - 1) && (rtt >> (b + 1)))
+        b++;
+
+    uatomic_inc(&r->hist[b]);
+    uatomic_inc(&r->samples);
+}
+
+/*
+ * Return the fraction of the RTT samples not greater than t microseconds,
+ * assuming samples are evenly spread within each bucket.
+ */
+double rtt_cdf(struct rtt *r, uint64_t t) {
+    double count = 0;
+    uint64_t samples = uatomic_read(&r->samples);
+
+    if (samples == 0)
+        return 0;
+
+    for (size_t b = 0; b < RTT_BUCKETS; b++) {
+        uint64_t lo = (b == 0) ? 0 : (1ull << b);
+        uint64_t hi = 1ull << (b + 1);
+        uint64_t n  = uatomic_read(&r->hist[b]);
+
+        if (t >= hi) {
+            count += n;
+            continue;
+        }
+
+        if (t > lo)
+            count += (double) n * (t - lo) / (hi - lo);
+
+        break;
+    }
+
+    return (count >= samples) ? 1 : count / samples;
+}
@@ -0,0 +1,455 @@
+/*
+ * Scriptable, asynchronous network packet generator/analyzer.
+ *
+ * Copyright (c) 2015, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Declarative reply rules.
+ *
+ * Scripts can declare a table of rules matching on the headers of the
+ * received frames (protocol, TCP flags, ICMP type and code, ports and cookie
+ * validity), each with a set of actions to run on a match. The rules are
+ * compiled into a two-level decision tree: the protocol and the TCP flags (or
+ * the ICMP type) of a frame select a leaf holding the list of the rules that
+ * can match it, which are then checked in declaration order against the rest
+ * of the fields. The first matching rule wins.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <arpa/inet.h>
+
+#include "queue.h"
+#include "pkt.h"
+#include "rules.h"
+#include "printf.h"
+#include "util.h"
+
+static const char rule_flag_chars[] = "FSRPAUEC";
+
+static const char *rule_vars[] = {
+    "src", "dst", "sport", "dport", "ttl", NULL
+};
+
+static int var_find(const char *name, size_t len) {
+    for (int i = 0; rule_vars[i]; i++) {
+        if ((strlen(rule_vars[i]) == len) && !strncmp(rule_vars[i], name, len))
+            return i;
+    }
+
+    return -1;
+}
+
+static bool format_valid(const char *fmt) {
+    const char *p, *end;
+
+    for (p = fmt; (p = strchr(p, '{')) != NULL; p = end + 1) {
+        end = strchr(p, '}');
+        if ((end == NULL) || (var_find(p + 1, end - p - 1) < 0))
+            return false;
+    }
+
+    return true;
+}
+
+void rules_init(struct rule_table *t) {
+    memset(t, 0, sizeof(*t));
+}
+
+int rules_add(struct rule_table *t, const struct rule *r) {
+    struct rule *n;
+
+    switch (r->proto) {
+    case PROTO_TCP:
+        break;
+
+    case PROTO_ICMP:
+    case PROTO_UDP:
+        /* only TCP replies carry the cookie of the probe in a fixed place */
+        if (r->cookie || (r->flags_mask != 0))
+            return -1;
+        break;
+
+    default:
+        return -1;
+    }
+
+    /* ICMP messages have a type and a code, but no ports */
+    if ((r->proto == PROTO_ICMP) && ((r->sport >= 0) || (r->dport >= 0)))
+        return -1;
+
+    if ((r->proto != PROTO_ICMP) &&
+        ((r->icmp_type >= 0) || (r->icmp_code >= 0)))
+        return -1;
+
+    if ((r->actions & RULE_REPLY) && (r->proto != PROTO_TCP))
+        return -1;
+
+    if (((r->actions & RULE_PRINT) && !format_valid(r->print)) ||
+        ((r->actions & RULE_COUNT) && !format_valid(r->count)))
+        return -1;
+
+    if (t->cnt == UINT16_MAX)
+        return -1;
+
+    n = realloc(t->rules, (t->cnt + 1) * sizeof(*t->rules));
+    if (n == NULL)
+        fail_printf("OOM");
+
+    t->rules = n;
+    t->rules[t->cnt] = *r;
+
+    n = &t->rules[t->cnt++];
+    n->print = (r->actions & RULE_PRINT) ? strdup(r->print) : NULL;
+    n->count = (r->actions & RULE_COUNT) ? strdup(r->count) : NULL;
+
+    return 0;
+}
+
+static bool leaf_has(const struct rule *r, unsigned leaf) {
+    if (leaf >= RULE_LEAF_UDP)
+        return r->proto == PROTO_UDP;
+
+    if (leaf >= RULE_LEAF_ICMP)
+        return (r->proto == PROTO_ICMP) &&
+               ((r->icmp_type < 0) ||
+                ((unsigned) r->icmp_type == leaf - RULE_LEAF_ICMP));
+
+    return (r->proto == PROTO_TCP) &&
+           (((leaf - RULE_LEAF_TCP) & r->flags_mask) == r->flags);
+}
+
+void rules_compile(struct rule_table *t) {
+    size_t cnt = 0;
+
+    for (unsigned l = 0; l < RULE_LEAVES; l++) {
+        for (size_t i = 0; i < t->cnt; i++)
+            cnt += leaf_has(&t->rules[i], l);
+    }
+
+    freep(&t->idx);
+
+    t->idx = malloc((cnt ? cnt : 1) * sizeof(*t->idx));
+    if (t->idx == NULL)
+        fail_printf("OOM");
+
+    cnt = 0;
+
+    for (unsigned l = 0; l < RULE_LEAVES; l++) {
+        t->leaf[l] = cnt;
+
+        for (size_t i = 0; i < t->cnt; i++) {
+            if (leaf_has(&t->rules[i], l))
+                t->idx[cnt++] = i;
+        }
+    }
+
+    t->leaf[RULE_LEAVES] = cnt;
+}
+
+void rules_free(struct rule_table *t) {
+    for (size_t i = 0; i < t->cnt; i++) {
+        free(t->rules[i].print);
+        free(t->rules[i].count);
+    }
+
+    free(t->rules);
+    free(t->idx);
+
+    memset(t, 0, sizeof(*t));
+}
+
+/*
+ * Parse a string of TCP flags, e.g. "SA" for SYN and ACK set, optionally
+ * followed by the flags to check, e.g. "SA/SAR" for SYN and ACK set and RST
+ * unset. By default only the given flags are checked.
+ */
+int rules_parse_flags(const char *str, uint8_t *flags, uint8_t *mask) {
+    uint8_t *dst = flags;
+
+    *flags = *mask = 0;
+
+    for (const char *p = str; *p; p++) {
+        const char *c;
+
+        if ((*p == '/') && (dst == flags)) {
+            dst = mask;
+            continue;
+        }
+
+        c = strchr(rule_flag_chars, *p);
+        if (c == NULL)
+            return -1;
+
+        *dst |= 1 << (c - rule_flag_chars);
+    }
+
+    if (dst == flags)
+        *mask = *flags;
+
+    /* flags required to be set must be checked */
+    if ((*flags & *mask) != *flags)
+        return -1;
+
+    return 0;
+}
+
+/*
+ * Extract the fields used by the rules from a frame, starting with its
+ * Ethernet header. Returns -1 if the frame is not IPv4, or is truncated.
+ */
+int rules_parse(const uint8_t *buf, size_t len, struct rule_pkt *p) {
+    const uint8_t *ip4, *l4;
+    size_t hlen;
+    uint16_t v16;
+    uint32_t v32;
+
+    if ((len < 14 + 20) || (buf[12] != 0x08) || (buf[13] != 0x00))
+        return -1;
+
+    ip4  = buf + 14;
+    hlen = (ip4[0] & 0x0f) * 4;
+
+    if ((hlen < 20) || (len < 14 + hlen))
+        return -1;
+
+    memset(p, 0, sizeof(*p));
+
+    p->ttl   = ip4[8];
+    p->proto = ip4[9];
+
+    memcpy(&p->src, ip4 + 12, 4);
+    memcpy(&p->dst, ip4 + 16, 4);
+
+    l4  = ip4 + hlen;
+    len = len - 14 - hlen;
+
+    switch (p->proto) {
+    case PROTO_TCP:
+        if (len < 20)
+            return -1;
+
+        memcpy(&v32, l4 + 4, 4);
+        p->seq = ntohl(v32);
+
+        memcpy(&v32, l4 + 8, 4);
+        p->ack_seq = ntohl(v32);
+
+        p->flags = l4[13];
+
+        /* fall through */
+    case PROTO_UDP:
+        if (len < 8)
+            return -1;
+
+        memcpy(&v16, l4, 2);
+        p->sport = ntohs(v16);
+
+        memcpy(&v16, l4 + 2, 2);
+        p->dport = ntohs(v16);
+        break;
+
+    case PROTO_ICMP:
+        if (len < 8)
+            return -1;
+
+        p->icmp_type = l4[0];
+        p->icmp_code = l4[1];
+        break;
+    }
+
+    return 0;
+}
+
+const struct rule *rules_match(const struct rule_table *t,
+                               const struct rule_pkt *p, uint64_t seed) {
+    unsigned leaf;
+    int cookie = -1;
+
+    switch (p->proto) {
+    case PROTO_TCP:
+        leaf = RULE_LEAF_TCP + p->flags;
+        break;
+
+    case PROTO_ICMP:
+        leaf = RULE_LEAF_ICMP + p->icmp_type;
+        break;
+
+    case PROTO_UDP:
+        leaf = RULE_LEAF_UDP;
+        break;
+
+    default:
+        return NULL;
+    }
+
+    for (uint32_t i = t->leaf[leaf]; i < t->leaf[leaf + 1]; i++) {
+        const struct rule *r = &t->rules[t->idx[i]];
+
+        if ((r->sport >= 0) && (r->sport != p->sport))
+            continue;
+
+        if ((r->dport >= 0) && (r->dport != p->dport))
+            continue;
+
+        if ((r->icmp_code >= 0) && (r->icmp_code != p->icmp_code))
+            continue;
+
+        /* the reply acknowledges the sequence number of the probe */
+        if (r->cookie && (cookie < 0)) {
+            uint32_t seq = pkt_cookie(p->dst, p->src, p->dport, p->sport,
+                                      seed);
+
+            cookie = (p->ack_seq - 1 == seq);
+        }
+
+        if (r->cookie && !cookie)
+            continue;
+
+        return r;
+    }
+
+    return NULL;
+}
+
+/*
+ * Expand the {src}, {dst}, {sport}, {dport} and {ttl} variables in fmt into
+ * buf, truncating the result to len - 1 bytes. Returns the length of the
+ * result.
+ */
+size_t rules_format(const char *fmt, const struct rule_pkt *p,
+                    char *buf, size_t len) {
+    size_t off = 0;
+    const char *s = fmt;
+
+    if (len == 0)
+        return 0;
+
+    while (*s && (off < len - 1)) {
+        const char *end;
+        char val[INET_ADDRSTRLEN];
+        int n;
+
+        if ((*s != '{') || ((end = strchr(s, '}')) == NULL)) {
+            buf[off++] = *s++;
+            continue;
+        }
+
+        switch (var_find(s + 1, end - s - 1)) {
+        case 0:
+            inet_ntop(AF_INET, &p->src, val, sizeof(val));
+            break;
+
+        case 1:
+            inet_ntop(AF_INET, &p->dst, val, sizeof(val));
+            break;
+
+        case 2:
+            snprintf(val, sizeof(val), "%u", p->sport);
+            break;
+
+        case 3:
+            snprintf(val, sizeof(val), "%u", p->dport);
+            break;
+
+        case 4:
+            snprintf(val, sizeof(val), "%u", p->ttl);
+            break;
+
+        default:
+            buf[off++] = *s++;
+            continue;
+        }
+
+        n = strlen(val);
+        if (off + n > len - 1)
+            n = len - 1 - off;
+
+        memcpy(buf + off, val, n);
+
+        off += n;
+        s    = end + 1;
+    }
+
+    buf[off] = '\0';
+
+    return off;
+}
+
+/*
+ * Build the RST that aborts the connection opened by the given TCP reply,
+ * without the Ethernet header. The IPv4 length and checksums are left to be
+ * filled in with PKT_FRAME_FIXUP.
+ */
+size_t rules_build_rst(const struct rule_pkt *p, uint8_t *buf, size_t len) {
+    uint16_t sport = htons(p->dport);
+    uint16_t dport = htons(p->sport);
+    uint32_t seq   = htonl(p->ack_seq);
+
+    if (len < 40)
+        return 0;
+
+    memset(buf, 0, 40);
+
+    buf[0] = 0x45;
+    buf[8] = 64;
+    buf[9] = PROTO_TCP;
+    memcpy(buf + 12, &p->dst, 4);
+    memcpy(buf + 16, &p->src, 4);
+
+    memcpy(buf + 20, &sport, 2);
+    memcpy(buf + 22, &dport, 2);
+    memcpy(buf + 24, &seq, 4);
+    buf[32] = 5 << 4;
+    buf[33] = RULE_RST;
+
+    return 40;
+}
+
+/*
+ * Build the RST reply to the given TCP reply, as a raw L3 frame to be queued
+ * and sent by pkt_send().
+ */
+struct pkt *rules_reply_rst(const struct rule_pkt *p) {
+    struct pkt *rst = pkt_new(TYPE_RAW);
+
+    rst->flags = PKT_FRAME | PKT_FRAME_FIXUP;
+
+    rst->p.raw.payload = malloc(40);
+    if (rst->p.raw.payload == NULL)
+        fail_printf("OOM");
+
+    rst->p.raw.len = rules_build_rst(p, rst->p.raw.payload, 40);
+    rst->length    = rst->p.raw.len;
+
+    return rst;
+}
@@ -0,0 +1,116 @@
+/*
+ * Scriptable, asynchronous network packet generator/analyzer.
+ *
+ * Copyright (c) 2015, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* TCP flags, as they appear in the 14th byte of the header */
+enum {
+    RULE_FIN = 1 << 0,
+    RULE_SYN = 1 << 1,
+    RULE_RST = 1 << 2,
+    RULE_PSH = 1 << 3,
+    RULE_ACK = 1 << 4,
+    RULE_URG = 1 << 5,
+    RULE_ECE = 1 << 6,
+    RULE_CWR = 1 << 7,
+};
+
+enum {
+    RULE_EMIT  = 1 << 0,
+    RULE_PRINT = 1 << 1,
+    RULE_COUNT = 1 << 2,
+    RULE_REPLY = 1 << 3,
+    RULE_DROP  = 1 << 4,
+};
+
+/* leaves of the decision tree: TCP flags, ICMP types and UDP */
+#define RULE_LEAF_TCP  0
+#define RULE_LEAF_ICMP 256
+#define RULE_LEAF_UDP  512
+#define RULE_LEAVES    513
+
+/* the header fields of a received frame the rules can match on */
+struct rule_pkt {
+    uint32_t src;
+    uint32_t dst;
+    uint8_t  proto;
+    uint8_t  ttl;
+
+    uint16_t sport;
+    uint16_t dport;
+
+    uint8_t  flags;
+    uint32_t seq;
+    uint32_t ack_seq;
+
+    uint8_t  icmp_type;
+    uint8_t  icmp_code;
+};
+
+struct rule {
+    /* match */
+    uint8_t proto;
+    uint8_t flags;
+    uint8_t flags_mask;
+    int     icmp_type;
+    int     icmp_code;
+    int     sport;
+    int     dport;
+    bool    cookie;
+
+    /* actions */
+    unsigned actions;
+    uint16_t status;
+    char    *print;
+    char    *count;
+};
+
+struct rule_table {
+    struct rule *rules;
+    size_t cnt;
+
+    /* indexes of the candidate rules of every leaf, in declaration order */
+    uint16_t *idx;
+    uint32_t  leaf[RULE_LEAVES + 1];
+};
+
+void rules_init(struct rule_table *t);
+int rules_add(struct rule_table *t, const struct rule *r);
+void rules_compile(struct rule_table *t);
+void rules_free(struct rule_table *t);
+
+int rules_parse_flags(const char *str, uint8_t *flags, uint8_t *mask);
+int rules_parse(const uint8_t *buf, size_t len, struct rule_pkt *p);
+
+const struct rule *rules_match(const struct rule_table *t,
+                               const struct rule_pkt *p, uint64_t seed);
+
+size_t rules_format(const char *fmt, const struct rule_pkt *p,
+                    char *buf, size_t len);
+size_t rules_build_rst(const struct rule_pkt *p, uint8_t *buf, size_t len);
+struct pkt *rules_reply_rst(const struct rule_pkt *p);
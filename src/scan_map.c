@@ -0,0 +1,129 @@
+/*
+ * Scriptable, asynchronous network packet generator/analyzer.
+ *
+ * Copyright (c) 2015, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "shuffle.h"
+#include "tiers.h"
+#include "scan_map.h"
+
+/*
+ * Within a tier, the permuted index of a probe is decomposed, from the least
+ * significant part, in repetition, address and port. Repetitions (and the
+ * scripts, folded in them by the caller) are thus interleaved.
+ */
+void scan_map_init(struct scan_map *m, uint64_t addr_cnt,
+                   const size_t *port_end, size_t tier_cnt, uint64_t rep_cnt,
+                   bool shuffle, uint64_t seed) {
+    uint64_t end = 0;
+
+    m->addr_cnt = addr_cnt;
+    m->rep_cnt  = rep_cnt;
+    m->tier_cnt = tier_cnt;
+    m->shuffle  = shuffle;
+
+    for (size_t t = 0; t < tier_cnt; t++) {
+        uint64_t ports = port_end[t] - (t ? port_end[t - 1] : 0);
+        uint64_t cnt   = addr_cnt * ports * rep_cnt;
+
+        /* nothing is ever picked from an empty tier */
+        if (cnt)
+            shuffle_init(&m->rnd[t], cnt, seed);
+
+        end += cnt;
+
+        m->port_end[t] = port_end[t];
+        m->tier_end[t] = end;
+    }
+
+    scan_map_shard(m, 0, 1);
+}
+
+void scan_map_shard(struct scan_map *m, uint64_t shard, uint64_t shard_cnt) {
+    m->shard     = shard;
+    m->shard_cnt = shard_cnt;
+}
+
+/* number of probes in the map's shard */
+uint64_t scan_map_count(const struct scan_map *m) {
+    uint64_t total = m->tier_cnt ? m->tier_end[m->tier_cnt - 1] : 0;
+
+    if (total <= m->shard)
+        return 0;
+
+    return (total - m->shard - 1) / m->shard_cnt + 1;
+}
+
+void scan_map_pick(struct scan_map *m, uint64_t i, struct scan_probe *p) {
+    size_t   t = 0;
+    uint64_t tgt = i * m->shard_cnt + m->shard;
+
+    while (tgt >= m->tier_end[t])
+        t++;
+
+    tgt -= t ? m->tier_end[t - 1] : 0;
+    tgt  = m->shuffle ? shuffle(&m->rnd[t], tgt) : tgt;
+
+    p->rep  = tgt % m->rep_cnt;
+    tgt    /= m->rep_cnt;
+
+    p->addr = tgt % m->addr_cnt;
+    p->port = tgt / m->addr_cnt + (t ? m->port_end[t - 1] : 0);
+}
+
+/*
+ * Inverse of scan_map_pick(): find the index of the given probe in the map's
+ * shard. Returns -1 if the probe isn't part of the map, or of the shard.
+ */
+int scan_map_index(struct scan_map *m, const struct scan_probe *p,
+                   uint64_t *i) {
+    size_t   t = 0;
+    uint64_t tgt;
+
+    if ((p->addr >= m->addr_cnt) || (p->rep >= m->rep_cnt) ||
+        !m->tier_cnt || (p->port >= m->port_end[m->tier_cnt - 1]))
+        return -1;
+
+    while (p->port >= m->port_end[t])
+        t++;
+
+    tgt = p->port - (t ? m->port_end[t - 1] : 0);
+    tgt = (tgt * m->addr_cnt + p->addr) * m->rep_cnt + p->rep;
+    tgt = m->shuffle ? unshuffle(&m->rnd[t], tgt) : tgt;
+    tgt += t ? m->tier_end[t - 1] : 0;
+
+    if (tgt % m->shard_cnt != m->shard)
+        return -1;
+
+    *i = tgt / m->shard_cnt;
+    return 0;
+}
@@ -0,0 +1,68 @@
+/*
+ * Scriptable, asynchronous network packet generator/analyzer.
+ *
+ * Copyright (c) 2015, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * The probes of a scan as a sequence of (address, port, repetition) indices.
+ * The ports are split in tiers, probed one after the other, each one
+ * permuted on its own. The sequence can be split in shards, shard k of n
+ * covering the probes at k, k + n, k + 2n, ... of the whole sequence.
+ */
+struct scan_probe {
+    uint64_t addr;
+    uint64_t port;
+    uint64_t rep;
+};
+
+struct scan_map {
+    uint64_t addr_cnt;
+    uint64_t rep_cnt;
+
+    /* port and probe indices each tier ends at */
+    uint64_t port_end[TIERS_MAX];
+    uint64_t tier_end[TIERS_MAX];
+    size_t   tier_cnt;
+
+    struct shuffle rnd[TIERS_MAX];
+    bool shuffle;
+
+    uint64_t shard;
+    uint64_t shard_cnt;
+};
+
+void scan_map_init(struct scan_map *m, uint64_t addr_cnt,
+                   const size_t *port_end, size_t tier_cnt, uint64_t rep_cnt,
+                   bool shuffle, uint64_t seed);
+void scan_map_shard(struct scan_map *m, uint64_t shard, uint64_t shard_cnt);
+
+uint64_t scan_map_count(const struct scan_map *m);
+
+void scan_map_pick(struct scan_map *m, uint64_t i, struct scan_probe *p);
+int scan_map_index(struct scan_map *m, const struct scan_probe *p,
+                   uint64_t *i);
@@ -28,9 +28,30 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-void *script_load(struct pktizr_args *args);
-void script_close(void *L);
+struct script {
+    const struct script_driver *driver;
+    void *priv;
+};
 
-int script_loop(void *L, struct pktizr_args *args, struct pkt **pkt,
+struct script_driver {
+    const char *name;
+
+    void *(*load)(struct pktizr_args *args, const char *path);
+    void (*close)(void *);
+
+    int (*loop)(void *, struct pktizr_args *, struct pkt **, uint32_t, uint16_t);
+    int (*recv)(void *, struct pktizr_args *, const uint8_t *, size_t);
+
+    void (*expire)(void *, struct pktizr_args *);
+    void (*mute)(void *, bool);
+};
+
+struct script *script_load(struct pktizr_args *args, const char *spec);
+void script_close(struct script *s);
+
+int script_loop(struct script *s, struct pktizr_args *args, struct pkt **pkt,
                 uint32_t addr, uint16_t port);
-int script_recv(void *L, struct pktizr_args *args, struct pkt *pkt);
+int script_recv(struct script *s, struct pktizr_args *args,
+                const uint8_t *buf, size_t len);
+void script_expire(struct script *s, struct pktizr_args *args);
+void script_mute(struct script *s, bool mute);
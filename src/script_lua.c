@@ -0,0 +1,2201 @@
+/*
+ * Scriptable, asynchronous network packet generator/analyzer.
+ *
+ * Copyright (c) 2015, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <time.h>
+#include <pthread.h>
+
+#include <arpa/inet.h>
+
+#include <lua.h>
+#include <lualib.h>
+#include <lauxlib.h>
+
+#include <urcu/uatomic.h>
+
+#include "lua-compat-5.3/c-api/compat-5.3.h"
+#include "ut/utlist.h"
+
+#include "flow.h"
+#include "netdev.h"
+#include "queue.h"
+#include "pkt.h"
+#include "payload.h"
+#include "count.h"
+#include "ring.h"
+#include "shared.h"
+#include "printf.h"
+#include "util.h"
+#include "pktizr.h"
+#include "rules.h"
+#include "script.h"
+
+#define FLOW_MAX     4096
+#define FLOW_TIMEOUT 5
+#define FLOW_TICK    100000
+
+#define COUNT_SIZE   (1 << 14)
+
+#if LUA_VERSION_NUM >= 502
+# define flow_resume(CO, L, N) lua_resume(CO, L, N)
+#else
+# define flow_resume(CO, L, N) lua_resume(CO, N)
+#endif
+
+static void push_pkt(lua_State *L, enum pkt_type type, struct pkt *p);
+static struct pkt *pop_pkt(lua_State *L, struct pktizr_args *args);
+static void push_pkts(lua_State *L, struct pkt *pkt);
+static unsigned get_frame_flags(lua_State *L, int idx);
+
+static struct flow_table *get_flows(lua_State *L, bool create);
+static struct count_table *get_counters(lua_State *L,
+                                        struct pktizr_args *args);
+static bool is_muted(lua_State *L);
+static void emit_record(struct pktizr_args *args, uint32_t addr,
+                        uint16_t port, uint16_t status,
+                        const char *data, size_t len);
+
+static void load_rules(lua_State *L);
+static struct rule_table *get_rules(lua_State *L);
+static int recv_rules(lua_State *L, struct pktizr_args *args,
+                      struct rule_table *rules, const uint8_t *buf, size_t len);
+
+static int resume_flow(lua_State *L, struct flow_table *flows,
+                       struct flow *f, lua_State *co, int nargs);
+static int recv_flow(lua_State *L, struct flow_table *flows, struct pkt *pkt);
+
+static int get_ip4(lua_State *L, const char *key, struct ip4_hdr *ip4);
+static int set_ip4(lua_State *L, const char *key, struct ip4_hdr *ip4);
+
+static int get_icmp(lua_State *L, const char *key, struct icmp_hdr *icmp);
+static int set_icmp(lua_State *L, const char *key, struct icmp_hdr *icmp);
+
+static int get_udp(lua_State *L, const char *key, struct udp_hdr *udp);
+static int set_udp(lua_State *L, const char *key, struct udp_hdr *udp);
+
+static int get_tcp(lua_State *L, const char *key, struct tcp_hdr *tcp);
+static int set_tcp(lua_State *L, const char *key, struct tcp_hdr *tcp);
+
+static int get_raw(lua_State *L, const char *key, struct raw_hdr *raw);
+static int set_raw(lua_State *L, const char *key, struct raw_hdr *raw);
+
+LUALIB_API int luaopen_bit(lua_State *L);
+LUALIB_API int luaopen_codec(lua_State *L);
+LUALIB_API int luaopen_compat53_string(lua_State *L);
+LUALIB_API int luaopen_pkt(lua_State *L);
+LUALIB_API int luaopen_std(lua_State *L);
+
+static const luaL_Reg pktizr_libs[] = {
+    { "pktizr.bin",   luaopen_compat53_string },
+    { "pktizr.bit",   luaopen_bit             },
+    { "pktizr.codec", luaopen_codec           },
+    { "pktizr.pkt",   luaopen_pkt             },
+    { "pktizr.std",   luaopen_std             },
+    { NULL,           NULL                    }
+};
+
+
+static void *script_lua_load(struct pktizr_args *args, const char *script) {
+    int rc;
+
+    lua_State *L = luaL_newstate();
+    if (L == NULL)
+        fail_printf("Error creating Lua state");
+
+    luaL_openlibs(L);
+
+    for (int i = 0; pktizr_libs[i].name; i++) {
+        luaL_requiref(L, pktizr_libs[i].name, pktizr_libs[i].func, 1);
+        lua_pop(L, 1);
+    }
+
+    lua_pushlightuserdata(L, args);
+    lua_setfield(L, LUA_REGISTRYINDEX, "args");
+
+    assert(lua_gettop(L) == 0);
+
+    rc = luaL_loadfile(L, script);
+    if (rc != 0) {
+        const char *err = "unknown error";
+        if (lua_type(L, -1) == LUA_TSTRING)
+            err = lua_tostring(L, -1);
+
+        fail_printf("Error loading script: %s", err);
+    }
+
+    rc = lua_pcall(L, 0, 0, 0);
+    if (rc != 0) {
+        const char *err = "unknown error";
+        if (lua_type(L, -1) == LUA_TSTRING)
+            err = lua_tostring(L, -1);
+
+        fail_printf("Error running script: %s", err);
+    }
+
+    load_rules(L);
+
+    assert(lua_gettop(L) == 0);
+
+    return L;
+}
+
+static void script_lua_close(void *L) {
+    struct flow_table *flows = get_flows(L, false);
+    struct rule_table *rules = get_rules(L);
+
+    lua_close(L);
+
+    if (flows) {
+        flow_table_free(flows);
+        free(flows);
+    }
+
+    if (rules) {
+        rules_free(rules);
+        free(rules);
+    }
+}
+
+static int script_lua_loop(void *L, struct pktizr_args *args, struct pkt **pkt,
+                           uint32_t daddr, uint16_t dport) {
+    int rc;
+
+    char dst_addr[INET_ADDRSTRLEN];
+    daddr = htonl(daddr);
+    inet_ntop(AF_INET, &daddr, dst_addr, sizeof(dst_addr));
+
+    assert(lua_gettop(L) == 0);
+
+    luaL_checkstack(L, 1, "OOM");
+    lua_getglobal(L, "loop");
+
+    if (caa_unlikely(lua_isnil(L, -1)))
+        goto error;
+
+    luaL_checkstack(L, 1, "OOM");
+    lua_pushstring(L, dst_addr);
+
+    luaL_checkstack(L, 1, "OOM");
+    lua_pushinteger(L, dport);
+
+    luaL_checkstack(L, 1, "OOM");
+    if (args->sport_min)
+        lua_pushinteger(L, pkt_source_port(args, ntohl(daddr), dport));
+    else
+        lua_pushnil(L);
+
+    rc = lua_pcall(L, 3, LUA_MULTRET, 0);
+    if (caa_unlikely(rc != 0)) {
+        const char *err = "unknown error";
+        if (lua_type(L, -1) == LUA_TSTRING)
+            err = lua_tostring(L, -1);
+
+        fail_printf("Error running script: %s", err);
+    }
+
+    if (lua_type(L, 1) == LUA_TSTRING) {
+        size_t len;
+        const char *frame = lua_tolstring(L, 1, &len);
+
+        pkt_send_frame(args, (const uint8_t *) frame, len,
+                       get_frame_flags(L, 2));
+
+        lua_settop(L, 0);
+
+        *pkt = NULL;
+        return 0;
+    }
+
+    if (caa_unlikely(lua_isnil(L, -1)))
+        goto error;
+
+    *pkt = pop_pkt(L, args);
+
+    assert(lua_gettop(L) == 0);
+
+    return 0;
+
+error:
+    lua_settop(L, 0);
+    return -1;
+}
+
+static int script_lua_recv(void *L, struct pktizr_args *args,
+                           const uint8_t *buf, size_t len) {
+    int rc;
+
+    struct pkt *pkt;
+    struct flow_table *flows;
+    struct rule_table *rules;
+
+    assert(lua_gettop(L) == 0);
+
+    /* the replies handled by a rule never reach Lua */
+    rules = get_rules(L);
+    if (rules) {
+        rc = recv_rules(L, args, rules, buf, len);
+        if (rc != 1)
+            return rc;
+
+        lua_getglobal(L, "recv");
+        lua_getglobal(L, "flow");
+        rc = lua_isnil(L, -1) && lua_isnil(L, -2);
+        lua_pop(L, 2);
+
+        if (rc)
+            return -1;
+    }
+
+    /* the script takes ownership of the packets */
+    if (!pkt_unpack((uint8_t *) buf, len, &pkt))
+        return -1;
+
+    flows = get_flows(L, true);
+    if (flows) {
+        rc = recv_flow(L, flows, pkt);
+
+        /* fall back to recv() only if the flow table is full */
+        if (rc != 1)
+            return rc;
+    }
+
+    luaL_checkstack(L, 1, "OOM");
+    lua_getglobal(L, "recv");
+
+    if (lua_isnil(L, -1))
+        goto error;
+
+    push_pkts(L, pkt);
+
+    assert(lua_gettop(L) == 2);
+
+    rc = lua_pcall(L, 1, 1, 0);
+    if (rc != 0) {
+        const char *err = "unknown error";
+        if (lua_type(L, -1) == LUA_TSTRING)
+            err = lua_tostring(L, -1);
+
+        fail_printf("Error running script: %s", err);
+    }
+
+    int status = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+
+    assert(lua_gettop(L) == 0);
+
+    return (status ? 0 : -1);
+
+error:
+    lua_settop(L, 0);
+    return -1;
+}
+
+static void script_lua_expire(void *L, struct pktizr_args *args) {
+    uint64_t now;
+
+    size_t n;
+    struct flow_key keys[64];
+
+    struct flow_table *flows = get_flows(L, false);
+    if (flows == NULL)
+        return;
+
+    now = time_now();
+
+    if (now < flows->next_tick)
+        return;
+
+    flows->next_tick = now + FLOW_TICK;
+
+    n = flow_expired(flows, now, keys, 64);
+
+    for (size_t i = 0; i < n; i++) {
+        lua_State *co;
+
+        struct flow *f = flow_lookup(flows, &keys[i]);
+        if (f == NULL)
+            continue;
+
+        lua_rawgeti(L, LUA_REGISTRYINDEX, f->ref);
+        co = lua_tothread(L, -1);
+        lua_pop(L, 1);
+
+        /* resume with no values, so that the pending wait() returns nil */
+        resume_flow(L, flows, f, co, 0);
+    }
+
+    assert(lua_gettop(L) == 0);
+}
+
+/*
+ * Suppress the output of print() and emit() for the replies that follow, e.g.
+ * the ones that didn't change since the --prior scan.
+ */
+static void script_lua_mute(void *L, bool mute) {
+    lua_pushboolean(L, mute);
+    lua_setfield(L, LUA_REGISTRYINDEX, "mute");
+}
+
+static bool is_muted(lua_State *L) {
+    bool mute;
+
+    lua_getfield(L, LUA_REGISTRYINDEX, "mute");
+    mute = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+
+    return mute;
+}
+
+static const char *rule_keys[] = {
+    "proto", "flags", "type", "code", "sport", "dport", "cookie",
+    "emit", "print", "count", "reply", "drop", NULL
+};
+
+static int rule_int(lua_State *L, int n, const char *key) {
+    int val = -1;
+
+    lua_getfield(L, -1, key);
+
+    if (!lua_isnil(L, -1)) {
+        if (!lua_isnumber(L, -1))
+            fail_printf("Invalid rule %d: '%s' is not a number", n, key);
+
+        val = lua_tointeger(L, -1);
+    }
+
+    lua_pop(L, 1);
+
+    return val;
+}
+
+static const char *rule_str(lua_State *L, int n, const char *key) {
+    const char *val = NULL;
+
+    lua_getfield(L, -1, key);
+
+    if (!lua_isnil(L, -1)) {
+        if (lua_type(L, -1) != LUA_TSTRING)
+            fail_printf("Invalid rule %d: '%s' is not a string", n, key);
+
+        val = lua_tostring(L, -1);
+    }
+
+    /* the string is still referenced by the rule table */
+    lua_pop(L, 1);
+
+    return val;
+}
+
+static bool rule_bool(lua_State *L, int n, const char *key) {
+    bool val;
+
+    lua_getfield(L, -1, key);
+    val = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+
+    return val;
+}
+
+/*
+ * Compile the global "rules" table of the script, if any, into a rule table
+ * evaluated in C for every received frame, before recv() and flow().
+ */
+static void load_rules(lua_State *L) {
+    struct rule_table *t;
+    size_t cnt;
+
+    lua_getglobal(L, "rules");
+
+    if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        return;
+    }
+
+    if (!lua_istable(L, -1))
+        fail_printf("Invalid rules: not a table");
+
+    t = malloc(sizeof(*t));
+    if (t == NULL)
+        fail_printf("OOM");
+
+    rules_init(t);
+
+    cnt = lua_rawlen(L, -1);
+
+    for (size_t i = 1; i <= cnt; i++) {
+        struct rule r;
+        const char *str;
+        int n = i;
+
+        lua_rawgeti(L, -1, i);
+
+        if (!lua_istable(L, -1))
+            fail_printf("Invalid rule %d: not a table", n);
+
+        /* catch misspelled fields, rather than silently ignoring them */
+        lua_pushnil(L);
+        while (lua_next(L, -2)) {
+            const char *key = NULL;
+            int k;
+
+            lua_pop(L, 1);
+
+            if (lua_type(L, -1) == LUA_TSTRING)
+                key = lua_tostring(L, -1);
+
+            for (k = 0; key && rule_keys[k]; k++) {
+                if (!strcmp(key, rule_keys[k]))
+                    break;
+            }
+
+            if ((key == NULL) || (rule_keys[k] == NULL))
+                fail_printf("Invalid rule %d: unknown field", n);
+        }
+
+        memset(&r, 0, sizeof(r));
+
+        str = rule_str(L, n, "proto");
+        if (str == NULL)
+            fail_printf("Invalid rule %d: missing 'proto'", n);
+
+        if (!strcmp(str, "tcp"))
+            r.proto = PROTO_TCP;
+        else if (!strcmp(str, "udp"))
+            r.proto = PROTO_UDP;
+        else if (!strcmp(str, "icmp"))
+            r.proto = PROTO_ICMP;
+        else
+            fail_printf("Invalid rule %d: unknown protocol '%s'", n, str);
+
+        str = rule_str(L, n, "flags");
+        if (str && (rules_parse_flags(str, &r.flags, &r.flags_mask) < 0))
+            fail_printf("Invalid rule %d: invalid flags '%s'", n, str);
+
+        r.icmp_type = rule_int(L, n, "type");
+        r.icmp_code = rule_int(L, n, "code");
+        r.sport     = rule_int(L, n, "sport");
+        r.dport     = rule_int(L, n, "dport");
+        r.cookie    = rule_bool(L, n, "cookie");
+
+        lua_getfield(L, -1, "emit");
+        if (lua_isnumber(L, -1)) {
+            r.actions |= RULE_EMIT;
+            r.status   = lua_tointeger(L, -1);
+        } else if (lua_toboolean(L, -1)) {
+            r.actions |= RULE_EMIT;
+        }
+        lua_pop(L, 1);
+
+        r.print = (char *) rule_str(L, n, "print");
+        if (r.print)
+            r.actions |= RULE_PRINT;
+
+        r.count = (char *) rule_str(L, n, "count");
+        if (r.count)
+            r.actions |= RULE_COUNT;
+
+        str = rule_str(L, n, "reply");
+        if (str && strcmp(str, "rst"))
+            fail_printf("Invalid rule %d: unknown reply '%s'", n, str);
+        else if (str)
+            r.actions |= RULE_REPLY;
+
+        if (rule_bool(L, n, "drop"))
+            r.actions |= RULE_DROP;
+
+        if (rules_add(t, &r) < 0)
+            fail_printf("Invalid rule %d", n);
+
+        lua_pop(L, 1);
+    }
+
+    lua_pop(L, 1);
+
+    rules_compile(t);
+
+    lua_pushlightuserdata(L, t);
+    lua_setfield(L, LUA_REGISTRYINDEX, "rules");
+}
+
+static struct rule_table *get_rules(lua_State *L) {
+    struct rule_table *t;
+
+    lua_getfield(L, LUA_REGISTRYINDEX, "rules");
+    t = lua_touserdata(L, -1);
+    lua_pop(L, 1);
+
+    return t;
+}
+
+/*
+ * Run the actions of the first rule matching the frame. Returns 0 if the reply
+ * was claimed, -1 if it was dropped, and 1 if no rule matched.
+ */
+static int recv_rules(lua_State *L, struct pktizr_args *args,
+                      struct rule_table *rules, const uint8_t *buf,
+                      size_t len) {
+    char str[256];
+    struct rule_pkt p;
+    const struct rule *r;
+
+    if (rules_parse(buf, len, &p) < 0)
+        return 1;
+
+    r = rules_match(rules, &p, args->seed);
+    if (r == NULL)
+        return 1;
+
+    if (r->actions & RULE_REPLY) {
+        struct pkt *pkt = NULL, *rst = rules_reply_rst(&p);
+        DL_APPEND(pkt, rst);
+
+        queue_enqueue(&args->queue, &pkt->queue);
+    }
+
+    if (r->actions & RULE_COUNT) {
+        size_t n = rules_format(r->count, &p, str, COUNT_KEY_LEN + 1);
+
+        count_add(get_counters(L, args), str, n, 1);
+    }
+
+    if (r->actions & RULE_DROP)
+        return -1;
+
+    if (is_muted(L))
+        return 0;
+
+    if (r->actions & RULE_PRINT) {
+        rules_format(r->print, &p, str, sizeof(str));
+        ok_printf("%s", str);
+    }
+
+    if (r->actions & RULE_EMIT)
+        emit_record(args, p.src, p.sport, r->status, NULL, 0);
+
+    return 0;
+}
+
+static struct flow_table *get_flows(lua_State *L, bool create) {
+    struct flow_table *flows;
+
+    lua_getfield(L, LUA_REGISTRYINDEX, "flows");
+    flows = lua_touserdata(L, -1);
+
+    if (flows || lua_isboolean(L, -1) || !create) {
+        lua_pop(L, 1);
+        return flows;
+    }
+
+    lua_pop(L, 1);
+
+    lua_getglobal(L, "flow");
+
+    if (!lua_isfunction(L, -1)) {
+        lua_pop(L, 1);
+
+        lua_pushboolean(L, 0);
+        lua_setfield(L, LUA_REGISTRYINDEX, "flows");
+        return NULL;
+    }
+
+    lua_pop(L, 1);
+
+    flows = malloc(sizeof(*flows));
+    flow_table_init(flows, FLOW_MAX);
+
+    lua_pushlightuserdata(L, flows);
+    lua_setfield(L, LUA_REGISTRYINDEX, "flows");
+
+    return flows;
+}
+
+static int get_flow_key(struct pkt *pkt, struct flow_key *key) {
+    struct pkt *cur, *l4;
+
+    DL_FOREACH(pkt, cur) {
+        if (cur->type == TYPE_IP4)
+            break;
+    }
+
+    if (cur == NULL)
+        return -1;
+
+    memset(key, 0, sizeof(*key));
+
+    key->raddr = cur->p.ip4.src;
+    key->laddr = cur->p.ip4.dst;
+    key->proto = cur->p.ip4.proto;
+
+    l4 = cur->next;
+    if (l4 == NULL)
+        return 0;
+
+    switch (l4->type) {
+    case TYPE_TCP:
+        key->rport = l4->p.tcp.sport;
+        key->lport = l4->p.tcp.dport;
+        break;
+
+    case TYPE_UDP:
+        key->rport = l4->p.udp.sport;
+        key->lport = l4->p.udp.dport;
+        break;
+    }
+
+    return 0;
+}
+
+static int resume_flow(lua_State *L, struct flow_table *flows,
+                       struct flow *f, lua_State *co, int nargs) {
+    int rc = flow_resume(co, L, nargs);
+
+    switch (rc) {
+    case LUA_YIELD: {
+        double timeout = FLOW_TIMEOUT;
+
+        if ((lua_gettop(co) > 0) && lua_isnumber(co, -1))
+            timeout = lua_tonumber(co, -1);
+
+        lua_settop(co, 0);
+
+        f->deadline = time_now() + (uint64_t) (timeout * 1e6);
+        return 0;
+    }
+
+    case 0: {
+        int status = (lua_gettop(co) > 0) && lua_toboolean(co, -1);
+
+        /* the coroutine is done, keep it around for the next flow */
+        lua_settop(co, 0);
+
+        if (!flow_pool_put(flows, f->ref))
+            luaL_unref(L, LUA_REGISTRYINDEX, f->ref);
+
+        flow_remove(flows, f);
+
+        return (status ? 0 : -1);
+    }
+
+    default: {
+        const char *err = "unknown error";
+        if (lua_type(co, -1) == LUA_TSTRING)
+            err = lua_tostring(co, -1);
+
+        fail_printf("Error running script: %s", err);
+    }
+    }
+
+    return -1;
+}
+
+static int recv_flow(lua_State *L, struct flow_table *flows, struct pkt *pkt) {
+    int ref;
+    lua_State *co;
+
+    struct flow *f;
+    struct flow_key key;
+
+    char addr[INET_ADDRSTRLEN];
+
+    if (get_flow_key(pkt, &key) < 0)
+        return -1;
+
+    f = flow_lookup(flows, &key);
+    if (f != NULL) {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, f->ref);
+        co = lua_tothread(L, -1);
+        lua_pop(L, 1);
+
+        push_pkts(L, pkt);
+        lua_xmove(L, co, 1);
+
+        return resume_flow(L, flows, f, co, 1);
+    }
+
+    f = flow_insert(flows, &key);
+    if (f == NULL)
+        return 1;
+
+    ref = flow_pool_get(flows);
+    if (ref < 0) {
+        luaL_checkstack(L, 1, "OOM");
+        lua_newthread(L);
+        ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    }
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
+    co = lua_tothread(L, -1);
+    lua_pop(L, 1);
+
+    f->ref = ref;
+
+    inet_ntop(AF_INET, &key.raddr, addr, sizeof(addr));
+
+    luaL_checkstack(co, 3, "OOM");
+    lua_getglobal(L, "flow");
+    lua_xmove(L, co, 1);
+
+    lua_pushstring(co, addr);
+    lua_pushinteger(co, key.rport);
+
+    push_pkts(L, pkt);
+    lua_xmove(L, co, 1);
+
+    return resume_flow(L, flows, f, co, 3);
+}
+
+static void push_pkts(lua_State *L, struct pkt *pkt) {
+    int n = 1;
+
+    struct pkt *cur, *tmp;
+
+    luaL_checkstack(L, 1, "OOM");
+    lua_newtable(L);
+
+    DL_FOREACH_SAFE(pkt, cur, tmp) {
+        luaL_checkstack(L, 1, "OOM");
+
+        switch (cur->type) {
+        case TYPE_ETH:
+        case TYPE_ARP:
+            DL_DELETE(pkt, cur);
+            pkt_free(cur);
+            break;
+
+        case TYPE_IP4:
+        case TYPE_ICMP:
+        case TYPE_UDP:
+        case TYPE_TCP:
+        case TYPE_RAW:
+            push_pkt(L, cur->type, cur);
+            lua_rawseti(L, -2, n++);
+            break;
+        }
+    }
+}
+
+static int pktizr_IP(lua_State *L) {
+    if (lua_gettop(L) != 0)
+        luaL_error(L, "Invalid argument");
+
+    struct pkt *p = pkt_new(TYPE_IP4);
+
+    p->p.ip4.version = 4;
+    p->p.ip4.ihl     = 5;
+    p->p.ip4.ttl     = 64;
+
+    push_pkt(L, TYPE_IP4, p);
+    return 1;
+}
+
+static int pktizr_ICMP(lua_State *L) {
+    if (lua_gettop(L) != 0)
+        luaL_error(L, "Invalid argument");
+
+    struct pkt *p = pkt_new(TYPE_ICMP);
+
+    p->p.icmp.type = 8;
+
+    push_pkt(L, TYPE_ICMP, p);
+    return 1;
+}
+
+static int pktizr_UDP(lua_State *L) {
+    if (lua_gettop(L) != 0)
+        luaL_error(L, "Invalid argument");
+
+    push_pkt(L, TYPE_UDP, NULL);
+    return 1;
+}
+
+static int pktizr_TCP(lua_State *L) {
+    if (lua_gettop(L) != 0)
+        luaL_error(L, "Invalid argument");
+
+    struct pkt *p = pkt_new(TYPE_TCP);
+
+    p->p.tcp.doff   = 5;
+    p->p.tcp.window = 5840;
+
+    push_pkt(L, TYPE_TCP, p);
+    return 1;
+}
+
+static int pktizr_Raw(lua_State *L) {
+    if (lua_gettop(L) != 0)
+        luaL_error(L, "Invalid argument");
+
+    struct pkt *p = pkt_new(TYPE_RAW);
+
+    p->p.raw.payload = NULL;
+
+    push_pkt(L, TYPE_RAW, p);
+    return 1;
+}
+
+static int pktizr_get_time(lua_State *L) {
+    double now = (double) time_now() / 1e6;
+    lua_pushnumber(L, now);
+
+    return 1;
+}
+
+static uint64_t pktizr_cookie(lua_State *L) {
+    struct pktizr_args *args;
+
+    uint16_t dport, sport;
+    struct in_addr daddr, saddr;
+
+    if (lua_gettop(L) != 4)
+        luaL_error(L, "Invalid number of arguments");
+
+    dport = (uint16_t) lua_tonumber(L, -1);
+    lua_pop(L, 1);
+
+    sport = (uint16_t) lua_tonumber(L, -1);
+    lua_pop(L, 1);
+
+    if (lua_isnil(L, -1))
+        luaL_error(L, "Invalid argument 'daddr': nil value");
+
+    if (!inet_aton(lua_tostring(L, -1), &daddr))
+        luaL_error(L, "Invalid argument 'daddr': not an IP address");
+
+    lua_pop(L, 1);
+
+    if (lua_isnil(L, -1))
+        luaL_error(L, "Invalid argument 'saddr': nil value");
+
+    if (!inet_aton(lua_tostring(L, -1), &saddr))
+        luaL_error(L, "Invalid argument 'saddr': not an IP address");
+
+    lua_pop(L, 1);
+
+    lua_getfield(L, LUA_REGISTRYINDEX, "args");
+    args = lua_touserdata(L, -1);
+
+    return pkt_cookie(saddr.s_addr, daddr.s_addr, sport, dport, args->seed);
+}
+
+static int pktizr_cookie16(lua_State *L) {
+    uint64_t cookie = pktizr_cookie(L);
+    lua_pushnumber(L, (uint16_t) cookie);
+
+    return 1;
+}
+
+static int pktizr_cookie32(lua_State *L) {
+    uint64_t cookie = pktizr_cookie(L);
+    lua_pushnumber(L, (uint32_t) cookie);
+
+    return 1;
+}
+
+static int pktizr_source_port(lua_State *L) {
+    struct pktizr_args *args;
+    struct in_addr addr;
+
+    if (!inet_aton(luaL_checkstring(L, 1), &addr))
+        luaL_error(L, "Invalid argument 'addr': not an IP address");
+
+    uint16_t port = luaL_checkinteger(L, 2);
+
+    lua_getfield(L, LUA_REGISTRYINDEX, "args");
+    args = lua_touserdata(L, -1);
+    lua_pop(L, 1);
+
+    if (!args->sport_min)
+        return 0;
+
+    lua_pushinteger(L, pkt_source_port(args, ntohl(addr.s_addr), port));
+    return 1;
+}
+
+static int pktizr_get_addr(lua_State *L) {
+    struct pktizr_args *args;
+
+    char local_addr_str[INET_ADDRSTRLEN];
+    uint32_t laddr;
+
+    lua_getfield(L, LUA_REGISTRYINDEX, "args");
+    args = lua_touserdata(L, -1);
+
+    laddr = htonl(args->local_addr);
+    inet_ntop(AF_INET, &laddr, local_addr_str, sizeof(local_addr_str));
+
+    lua_pushstring(L, local_addr_str);
+
+    return 1;
+
+}
+
+static void check_shared_key(lua_State *L, int idx, struct shared_obj *key) {
+    size_t len;
+    const char *str;
+    lua_Number num;
+
+    switch (lua_type(L, idx)) {
+    case LUA_TNUMBER:
+        num = lua_tonumber(L, idx);
+
+        if (num != (lua_Number) (int64_t) num)
+            luaL_error(L, "Invalid shared key: not an integer");
+
+        shared_obj_int(key, (int64_t) num);
+        return;
+
+    case LUA_TSTRING:
+        str = lua_tolstring(L, idx, &len);
+
+        if (shared_obj_str(key, str, len) < 0)
+            luaL_error(L, "Invalid shared key: string too long");
+
+        return;
+    }
+
+    luaL_error(L, "Invalid shared key type");
+}
+
+static void check_shared_val(lua_State *L, int idx, struct shared_obj *val) {
+    size_t len;
+    const char *str;
+
+    switch (lua_type(L, idx)) {
+    case LUA_TNIL:
+        memset(val, 0, sizeof(*val));
+        val->type = SHARED_NIL;
+        return;
+
+    case LUA_TBOOLEAN:
+        memset(val, 0, sizeof(*val));
+        val->type    = SHARED_BOOLEAN;
+        val->len     = 1;
+        val->data[0] = lua_toboolean(L, idx);
+        return;
+
+    case LUA_TNUMBER:
+        shared_obj_num(val, lua_tonumber(L, idx));
+        return;
+
+    case LUA_TSTRING:
+        str = lua_tolstring(L, idx, &len);
+
+        if (shared_obj_str(val, str, len) < 0)
+            luaL_error(L, "Invalid shared value: string too long");
+
+        return;
+    }
+
+    luaL_error(L, "Invalid shared value type");
+}
+
+static void push_shared_val(lua_State *L, struct shared_obj *val) {
+    double num;
+
+    luaL_checkstack(L, 1, "OOM");
+
+    switch (val->type) {
+    case SHARED_BOOLEAN:
+        lua_pushboolean(L, val->data[0]);
+        break;
+
+    case SHARED_NUMBER:
+        memcpy(&num, val->data, sizeof(num));
+        lua_pushnumber(L, num);
+        break;
+
+    case SHARED_STRING:
+        lua_pushlstring(L, (const char *) val->data, val->len);
+        break;
+
+    default:
+        lua_pushnil(L);
+        break;
+    }
+}
+
+static int pktizr_shared_index(lua_State *L) {
+    struct pktizr_args *args;
+    struct shared_obj key, val;
+
+    lua_getfield(L, LUA_REGISTRYINDEX, "args");
+    args = lua_touserdata(L, -1);
+    lua_pop(L, 1);
+
+    check_shared_key(L, 2, &key);
+
+    shared_get(args->shared, &key, &val);
+    push_shared_val(L, &val);
+
+    return 1;
+}
+
+static int pktizr_shared_newindex(lua_State *L) {
+    struct pktizr_args *args;
+    struct shared_obj key, val;
+
+    lua_getfield(L, LUA_REGISTRYINDEX, "args");
+    args = lua_touserdata(L, -1);
+    lua_pop(L, 1);
+
+    check_shared_key(L, 2, &key);
+    check_shared_val(L, 3, &val);
+
+    if (shared_set(args->shared, &key, &val) < 0)
+        luaL_error(L, "Shared table is full");
+
+    return 0;
+}
+
+static int pktizr_shared_add(lua_State *L) {
+    double res;
+
+    struct pktizr_args *args;
+    struct shared_obj key;
+
+    lua_getfield(L, LUA_REGISTRYINDEX, "args");
+    args = lua_touserdata(L, -1);
+    lua_pop(L, 1);
+
+    check_shared_key(L, 1, &key);
+
+    if (shared_add(args->shared, &key, luaL_optnumber(L, 2, 1), &res) < 0)
+        luaL_error(L, "Shared table is full");
+
+    lua_pushnumber(L, res);
+    return 1;
+}
+
+static int pktizr_skip(lua_State *L) {
+    struct pktizr_args *args;
+    struct in_addr addr;
+
+    if (!inet_aton(luaL_checkstring(L, 1), &addr))
+        luaL_error(L, "Invalid argument 'addr': not an IP address");
+
+    lua_getfield(L, LUA_REGISTRYINDEX, "args");
+    args = lua_touserdata(L, -1);
+    lua_pop(L, 1);
+
+    if (shared_set_skip(args->shared, ntohl(addr.s_addr)) < 0)
+        luaL_error(L, "Shared table is full");
+
+    return 0;
+}
+
+static int pktizr_emit(lua_State *L) {
+    size_t len = 0;
+    const char *data = NULL;
+
+    struct in_addr addr;
+    struct pktizr_args *args;
+
+    const char *addr_str = luaL_checkstring(L, 1);
+    uint16_t    port     = luaL_checkinteger(L, 2);
+    uint16_t    status   = luaL_optinteger(L, 3, 0);
+
+    if (!lua_isnoneornil(L, 4))
+        data = luaL_checklstring(L, 4, &len);
+
+    if (!inet_aton(addr_str, &addr))
+        luaL_error(L, "Invalid argument 'addr': not an IP address");
+
+    if (is_muted(L))
+        return 0;
+
+    lua_getfield(L, LUA_REGISTRYINDEX, "args");
+    args = lua_touserdata(L, -1);
+    lua_pop(L, 1);
+
+    /* the ring only supports a single writer: the recv thread */
+    if (args->ring && !pthread_equal(pthread_self(), args->recv[0].thread))
+        luaL_error(L, "emit() can only be called from recv()");
+
+    emit_record(args, addr.s_addr, port, status, data, len);
+
+    return 0;
+}
+
+static void emit_record(struct pktizr_args *args, uint32_t addr,
+                        uint16_t port, uint16_t status,
+                        const char *data, size_t len) {
+    struct timespec now;
+    struct ring_rec *rec;
+
+    if (!args->ring) {
+        char addr_str[INET_ADDRSTRLEN];
+
+        inet_ntop(AF_INET, &addr, addr_str, sizeof(addr_str));
+        ok_printf("%s %u %u", addr_str, port, status);
+        return;
+    }
+
+    rec = ring_reserve(args->ring);
+    if (rec == NULL)
+        return;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    if (len > RING_DATA_LEN)
+        len = RING_DATA_LEN;
+
+    rec->time   = now.tv_sec * 1000000 + now.tv_nsec / 1000;
+    rec->addr   = addr;
+    rec->port   = port;
+    rec->status = status;
+    rec->len    = len;
+
+    if (len)
+        memcpy(rec->data, data, len);
+
+    ring_commit(args->ring);
+}
+
+static struct count_table *get_counters(lua_State *L,
+                                        struct pktizr_args *args) {
+    struct count_table *t;
+
+    lua_getfield(L, LUA_REGISTRYINDEX, "counters");
+    t = lua_touserdata(L, -1);
+    lua_pop(L, 1);
+
+    if (t)
+        return t;
+
+    t = count_new(COUNT_SIZE);
+
+    /* tables are kept around after the script is closed, for the summary */
+    pthread_mutex_lock(&args->counters_mutex);
+    t->next = args->counters;
+    args->counters = t;
+    pthread_mutex_unlock(&args->counters_mutex);
+
+    lua_pushlightuserdata(L, t);
+    lua_setfield(L, LUA_REGISTRYINDEX, "counters");
+
+    return t;
+}
+
+static int pktizr_count(lua_State *L) {
+    size_t len = 0;
+    char key[COUNT_KEY_LEN];
+
+    struct pktizr_args *args;
+
+    int n = lua_gettop(L);
+    if (n == 0)
+        luaL_error(L, "Invalid number of arguments");
+
+    for (int i = 1; i <= n; i++) {
+        size_t l;
+        const char *s = luaL_tolstring(L, i, &l);
+
+        if (len + l + (i > 1) > sizeof(key))
+            luaL_error(L, "Invalid argument: key too long");
+
+        if (i > 1)
+            key[len++] = ' ';
+
+        memcpy(key + len, s, l);
+        len += l;
+
+        lua_pop(L, 1);
+    }
+
+    lua_getfield(L, LUA_REGISTRYINDEX, "args");
+    args = lua_touserdata(L, -1);
+    lua_pop(L, 1);
+
+    count_add(get_counters(L, args), key, len, 1);
+
+    return 0;
+}
+
+static int pktizr_wait(lua_State *L) {
+    return lua_yield(L, lua_gettop(L));
+}
+
+static int pktizr_print(lua_State *L) {
+    if (is_muted(L))
+        return 0;
+
+    luaL_checkstack(L, 1, "OOM");
+    lua_getglobal(L, "string");
+    lua_getfield(L, -1, "format");
+    lua_insert(L, 1);
+
+    lua_call(L, lua_gettop(L) - 1, 1);
+
+    ok_printf("%s", lua_tostring(L, -1));
+    return 0;
+}
+
+static int pktizr_send(lua_State *L) {
+    struct pktizr_args *args = NULL;
+
+    lua_getfield(L, LUA_REGISTRYINDEX, "args");
+    args = lua_touserdata(L, -1);
+    lua_pop(L, 1);
+
+    struct pkt *pkt = pop_pkt(L, args);
+    assert(lua_gettop(L) == 0);
+
+    queue_enqueue(&args->queue, &pkt->queue);
+
+    lua_pushboolean(L, 1);
+
+    return 1;
+}
+
+static int pktizr_send_raw(lua_State *L) {
+    size_t len;
+    const char *frame;
+
+    struct pkt *pkt = NULL, *p;
+    struct pktizr_args *args = NULL;
+
+    frame = luaL_checklstring(L, 1, &len);
+
+    lua_getfield(L, LUA_REGISTRYINDEX, "args");
+    args = lua_touserdata(L, -1);
+    lua_pop(L, 1);
+
+    p = pkt_new(TYPE_RAW);
+    DL_APPEND(pkt, p);
+
+    p->flags = get_frame_flags(L, 2);
+
+    p->p.raw.payload = malloc(len);
+    p->p.raw.len     = len;
+    p->length        = len;
+
+    memcpy(p->p.raw.payload, frame, len);
+
+    queue_enqueue(&args->queue, &pkt->queue);
+
+    lua_pushboolean(L, 1);
+
+    return 1;
+}
+
+static int pktizr_pkt_gc(lua_State* L) {
+    void *u = lua_touserdata(L, -1);
+
+    if (u == NULL)
+        return 0;
+
+    struct pkt *p = *(struct pkt **) u;
+    pkt_free(p);
+
+    return 0;
+}
+
+static int pktizr_pkt_newindex(lua_State* L) {
+    struct pkt *p   = *(struct pkt **) lua_touserdata(L, -3);
+    const char *key = lua_tostring(L, -2);
+
+    switch (p->type) {
+    case TYPE_IP4:
+        p->length = set_ip4(L, key, &p->p.ip4);
+        return 0;
+
+    case TYPE_ICMP:
+        p->length = set_icmp(L, key, &p->p.icmp);
+        return 0;
+
+    case TYPE_UDP:
+        p->length = set_udp(L, key, &p->p.udp);
+        return 0;
+
+    case TYPE_TCP:
+        p->length = set_tcp(L, key, &p->p.tcp);
+        return 0;
+
+    case TYPE_RAW:
+        p->length = set_raw(L, key, &p->p.raw);
+        return 0;
+    }
+
+    return 0;
+}
+
+static int pktizr_pkt_index(lua_State* L) {
+    struct pkt *p   = *(struct pkt **) lua_touserdata(L, -2);
+    const char *key = lua_tostring(L, -1);
+
+    if (!strncmp("_type", key, sizeof("_type"))) {
+        switch (p->type) {
+        case TYPE_IP4:
+            lua_pushstring(L, "ip4");
+            return 1;
+
+        case TYPE_ICMP:
+            lua_pushstring(L, "icmp");
+            return 1;
+
+        case TYPE_UDP:
+            lua_pushstring(L, "udp");
+            return 1;
+
+        case TYPE_TCP:
+            lua_pushstring(L, "tcp");
+            return 1;
+
+        case TYPE_RAW:
+            lua_pushstring(L, "raw");
+            return 1;
+        }
+    }
+
+    switch (p->type) {
+    case TYPE_IP4:
+        return get_ip4(L, key, &p->p.ip4);
+
+    case TYPE_ICMP:
+        return get_icmp(L, key, &p->p.icmp);
+
+    case TYPE_UDP:
+        return get_udp(L, key, &p->p.udp);
+
+    case TYPE_TCP:
+        return get_tcp(L, key, &p->p.tcp);
+
+    case TYPE_RAW:
+        return get_raw(L, key, &p->p.raw);
+    }
+
+    return 0;
+}
+
+LUALIB_API int luaopen_pkt(lua_State *L) {
+    luaL_Reg const funcs[] = {
+        { "IP",       pktizr_IP       },
+        { "ICMP",     pktizr_ICMP     },
+        { "UDP",      pktizr_UDP      },
+        { "TCP",      pktizr_TCP      },
+        { "Raw",      pktizr_Raw      },
+        { "cookie16", pktizr_cookie16 },
+        { "cookie32", pktizr_cookie32 },
+        { "send",     pktizr_send     },
+        { "send_raw", pktizr_send_raw },
+        { NULL,       NULL            }
+    };
+
+    luaL_Reg const pkt_meta[] = {
+        { "__gc",       pktizr_pkt_gc       },
+        { "__index",    pktizr_pkt_index    },
+        { "__newindex", pktizr_pkt_newindex },
+        { NULL,         NULL                }
+    };
+
+    luaL_newlib(L, funcs);
+
+    luaL_newmetatable(L, "pktizr.pkt");
+    luaL_setfuncs(L, pkt_meta, 0);
+    lua_setmetatable(L, -2);
+
+    return 1;
+}
+
+LUALIB_API int luaopen_std(lua_State *L) {
+    luaL_Reg const funcs[] = {
+        { "get_time",    pktizr_get_time    },
+        { "get_addr",    pktizr_get_addr    },
+        { "source_port", pktizr_source_port },
+        { "print",       pktizr_print       },
+        { "wait",        pktizr_wait        },
+        { "emit",        pktizr_emit        },
+        { "count",       pktizr_count       },
+        { "shared_add",  pktizr_shared_add  },
+        { "skip",        pktizr_skip        },
+        { NULL,          NULL               }
+    };
+
+    luaL_Reg const shared_meta[] = {
+        { "__index",    pktizr_shared_index    },
+        { "__newindex", pktizr_shared_newindex },
+        { NULL,         NULL                   }
+    };
+
+    luaL_newlib(L, funcs);
+
+    lua_newtable(L);
+    luaL_newmetatable(L, "pktizr.shared");
+    luaL_setfuncs(L, shared_meta, 0);
+    lua_setmetatable(L, -2);
+    lua_setfield(L, -2, "shared");
+
+    return 1;
+}
+
+static struct pkt *pop_pkt(lua_State *L, struct pktizr_args *args) {
+    struct pkt *pkt = NULL;
+
+    while (lua_gettop(L) != 0) {
+        struct pkt *p = NULL;
+
+        if (!lua_isuserdata(L, -1))
+            luaL_error(L, "Invalid packet type");
+
+        p = *(struct pkt **) lua_touserdata(L, -1);
+        DL_APPEND(pkt, p);
+
+        p->refcnt++;
+
+        lua_pop(L, 1);
+    }
+
+    struct pkt *eth = pkt_new(TYPE_ETH);
+
+    /* IPv4 packets to the gateway get the header kept in the TX buffers */
+    if (pkt && (pkt->prev->type == TYPE_IP4))
+        eth->flags |= PKT_ETH_PREFIX;
+
+    DL_APPEND(pkt, eth);
+
+    pkt_build_eth(eth, args->local_mac, args->gateway_mac, 0);
+
+    return pkt;
+}
+
+static unsigned get_frame_flags(lua_State *L, int idx) {
+    unsigned flags = PKT_FRAME;
+
+    if (!lua_istable(L, idx))
+        return flags;
+
+    lua_getfield(L, idx, "l2");
+    if (lua_toboolean(L, -1))
+        flags |= PKT_FRAME_L2;
+    lua_pop(L, 1);
+
+    lua_getfield(L, idx, "fixup");
+    if (lua_toboolean(L, -1))
+        flags |= PKT_FRAME_FIXUP;
+    lua_pop(L, 1);
+
+    return flags;
+}
+
+static void push_pkt(lua_State *L, enum pkt_type type, struct pkt *p) {
+    struct pkt **pkt = lua_newuserdata(L, sizeof(*pkt));
+
+    if (p == NULL)
+        p = pkt_new(type);
+
+    *pkt = p;
+
+    luaL_setmetatable(L, "pktizr.pkt");
+}
+
+#define MATCH_KEY(NAME, KEY)                \
+    (!strncmp(NAME, KEY, sizeof(NAME)))
+
+#define MATCH_KEY_TYPE(NAME, KEY, TYPE)         \
+    (MATCH_KEY(NAME, KEY) && lua_is##TYPE(L, -1))
+
+static int get_opt(lua_State *L, struct pkt_opts *opts, uint8_t kind,
+                   size_t at, size_t width) {
+    size_t len;
+    uint32_t val = 0;
+
+    const uint8_t *data = pkt_opts_find(opts, kind, &len);
+
+    if ((data == NULL) || (len < at + width)) {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    for (size_t i = 0; i < width; i++)
+        val = (val << 8) | data[at + i];
+
+    lua_pushnumber(L, val);
+    return 1;
+}
+
+static void set_opt(lua_State *L, struct pkt_opts *opts, uint8_t kind,
+                    size_t size, size_t at, size_t width) {
+    size_t len;
+    uint32_t val;
+    uint8_t data[OPT_MAX_LEN];
+
+    const uint8_t *cur;
+
+    if (lua_isnil(L, -1)) {
+        pkt_opts_del(opts, kind);
+        return;
+    }
+
+    if (!lua_isnumber(L, -1)) {
+        luaL_error(L, "Invalid option value");
+        return;
+    }
+
+    /* keep the other fields of multi-value options (e.g. timestamps) */
+    cur = pkt_opts_find(opts, kind, &len);
+    if (cur && (len == size))
+        memcpy(data, cur, size);
+    else
+        memset(data, 0, size);
+
+    val = lua_tonumber(L, -1);
+
+    for (size_t i = width; i > 0; i--) {
+        data[at + i - 1] = val & 0xff;
+        val >>= 8;
+    }
+
+    if (pkt_opts_set(opts, kind, data, size) < 0)
+        luaL_error(L, "Too many options");
+}
+
+static int get_opts(lua_State *L, struct pkt_opts *opts) {
+    lua_createtable(L, opts->cnt, 0);
+
+    for (int i = 0; i < opts->cnt; i++) {
+        lua_pushnumber(L, opts->opt[i].kind);
+        lua_rawseti(L, -2, i + 1);
+    }
+
+    return 1;
+}
+
+static void set_opts(lua_State *L, struct pkt_opts *opts) {
+    size_t len = 0;
+    const char *buf = "";
+
+    if (!lua_isnil(L, -1)) {
+        if (!lua_isstring(L, -1)) {
+            luaL_error(L, "Invalid option value");
+            return;
+        }
+
+        buf = lua_tolstring(L, -1, &len);
+    }
+
+    if (pkt_opts_parse(opts, (const uint8_t *) buf, len) < 0)
+        luaL_error(L, "Too many options");
+}
+
+static int get_ip4(lua_State *L, const char *key, struct ip4_hdr *ip4) {
+    luaL_checkstack(L, 3, "OOM");
+
+    if (MATCH_KEY("version", key)) {
+        lua_pushnumber(L, ip4->version);
+        goto done;
+    }
+
+    if (MATCH_KEY("ihl", key)) {
+        lua_pushnumber(L, ip4->ihl);
+        goto done;
+    }
+
+    if (MATCH_KEY("tos", key)) {
+        lua_pushnumber(L, ip4->tos);
+        goto done;
+    }
+
+    if (MATCH_KEY("len", key)) {
+        lua_pushnumber(L, ip4->len);
+        goto done;
+    }
+
+    if (MATCH_KEY("id", key)) {
+        lua_pushnumber(L, ip4->id);
+        goto done;
+    }
+
+    if (MATCH_KEY("frag", key)) {
+        lua_pushnumber(L, ip4->frag_off);
+        goto done;
+    }
+
+    if (MATCH_KEY("ttl", key)) {
+        lua_pushnumber(L, ip4->ttl);
+        goto done;
+    }
+
+    if (MATCH_KEY("proto", key)) {
+        lua_pushnumber(L, ip4->proto);
+        goto done;
+    }
+
+    if (MATCH_KEY("chksum", key)) {
+        lua_pushnumber(L, ip4->chksum);
+        goto done;
+    }
+
+    if (MATCH_KEY("src", key)) {
+        struct in_addr saddr = { .s_addr = ip4->src };
+
+        lua_pushstring(L, inet_ntoa(saddr));
+        goto done;
+    }
+
+    if (MATCH_KEY("dst", key)) {
+        struct in_addr daddr = { .s_addr = ip4->dst };
+
+        lua_pushstring(L, inet_ntoa(daddr));
+        goto done;
+    }
+
+    if (MATCH_KEY("opts", key))
+        return get_opts(L, &ip4->opts);
+
+    return luaL_error(L, "Invalid field '%s'", key);
+
+done:
+    return 1;
+}
+
+static int set_ip4(lua_State *L, const char *key, struct ip4_hdr *ip4) {
+    if (MATCH_KEY_TYPE("version", key, number)) {
+        ip4->version = lua_tonumber(L, -1);
+        goto done;
+    }
+
+    if (MATCH_KEY_TYPE("ihl", key, number)) {
+        ip4->ihl = lua_tonumber(L, -1);
+
+        /* keep only the options that fit in the new header length */
+        pkt_opts_truncate(&ip4->opts,
+                          (ip4->ihl > 5) ? (ip4->ihl - 5) * 4 : 0);
+        goto done;
+    }
+
+    if (MATCH_KEY_TYPE("tos", key, number)) {
+        ip4->tos = lua_tonumber(L, -1);
+        goto done;
+    }
+
+    if (MATCH_KEY_TYPE("len", key, number)) {
+        ip4->len = lua_tonumber(L, -1);
+        goto done;
+    }
+
+    if (MATCH_KEY_TYPE("id", key, number)) {
+        ip4->id = lua_tonumber(L, -1);
+        goto done;
+    }
+
+    if (MATCH_KEY_TYPE("frag", key, number)) {
+        ip4->frag_off = lua_tonumber(L, -1);
+        goto done;
+    }
+
+    if (MATCH_KEY_TYPE("ttl", key, number)) {
+        ip4->ttl = lua_tonumber(L, -1);
+        goto done;
+    }
+
+    if (MATCH_KEY_TYPE("proto", key, number)) {
+        ip4->proto = lua_tonumber(L, -1);
+        goto done;
+    }
+
+    if (MATCH_KEY_TYPE("chksum", key, number)) {
+        ip4->version = lua_tonumber(L, -1);
+        goto done;
+    }
+
+    if (MATCH_KEY_TYPE("src", key, string)) {
+        inet_aton(lua_tostring(L, -1), (struct in_addr *) &ip4->src);
+        goto done;
+    }
+
+    if (MATCH_KEY_TYPE("dst", key, string)) {
+        inet_aton(lua_tostring(L, -1), (struct in_addr *) &ip4->dst);
+        goto done;
+    }
+
+    if (MATCH_KEY("opts", key)) {
+        set_opts(L, &ip4->opts);
+        ip4->ihl = 5 + pkt_opts_size(&ip4->opts) / 4;
+        goto done;
+    }
+
+    return luaL_error(L, "Invalid field '%s'", key);
+
+done:
+    return 20 + pkt_opts_size(&ip4->opts);
+}
+
+static int get_icmp(lua_State *L, const char *key, struct icmp_hdr *icmp) {
+    luaL_checkstack(L, 1, "OOM");
+
+    if (MATCH_KEY("type", key)) {
+        lua_pushnumber(L, icmp->type);
+        goto done;
+    }
+
+    if (MATCH_KEY("code", key)) {
+        lua_pushnumber(L, icmp->code);
+        goto done;
+    }
+
+    if (MATCH_KEY("chksum", key)) {
+        lua_pushnumber(L, icmp->chksum);
+        goto done;
+    }
+
+    if (MATCH_KEY("id", key)) {
+        lua_pushnumber(L, icmp->id);
+        goto done;
+    }
+
+    if (MATCH_KEY("seq", key)) {
+        lua_pushnumber(L, icmp->seq);
+        goto done;
+    }
+
+    return luaL_error(L, "Invalid field '%s'", key);
+
+done:
+    return 1;
+}
+
+static int set_icmp(lua_State *L, const char *key, struct icmp_hdr *icmp) {
+    if (MATCH_KEY_TYPE("type", key, number)) {
+        icmp->type = lua_tonumber(L, -1);
+        goto done;
+    }
+
+    if (MATCH_KEY_TYPE("code", key, number)) {
+        icmp->code = lua_tonumber(L, -1);
+        goto done;
+    }
+
+    if (MATCH_KEY_TYPE("chksum", key, number)) {
+        icmp->chksum = lua_tonumber(L, -1);
+        goto done;
+    }
+
+    if (MATCH_KEY_TYPE("id", key, number)) {
+        icmp->id = lua_tonumber(L, -1);
+        goto done;
+    }
+
+    if (MATCH_KEY_TYPE("seq", key, number)) {
+        icmp->seq = lua_tonumber(L, -1);
+        goto done;
+    }
+
+    return luaL_error(L, "Invalid field '%s'", key);
+
+done:
+    return 8;
+}
+
+static int get_udp(lua_State *L, const char *key, struct udp_hdr *udp) {
+    luaL_checkstack(L, 1, "OOM");
+
+    if (MATCH_KEY("sport", key)) {
+        lua_pushnumber(L, udp->sport);
+        goto done;
+    }
+
+    if (MATCH_KEY("dport", key)) {
+        lua_pushnumber(L, udp->dport);
+        goto done;
+    }
+
+    if (MATCH_KEY("len", key)) {
+        lua_pushnumber(L, udp->len);
+        goto done;
+    }
+
+    if (MATCH_KEY("chksum", key)) {
+        lua_pushnumber(L, udp->chksum);
+        goto done;
+    }
+
+    return luaL_error(L, "Invalid field '%s'", key);
+
+done:
+    return 1;
+}
+
+static int set_udp(lua_State *L, const char *key, struct udp_hdr *udp) {
+    if (MATCH_KEY_TYPE("sport", key, number)) {
+        udp->sport = lua_tonumber(L, -1);
+        goto done;
+    }
+
+    if (MATCH_KEY_TYPE("dport", key, number)) {
+        udp->dport = lua_tonumber(L, -1);
+        goto done;
+    }
+
+    if (MATCH_KEY_TYPE("len", key, number)) {
+        udp->len = lua_tonumber(L, -1);
+        goto done;
+    }
+
+    if (MATCH_KEY_TYPE("chksum", key, number)) {
+        udp->chksum = lua_tonumber(L, -1);
+        goto done;
+    }
+
+    return luaL_error(L, "Invalid field '%s'", key);
+
+done:
+    return 8;
+}
+
+static int get_tcp(lua_State *L, const char *key, struct tcp_hdr *tcp) {
+    luaL_checkstack(L, 3, "OOM");
+
+    if (MATCH_KEY("sport", key)) {
+        lua_pushnumber(L, tcp->sport);
+        goto done;
+    }
+
+    if (MATCH_KEY("dport", key)) {
+        lua_pushnumber(L, tcp->dport);
+        goto done;
+    }
+
+    if (MATCH_KEY("seq", key)) {
+        lua_pushnumber(L, tcp->seq);
+        goto done;
+    }
+
+    if (MATCH_KEY("ack_seq", key)) {
+        lua_pushnumber(L, tcp->ack_seq);
+        goto done;
+    }
+
+    if (MATCH_KEY("doff", key)) {
+        lua_pushnumber(L, tcp->doff);
+        goto done;
+    }
+
+    if (MATCH_KEY("fin", key)) {
+        lua_pushboolean(L, tcp->fin);
+        goto done;
+    }
+
+    if (MATCH_KEY("syn", key)) {
+        lua_pushboolean(L, tcp->syn);
+        goto done;
+    }
+
+    if (MATCH_KEY("rst", key)) {
+        lua_pushboolean(L, tcp->rst);
+        goto done;
+    }
+
+    if (MATCH_KEY("psh", key)) {
+        lua_pushboolean(L, tcp->psh);
+        goto done;
+    }
+
+    if (MATCH_KEY("ack", key)) {
+        lua_pushboolean(L, tcp->ack);
+        goto done;
+    }
+
+    if (MATCH_KEY("urg", key)) {
+        lua_pushboolean(L, tcp->urg);
+        goto done;
+    }
+
+    if (MATCH_KEY("ece", key)) {
+        lua_pushboolean(L, tcp->ece);
+        goto done;
+    }
+
+    if (MATCH_KEY("cwr", key)) {
+        lua_pushboolean(L, tcp->cwr);
+        goto done;
+    }
+
+    if (MATCH_KEY("ns", key)) {
+        lua_pushboolean(L, tcp->ns);
+        goto done;
+    }
+
+    if (MATCH_KEY("window", key)) {
+        lua_pushnumber(L, tcp->window);
+        goto done;
+    }
+
+    if (MATCH_KEY("chksum", key)) {
+        lua_pushnumber(L, tcp->chksum);
+        goto done;
+    }
+
+    if (MATCH_KEY("urg_ptr", key)) {
+        lua_pushnumber(L, tcp->urg_ptr);
+        goto done;
+    }
+
+    if (MATCH_KEY("mss", key))
+        return get_opt(L, &tcp->opts, OPT_MSS, 0, 2);
+
+    if (MATCH_KEY("wscale", key))
+        return get_opt(L, &tcp->opts, OPT_WSCALE, 0, 1);
+
+    if (MATCH_KEY("sack_perm", key)) {
+        size_t len;
+        const uint8_t *opt = pkt_opts_find(&tcp->opts, OPT_SACK_PERM, &len);
+
+        lua_pushboolean(L, opt != NULL);
+        goto done;
+    }
+
+    if (MATCH_KEY("ts_val", key))
+        return get_opt(L, &tcp->opts, OPT_TS, 0, 4);
+
+    if (MATCH_KEY("ts_ecr", key))
+        return get_opt(L, &tcp->opts, OPT_TS, 4, 4);
+
+    if (MATCH_KEY("opts", key))
+        return get_opts(L, &tcp->opts);
+
+    return luaL_error(L, "Invalid field '%s'", key);
+
+done:
+    return 1;
+}
+
+static int set_tcp(lua_State *L, const char *key, struct tcp_hdr *tcp) {
+    if (MATCH_KEY_TYPE("sport", key, number)) {
+        tcp->sport = lua_tonumber(L, -1);
+        goto done;
+    }
+
+    if (MATCH_KEY_TYPE("dport", key, number)) {
+        tcp->dport = lua_tonumber(L, -1);
+        goto done;
+    }
+
+    if (MATCH_KEY_TYPE("seq", key, number)) {
+        tcp->seq = lua_tonumber(L, -1);
+        goto done;
+    }
+
+    if (MATCH_KEY_TYPE("ack_seq", key, number)) {
+        tcp->ack_seq = lua_tonumber(L, -1);
+        goto done;
+    }
+
+    if (MATCH_KEY_TYPE("doff", key, number)) {
+        tcp->doff = lua_tonumber(L, -1);
+
+        /* e.g. replying to a SYN-ACK with doff = 5 drops its options */
+        pkt_opts_truncate(&tcp->opts,
+                          (tcp->doff > 5) ? (tcp->doff - 5) * 4 : 0);
+        goto done;
+    }
+
+    if (MATCH_KEY_TYPE("fin", key, boolean)) {
+        tcp->fin = lua_toboolean(L, -1);
+        goto done;
+    }
+
+    if (MATCH_KEY_TYPE("syn", key, boolean)) {
+        tcp->syn = lua_toboolean(L, -1);
+        goto done;
+    }
+
+    if (MATCH_KEY_TYPE("rst", key, boolean)) {
+        tcp->rst = lua_toboolean(L, -1);
+        goto done;
+    }
+
+    if (MATCH_KEY_TYPE("psh", key, boolean)) {
+        tcp->psh = lua_toboolean(L, -1);
+        goto done;
+    }
+
+    if (MATCH_KEY_TYPE("ack", key, boolean)) {
+        tcp->ack = lua_toboolean(L, -1);
+        goto done;
+    }
+
+    if (MATCH_KEY_TYPE("urg", key, boolean)) {
+        tcp->urg = lua_toboolean(L, -1);
+        goto done;
+    }
+
+    if (MATCH_KEY_TYPE("ece", key, boolean)) {
+        tcp->ece = lua_toboolean(L, -1);
+        goto done;
+    }
+
+    if (MATCH_KEY_TYPE("cwr", key, boolean)) {
+        tcp->cwr = lua_toboolean(L, -1);
+        goto done;
+    }
+
+    if (MATCH_KEY_TYPE("ns", key, boolean)) {
+        tcp->ns = lua_toboolean(L, -1);
+        goto done;
+    }
+
+    if (MATCH_KEY_TYPE("window", key, number)) {
+        tcp->window = lua_tonumber(L, -1);
+        goto done;
+    }
+
+    if (MATCH_KEY_TYPE("chksum", key, number)) {
+        tcp->chksum = lua_tonumber(L, -1);
+        goto done;
+    }
+
+    if (MATCH_KEY_TYPE("urg_ptr", key, number)) {
+        tcp->urg_ptr = lua_tonumber(L, -1);
+        goto done;
+    }
+
+    if (MATCH_KEY("mss", key)) {
+        set_opt(L, &tcp->opts, OPT_MSS, 2, 0, 2);
+        goto opts;
+    }
+
+    if (MATCH_KEY("wscale", key)) {
+        set_opt(L, &tcp->opts, OPT_WSCALE, 1, 0, 1);
+        goto opts;
+    }
+
+    if (MATCH_KEY("sack_perm", key)) {
+        if (!lua_toboolean(L, -1))
+            pkt_opts_del(&tcp->opts, OPT_SACK_PERM);
+        else if (pkt_opts_set(&tcp->opts, OPT_SACK_PERM, NULL, 0) < 0)
+            return luaL_error(L, "Too many options");
+
+        goto opts;
+    }
+
+    if (MATCH_KEY("ts_val", key)) {
+        set_opt(L, &tcp->opts, OPT_TS, 8, 0, 4);
+        goto opts;
+    }
+
+    if (MATCH_KEY("ts_ecr", key)) {
+        set_opt(L, &tcp->opts, OPT_TS, 8, 4, 4);
+        goto opts;
+    }
+
+    if (MATCH_KEY("opts", key)) {
+        set_opts(L, &tcp->opts);
+        goto opts;
+    }
+
+    return luaL_error(L, "Invalid field '%s'", key);
+
+opts:
+    tcp->doff = 5 + pkt_opts_size(&tcp->opts) / 4;
+
+done:
+    return 20 + pkt_opts_size(&tcp->opts);
+}
+
+static int get_raw(lua_State *L, const char *key, struct raw_hdr *raw) {
+    luaL_checkstack(L, 1, "OOM");
+
+    if (MATCH_KEY("payload", key)) {
+        lua_pushlstring(L, (const char *) raw->payload, raw->len);
+        goto done;
+    }
+
+    return luaL_error(L, "Invalid field '%s'", key);
+
+done:
+    return 1;
+}
+
+static int set_raw(lua_State *L, const char *key, struct raw_hdr *raw) {
+    if (MATCH_KEY_TYPE("payload", key, string)) {
+        const char *payload = lua_tolstring(L, -1, &raw->len);
+
+        if (raw->payload && !raw->ref)
+            free(raw->payload);
+
+        raw->payload = malloc(raw->len);
+        memcpy(raw->payload, payload, raw->len);
+
+        raw->ref = false;
+
+        goto done;
+    }
+
+    if (MATCH_KEY_TYPE("payload_db", key, number)) {
+        struct pktizr_args *args;
+
+        const uint8_t *payload;
+
+        lua_getfield(L, LUA_REGISTRYINDEX, "args");
+        args = lua_touserdata(L, -1);
+        lua_pop(L, 1);
+
+        if (args->payloads == NULL)
+            return luaL_error(L, "No payload database loaded");
+
+        if (raw->payload && !raw->ref)
+            free(raw->payload);
+
+        payload = payload_get(args->payloads, lua_tonumber(L, -1),
+                              &raw->len, &raw->csum);
+
+        /* ports without a payload get an empty one */
+        raw->payload = (uint8_t *) payload;
+        raw->ref     = (payload != NULL);
+
+        if (payload == NULL)
+            raw->len = 0;
+
+        goto done;
+    }
+
+    return luaL_error(L, "Invalid field '%s'", key);
+
+done:
+    return raw->len;
+}
+
+const struct script_driver script_lua = {
+    .name   = "lua",
+
+    .load   = script_lua_load,
+    .close  = script_lua_close,
+
+    .loop   = script_lua_loop,
+    .recv   = script_lua_recv,
+
+    .expire = script_lua_expire,
+    .mute   = script_lua_mute,
+};
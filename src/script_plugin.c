@@ -0,0 +1,228 @@
+/*
+ * Scriptable, asynchronous network packet generator/analyzer.
+ *
+ * Copyright (c) 2015, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <dlfcn.h>
+#include <pthread.h>
+
+#include <arpa/inet.h>
+
+#include "ut/utlist.h"
+
+#include "netdev.h"
+#include "queue.h"
+#include "pkt.h"
+#include "printf.h"
+#include "util.h"
+#include "pktizr.h"
+#include "script.h"
+#include "pktizr_plugin.h"
+
+#define PLUGIN_FRAME_MAX 9216
+
+struct plugin {
+    void *dl;
+
+    const struct pktizr_plugin *ops;
+    void *ctx;
+
+    struct pktizr_host  host;
+    struct pktizr_args *args;
+
+    bool mute;
+
+    uint8_t frame[PLUGIN_FRAME_MAX];
+};
+
+static unsigned frame_flags(unsigned flags) {
+    unsigned out = PKT_FRAME;
+
+    if (flags & PKTIZR_FRAME_L2)
+        out |= PKT_FRAME_L2;
+
+    if (flags & PKTIZR_FRAME_FIXUP)
+        out |= PKT_FRAME_FIXUP;
+
+    return out;
+}
+
+static int host_send(const struct pktizr_host *host, const uint8_t *frame,
+                     size_t len, unsigned flags) {
+    struct plugin *p = host->priv;
+    struct pkt *pkt = NULL, *raw;
+
+    raw = pkt_new(TYPE_RAW);
+    DL_APPEND(pkt, raw);
+
+    raw->flags = frame_flags(flags);
+
+    raw->p.raw.payload = malloc(len);
+    if (raw->p.raw.payload == NULL)
+        fail_printf("OOM");
+
+    raw->p.raw.len = len;
+    raw->length    = len;
+
+    memcpy(raw->p.raw.payload, frame, len);
+
+    /* frames are sent by the loop thread, as for pkt.send() in scripts */
+    queue_enqueue(&p->args->queue, &pkt->queue);
+
+    return 0;
+}
+
+static void host_print(const struct pktizr_host *host, const char *fmt, ...) {
+    struct plugin *p = host->priv;
+    char buf[1024];
+    va_list ap;
+
+    if (p->mute)
+        return;
+
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+
+    ok_printf("%s", buf);
+}
+
+static uint64_t host_cookie(const struct pktizr_host *host,
+                            uint32_t saddr, uint32_t daddr,
+                            uint16_t sport, uint16_t dport) {
+    struct plugin *p = host->priv;
+
+    return pkt_cookie(saddr, daddr, sport, dport, p->args->seed);
+}
+
+static void *script_plugin_load(struct pktizr_args *args, const char *path) {
+    struct plugin *p = calloc(1, sizeof(*p));
+    if (p == NULL)
+        fail_printf("OOM");
+
+    p->dl = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (p->dl == NULL)
+        fail_printf("Error loading plugin: %s", dlerror());
+
+    p->ops = dlsym(p->dl, "pktizr_plugin");
+    if (p->ops == NULL)
+        fail_printf("Error loading plugin: %s", dlerror());
+
+    if (p->ops->abi != PKTIZR_PLUGIN_ABI)
+        fail_printf("Error loading plugin %s: ABI version %u, expected %u",
+                    path, p->ops->abi, PKTIZR_PLUGIN_ABI);
+
+    p->args = args;
+
+    p->host.abi        = PKTIZR_PLUGIN_ABI;
+    p->host.local_addr = htonl(args->local_addr);
+    p->host.send       = host_send;
+    p->host.print      = host_print;
+    p->host.cookie     = host_cookie;
+    p->host.priv       = p;
+
+    p->ctx = p->ops->init ? p->ops->init(&p->host) : NULL;
+    if (p->ops->init && (p->ctx == NULL))
+        fail_printf("Error initializing plugin %s", path);
+
+    return p;
+}
+
+static void script_plugin_close(void *priv) {
+    struct plugin *p = priv;
+
+    if (p->ops->fini)
+        p->ops->fini(p->ctx);
+
+    dlclose(p->dl);
+
+    freep(&p);
+}
+
+static int script_plugin_loop(void *priv, struct pktizr_args *args,
+                              struct pkt **pkt, uint32_t daddr,
+                              uint16_t dport) {
+    struct plugin *p = priv;
+    size_t   len   = sizeof(p->frame);
+    unsigned flags = 0;
+    uint16_t sport = 0;
+
+    *pkt = NULL;
+
+    if (!p->ops->loop)
+        return -1;
+
+    if (args->sport_min)
+        sport = pkt_source_port(args, daddr, dport);
+
+    if (p->ops->loop(p->ctx, htonl(daddr), dport, sport,
+                     p->frame, &len, &flags) < 0)
+        return -1;
+
+    if (len > sizeof(p->frame))
+        fail_printf("Plugin %s: frame too long", p->ops->name);
+
+    pkt_send_frame(args, p->frame, len, frame_flags(flags));
+
+    return 0;
+}
+
+static int script_plugin_recv(void *priv, struct pktizr_args *args,
+                              const uint8_t *buf, size_t len) {
+    struct plugin *p = priv;
+
+    if (!p->ops->recv)
+        return -1;
+
+    return (p->ops->recv(p->ctx, buf, len) > 0) ? 0 : -1;
+}
+
+static void script_plugin_mute(void *priv, bool mute) {
+    struct plugin *p = priv;
+
+    p->mute = mute;
+}
+
+const struct script_driver script_plugin = {
+    .name   = "plugin",
+
+    .load   = script_plugin_load,
+    .close  = script_plugin_close,
+
+    .loop   = script_plugin_loop,
+    .recv   = script_plugin_recv,
+
+    .mute   = script_plugin_mute,
+};
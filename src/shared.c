@@ -0,0 +1,298 @@
+/*
+ * Scriptable, asynchronous network packet generator/analyzer.
+ *
+ * Copyright (c) 2015, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Concurrent hash map shared by the loop and recv threads.
+ *
+ * The map is split into shards, each one being a separate open addressing
+ * table protected by its own lock, which is only taken by writers. Readers
+ * never lock: every slot carries a sequence counter that writers make odd
+ * while updating the slot, so that readers can detect torn reads and retry.
+ *
+ * Keys are never removed (setting a key to nil just clears its value), so
+ * probe sequences only ever grow and a reader that hits an empty slot can
+ * safely report the key as missing.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#include <urcu/uatomic.h>
+
+#include "hash.h"
+#include "shared.h"
+#include "printf.h"
+#include "util.h"
+
+#define SHARED_SHARDS 256
+
+static inline uint64_t shared_hash(struct shared_obj *key) {
+    uint64_t seed[2] = { 0x9e3779b97f4a7c15ull, 0xc2b2ae3d27d4eb4full };
+
+    return pyrhash((const uint8_t *) seed, (const uint8_t *) key,
+                   sizeof(*key));
+}
+
+struct shared *shared_new(size_t size) {
+    struct shared *s = malloc(sizeof(*s));
+    if (s == NULL)
+        fail_printf("OOM");
+
+    s->shard_cnt  = SHARED_SHARDS;
+    s->shard_size = 1;
+
+    while (s->shard_size * s->shard_cnt < size)
+        s->shard_size <<= 1;
+
+    s->shards = calloc(s->shard_cnt, sizeof(*s->shards));
+    if (s->shards == NULL)
+        fail_printf("OOM");
+
+    for (size_t i = 0; i < s->shard_cnt; i++) {
+        struct shared_shard *shard = &s->shards[i];
+
+        pthread_mutex_init(&shard->lock, NULL);
+
+        shard->slots = calloc(s->shard_size, sizeof(*shard->slots));
+        if (shard->slots == NULL)
+            fail_printf("OOM");
+    }
+
+    return s;
+}
+
+void shared_free(struct shared *s) {
+    for (size_t i = 0; i < s->shard_cnt; i++) {
+        pthread_mutex_destroy(&s->shards[i].lock);
+        freep(&s->shards[i].slots);
+    }
+
+    freep(&s->shards);
+    free(s);
+}
+
+static struct shared_slot *find_slot(struct shared *s, struct shared_obj *key,
+                                     struct shared_shard **shard) {
+    uint64_t hash = shared_hash(key);
+    size_t   mask = s->shard_size - 1;
+
+    *shard = &s->shards[hash % s->shard_cnt];
+
+    for (size_t n = 0, i = (hash / s->shard_cnt) & mask;
+         n < s->shard_size; n++, i = (i + 1) & mask) {
+        struct shared_slot *slot = &(*shard)->slots[i];
+
+        if (!CMM_LOAD_SHARED(slot->used))
+            return slot;
+
+        cmm_smp_rmb();
+
+        if (!memcmp(&slot->key, key, sizeof(*key)))
+            return slot;
+    }
+
+    return NULL;
+}
+
+int shared_get(struct shared *s, struct shared_obj *key,
+               struct shared_obj *val) {
+    struct shared_shard *shard;
+
+    struct shared_slot *slot = find_slot(s, key, &shard);
+    if ((slot == NULL) || !CMM_LOAD_SHARED(slot->used))
+        goto missing;
+
+    while (1) {
+        uint32_t seq = CMM_LOAD_SHARED(slot->seq);
+
+        if (seq & 1) {
+            caa_cpu_relax();
+            continue;
+        }
+
+        cmm_smp_rmb();
+
+        memcpy(val, &slot->val, sizeof(*val));
+
+        cmm_smp_rmb();
+
+        if (CMM_LOAD_SHARED(slot->seq) == seq)
+            return 0;
+    }
+
+missing:
+    val->type = SHARED_NIL;
+    val->len  = 0;
+    return -1;
+}
+
+static void write_slot(struct shared_slot *slot, struct shared_obj *key,
+                       struct shared_obj *val) {
+    CMM_STORE_SHARED(slot->seq, slot->seq + 1);
+    cmm_smp_wmb();
+
+    memcpy(&slot->key, key, sizeof(*key));
+    memcpy(&slot->val, val, sizeof(*val));
+
+    cmm_smp_wmb();
+    CMM_STORE_SHARED(slot->seq, slot->seq + 1);
+
+    cmm_smp_wmb();
+    CMM_STORE_SHARED(slot->used, 1);
+}
+
+int shared_set(struct shared *s, struct shared_obj *key,
+               struct shared_obj *val) {
+    struct shared_shard *shard;
+    struct shared_slot  *slot;
+
+    slot = find_slot(s, key, &shard);
+    if (slot == NULL)
+        return -1;
+
+    pthread_mutex_lock(&shard->lock);
+
+    /* another writer may have taken the slot before we got the lock */
+    slot = find_slot(s, key, &shard);
+    if (slot == NULL) {
+        pthread_mutex_unlock(&shard->lock);
+        return -1;
+    }
+
+    if (!slot->used)
+        shard->count++;
+
+    write_slot(slot, key, val);
+
+    pthread_mutex_unlock(&shard->lock);
+
+    return 0;
+}
+
+int shared_add(struct shared *s, struct shared_obj *key, double delta,
+               double *res) {
+    double num = 0;
+
+    struct shared_obj   val;
+    struct shared_shard *shard;
+    struct shared_slot  *slot;
+
+    slot = find_slot(s, key, &shard);
+    if (slot == NULL)
+        return -1;
+
+    pthread_mutex_lock(&shard->lock);
+
+    slot = find_slot(s, key, &shard);
+    if (slot == NULL) {
+        pthread_mutex_unlock(&shard->lock);
+        return -1;
+    }
+
+    if (!slot->used)
+        shard->count++;
+    else if (slot->val.type == SHARED_NUMBER)
+        memcpy(&num, slot->val.data, sizeof(num));
+
+    num += delta;
+
+    shared_obj_num(&val, num);
+    write_slot(slot, key, &val);
+
+    pthread_mutex_unlock(&shard->lock);
+
+    if (res)
+        *res = num;
+
+    return 0;
+}
+
+void shared_obj_int(struct shared_obj *o, int64_t v) {
+    memset(o, 0, sizeof(*o));
+
+    o->type = SHARED_INTEGER;
+    o->len  = sizeof(v);
+    memcpy(o->data, &v, sizeof(v));
+}
+
+void shared_obj_num(struct shared_obj *o, double v) {
+    memset(o, 0, sizeof(*o));
+
+    o->type = SHARED_NUMBER;
+    o->len  = sizeof(v);
+    memcpy(o->data, &v, sizeof(v));
+}
+
+int shared_obj_str(struct shared_obj *o, const char *s, size_t len) {
+    if (len > SHARED_DATA_LEN)
+        return -1;
+
+    memset(o, 0, sizeof(*o));
+
+    o->type = SHARED_STRING;
+    o->len  = len;
+    memcpy(o->data, s, len);
+
+    return 0;
+}
+
+int shared_set_skip(struct shared *s, uint32_t addr) {
+    struct shared_obj key, val;
+
+    memset(&key, 0, sizeof(key));
+    key.type = SHARED_SKIP;
+    key.len  = sizeof(addr);
+    memcpy(key.data, &addr, sizeof(addr));
+
+    memset(&val, 0, sizeof(val));
+    val.type = SHARED_BOOLEAN;
+    val.len  = 1;
+    val.data[0] = 1;
+
+    return shared_set(s, &key, &val);
+}
+
+bool shared_skip(struct shared *s, uint32_t addr) {
+    struct shared_obj key, val;
+
+    memset(&key, 0, sizeof(key));
+    key.type = SHARED_SKIP;
+    key.len  = sizeof(addr);
+    memcpy(key.data, &addr, sizeof(addr));
+
+    if (shared_get(s, &key, &val) < 0)
+        return false;
+
+    return (val.type == SHARED_BOOLEAN) && val.data[0];
+}
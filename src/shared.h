@@ -0,0 +1,82 @@
+/*
+ * Scriptable, asynchronous network packet generator/analyzer.
+ *
+ * Copyright (c) 2015, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define SHARED_DATA_LEN 14
+
+enum shared_type {
+    SHARED_NIL,
+    SHARED_NUMBER,
+    SHARED_BOOLEAN,
+    SHARED_STRING,
+    SHARED_INTEGER,
+    SHARED_SKIP,
+};
+
+struct shared_obj {
+    uint8_t type;
+    uint8_t len;
+    uint8_t data[SHARED_DATA_LEN];
+};
+
+struct shared_slot {
+    uint32_t seq;
+    uint32_t used;
+
+    struct shared_obj key;
+    struct shared_obj val;
+};
+
+struct shared_shard {
+    pthread_mutex_t lock;
+
+    struct shared_slot *slots;
+    size_t count;
+} __attribute__((aligned(64)));
+
+struct shared {
+    struct shared_shard *shards;
+    size_t shard_cnt;
+    size_t shard_size;
+};
+
+struct shared *shared_new(size_t size);
+void shared_free(struct shared *s);
+
+int shared_get(struct shared *s, struct shared_obj *key, struct shared_obj *val);
+int shared_set(struct shared *s, struct shared_obj *key, struct shared_obj *val);
+int shared_add(struct shared *s, struct shared_obj *key, double delta,
+               double *res);
+
+void shared_obj_int(struct shared_obj *o, int64_t v);
+void shared_obj_num(struct shared_obj *o, double v);
+int shared_obj_str(struct shared_obj *o, const char *s, size_t len);
+
+int shared_set_skip(struct shared *s, uint32_t addr);
+bool shared_skip(struct shared *s, uint32_t addr);
@@ -35,6 +35,7 @@
  */
 
 #include <stdint.h>
+#include <stddef.h>
 #include <math.h>
 
 #include "hash.h"
@@ -52,9 +53,10 @@ void shuffle_init(struct shuffle *r, uint64_t range, uint64_t seed) {
     double root = sqrt(range);
 
     switch (range) {
+    /* an empty permutation, only make sure the loop below terminates */
     case 0:
-        r->a = 0;
-        r->b = 0;
+        r->a = 1;
+        r->b = 1;
         break;
 
     case 1:
@@ -106,6 +108,29 @@ uint64_t unshuffle(struct shuffle *r, uint64_t m) {
     return c;
 }
 
+/*
+ * Same as unshuffle() on every value. All the values go through the cipher
+ * once first, so that their rounds can overlap, and only the few that fell
+ * outside of the range are cycle-walked afterwards.
+ */
+void unshuffle_batch(struct shuffle *r, const uint64_t *m, uint64_t *out,
+                     size_t cnt) {
+    size_t left = 0;
+
+    for (size_t i = 0; i < cnt; i++) {
+        out[i] = do_unshuffle(r->rounds, r->a, r->b, m[i], r->seed);
+        left  += (out[i] >= r->range);
+    }
+
+    for (size_t i = 0; left && (i < cnt); i++) {
+        if (out[i] < r->range)
+            continue;
+
+        out[i] = unshuffle(r, out[i]);
+        left--;
+    }
+}
+
 static inline uint64_t F(uint64_t r, uint64_t R, uint64_t seed) {
     uint64_t buf[2];
     uint64_t key[2];
@@ -38,3 +38,5 @@ struct shuffle {
 void shuffle_init(struct shuffle *r, uint64_t range, uint64_t seed);
 uint64_t shuffle(struct shuffle *r, uint64_t m);
 uint64_t unshuffle(struct shuffle *r, uint64_t m);
+void unshuffle_batch(struct shuffle *r, const uint64_t *m, uint64_t *out,
+                     size_t cnt);
@@ -0,0 +1,510 @@
+/*
+ * Scriptable, asynchronous network packet generator/analyzer.
+ *
+ * Copyright (c) 2015, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Compact store of scan results: for every responsive host, the set of its
+ * responsive ports, kept either as a sorted array or as a bitmap depending on
+ * its size (like roaring bitmap containers). The store is built in memory
+ * during the scan, and written to a file that can be mapped read-only for
+ * queries and set operations.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "store.h"
+#include "printf.h"
+#include "util.h"
+
+#define ALIGN8(X) (((X) + 7) & ~((uint64_t) 7))
+
+static inline size_t store_hash(uint32_t addr) {
+    return (addr * 0x9e3779b1u) ^ (addr >> 16);
+}
+
+struct store *store_new(void) {
+    struct store *s = calloc(1, sizeof(*s));
+    if (s == NULL)
+        fail_printf("OOM");
+
+    s->index_size = 1024;
+    s->index = calloc(s->index_size, sizeof(*s->index));
+    if (s->index == NULL)
+        fail_printf("OOM");
+
+    return s;
+}
+
+void store_free(struct store *s) {
+    for (size_t i = 0; i < s->cnt; i++) {
+        free(s->sets[i].ports);
+        free(s->sets[i].bits);
+    }
+
+    free(s->sets);
+    free(s->index);
+    free(s);
+}
+
+static void store_rehash(struct store *s) {
+    size_t mask;
+
+    free(s->index);
+
+    s->index_size *= 2;
+    s->index = calloc(s->index_size, sizeof(*s->index));
+    if (s->index == NULL)
+        fail_printf("OOM");
+
+    mask = s->index_size - 1;
+
+    for (size_t n = 0; n < s->cnt; n++) {
+        size_t i = store_hash(s->sets[n].addr) & mask;
+
+        while (s->index[i])
+            i = (i + 1) & mask;
+
+        s->index[i] = n + 1;
+    }
+}
+
+static struct store_set *store_get(struct store *s, uint32_t addr) {
+    size_t i, mask;
+    struct store_set *set;
+
+    if ((s->cnt + 1) * 2 > s->index_size)
+        store_rehash(s);
+
+    mask = s->index_size - 1;
+
+    for (i = store_hash(addr) & mask; s->index[i]; i = (i + 1) & mask) {
+        set = &s->sets[s->index[i] - 1];
+
+        if (set->addr == addr)
+            return set;
+    }
+
+    if (s->cnt == s->cap) {
+        s->cap  = s->cap ? s->cap * 2 : 64;
+        s->sets = realloc(s->sets, s->cap * sizeof(*s->sets));
+        if (s->sets == NULL)
+            fail_printf("OOM");
+    }
+
+    s->index[i] = s->cnt + 1;
+
+    set = &s->sets[s->cnt++];
+    memset(set, 0, sizeof(*set));
+
+    set->addr = addr;
+
+    return set;
+}
+
+static void set_to_bitmap(struct store_set *set) {
+    set->bits = calloc(1, STORE_BITMAP_LEN);
+    if (set->bits == NULL)
+        fail_printf("OOM");
+
+    for (size_t i = 0; i < set->card; i++)
+        set->bits[set->ports[i] / 64] |= 1ull << (set->ports[i] % 64);
+
+    freep(&set->ports);
+    set->cap = 0;
+}
+
+void store_add(struct store *s, uint32_t addr, uint16_t port) {
+    size_t lo = 0, hi;
+    struct store_set *set = store_get(s, addr);
+
+    if (set->bits) {
+        uint64_t bit = 1ull << (port % 64);
+
+        if (!(set->bits[port / 64] & bit)) {
+            set->bits[port / 64] |= bit;
+            set->card++;
+        }
+
+        return;
+    }
+
+    hi = set->card;
+
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+
+        if (set->ports[mid] < port)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if ((lo < set->card) && (set->ports[lo] == port))
+        return;
+
+    if (set->card == STORE_ARRAY_MAX) {
+        set_to_bitmap(set);
+        store_add(s, addr, port);
+        return;
+    }
+
+    if (set->card == set->cap) {
+        set->cap   = set->cap ? set->cap * 2 : 4;
+        set->ports = realloc(set->ports, set->cap * sizeof(*set->ports));
+        if (set->ports == NULL)
+            fail_printf("OOM");
+    }
+
+    memmove(set->ports + lo + 1, set->ports + lo,
+            (set->card - lo) * sizeof(*set->ports));
+
+    set->ports[lo] = port;
+    set->card++;
+}
+
+static int set_cmp(const void *a, const void *b) {
+    const struct store_set *x = a, *y = b;
+
+    return (x->addr > y->addr) - (x->addr < y->addr);
+}
+
+static size_t set_len(uint32_t card) {
+    if (card > STORE_ARRAY_MAX)
+        return STORE_BITMAP_LEN;
+
+    return card * sizeof(uint16_t);
+}
+
+int store_save(struct store *s, const char *path) {
+    uint64_t off;
+    static const uint8_t pad[8];
+
+    struct store_hdr hdr;
+
+    FILE *f = fopen(path, "w");
+    if (f == NULL)
+        return -1;
+
+    /* the hosts are reordered, so the hash index is no longer valid */
+    qsort(s->sets, s->cnt, sizeof(*s->sets), set_cmp);
+    memset(s->index, 0, s->index_size * sizeof(*s->index));
+
+    for (size_t i = 0; i < s->cnt; i++) {
+        size_t mask = s->index_size - 1;
+        size_t j = store_hash(s->sets[i].addr) & mask;
+
+        while (s->index[j])
+            j = (j + 1) & mask;
+
+        s->index[j] = i + 1;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, STORE_MAGIC, sizeof(hdr.magic));
+
+    hdr.version    = STORE_VERSION;
+    hdr.host_count = s->cnt;
+    hdr.time       = time(NULL);
+
+    off = ALIGN8(sizeof(hdr) + s->cnt * sizeof(struct store_host));
+
+    for (size_t i = 0; i < s->cnt; i++) {
+        hdr.port_count += s->sets[i].card;
+        off += ALIGN8(set_len(s->sets[i].card));
+    }
+
+    hdr.size = off;
+
+    fwrite(&hdr, sizeof(hdr), 1, f);
+
+    off = ALIGN8(sizeof(hdr) + s->cnt * sizeof(struct store_host));
+
+    for (size_t i = 0; i < s->cnt; i++) {
+        struct store_host h = {
+            .addr = s->sets[i].addr,
+            .card = s->sets[i].card,
+            .off  = off,
+        };
+
+        fwrite(&h, sizeof(h), 1, f);
+
+        off += ALIGN8(set_len(h.card));
+    }
+
+    off = sizeof(hdr) + s->cnt * sizeof(struct store_host);
+    fwrite(pad, ALIGN8(off) - off, 1, f);
+
+    for (size_t i = 0; i < s->cnt; i++) {
+        struct store_set *set = &s->sets[i];
+        size_t len = set_len(set->card);
+
+        if (set->bits)
+            fwrite(set->bits, len, 1, f);
+        else
+            fwrite(set->ports, len, 1, f);
+
+        fwrite(pad, ALIGN8(len) - len, 1, f);
+    }
+
+    if (ferror(f)) {
+        fclose(f);
+        return -1;
+    }
+
+    return fclose(f);
+}
+
+/*
+ * Check that the port set of the host has as many ports as its card says, so
+ * that store_ports() never returns more.
+ */
+static bool host_valid(const struct store_file *f, const struct store_host *h) {
+    size_t n = 0;
+    const uint64_t *bits;
+
+    if (h->card <= STORE_ARRAY_MAX)
+        return true;
+
+    bits = (const uint64_t *) ((const uint8_t *) f->hdr + h->off);
+
+    for (size_t w = 0; w < STORE_BITMAP_LEN / 8; w++)
+        n += __builtin_popcountll(bits[w]);
+
+    return n == h->card;
+}
+
+struct store_file *store_open(const char *path) {
+    int rc;
+    struct stat st;
+    uint64_t port_count = 0;
+
+    struct store_file *f;
+
+    _close_ int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        sysf_printf("open(%s)", path);
+
+    rc = fstat(fd, &st);
+    if (rc < 0)
+        sysf_printf("fstat(%s)", path);
+
+    if ((size_t) st.st_size < sizeof(struct store_hdr))
+        fail_printf("Invalid result store %s", path);
+
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+        sysf_printf("mmap()");
+
+    f = malloc(sizeof(*f));
+    if (f == NULL)
+        fail_printf("OOM");
+
+    f->hdr   = p;
+    f->hosts = (struct store_host *) ((uint8_t *) p + sizeof(*f->hdr));
+    f->size  = st.st_size;
+
+    if (memcmp(f->hdr->magic, STORE_MAGIC, sizeof(f->hdr->magic)) ||
+        (f->hdr->version != STORE_VERSION) || (f->hdr->size != f->size) ||
+        (sizeof(*f->hdr) + (uint64_t) f->hdr->host_count *
+                           sizeof(*f->hosts) > f->size))
+        fail_printf("Invalid result store %s", path);
+
+    for (size_t i = 0; i < f->hdr->host_count; i++) {
+        const struct store_host *h = &f->hosts[i];
+
+        if ((h->card == 0) || (h->card > 65536) || (h->off & 7) ||
+            (h->off + set_len(h->card) > f->size) ||
+            ((i > 0) && (h->addr <= f->hosts[i - 1].addr)) ||
+            !host_valid(f, h))
+            fail_printf("Invalid result store %s", path);
+
+        port_count += h->card;
+    }
+
+    if (port_count != f->hdr->port_count)
+        fail_printf("Invalid result store %s", path);
+
+    return f;
+}
+
+void store_close(struct store_file *f) {
+    munmap(f->hdr, f->size);
+    free(f);
+}
+
+const struct store_host *store_find(const struct store_file *f, uint32_t addr) {
+    size_t lo = 0, hi = f->hdr->host_count;
+
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+
+        if (f->hosts[mid].addr < addr)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if ((lo < f->hdr->host_count) && (f->hosts[lo].addr == addr))
+        return &f->hosts[lo];
+
+    return NULL;
+}
+
+bool store_has(const struct store_file *f, const struct store_host *h,
+               uint16_t port) {
+    const uint8_t *set = (const uint8_t *) f->hdr + h->off;
+
+    if (h->card > STORE_ARRAY_MAX) {
+        const uint64_t *bits = (const uint64_t *) set;
+
+        return bits[port / 64] & (1ull << (port % 64));
+    }
+
+    const uint16_t *ports = (const uint16_t *) set;
+    size_t lo = 0, hi = h->card;
+
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+
+        if (ports[mid] < port)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return (lo < h->card) && (ports[lo] == port);
+}
+
+size_t store_ports(const struct store_file *f, const struct store_host *h,
+                   uint16_t *out) {
+    size_t n = 0;
+    const uint8_t *set = (const uint8_t *) f->hdr + h->off;
+
+    if (h->card <= STORE_ARRAY_MAX) {
+        memcpy(out, set, h->card * sizeof(*out));
+        return h->card;
+    }
+
+    const uint64_t *bits = (const uint64_t *) set;
+
+    for (size_t w = 0; w < STORE_BITMAP_LEN / 8; w++) {
+        uint64_t word = bits[w];
+
+        while (word) {
+            out[n++] = w * 64 + __builtin_ctzll(word);
+            word &= word - 1;
+        }
+    }
+
+    return n;
+}
+
+static void add_host(struct store *s, const struct store_file *f,
+                     const struct store_host *h, uint16_t *ports) {
+    size_t n = store_ports(f, h, ports);
+
+    for (size_t i = 0; i < n; i++)
+        store_add(s, h->addr, ports[i]);
+}
+
+struct store *store_union(const struct store_file *a,
+                          const struct store_file *b) {
+    struct store *s = store_new();
+
+    _free_ uint16_t *ports = malloc(65536 * sizeof(*ports));
+    if (ports == NULL)
+        fail_printf("OOM");
+
+    for (size_t i = 0; i < a->hdr->host_count; i++)
+        add_host(s, a, &a->hosts[i], ports);
+
+    for (size_t i = 0; i < b->hdr->host_count; i++)
+        add_host(s, b, &b->hosts[i], ports);
+
+    return s;
+}
+
+struct store *store_intersect(const struct store_file *a,
+                              const struct store_file *b) {
+    struct store *s = store_new();
+
+    _free_ uint16_t *ports = malloc(65536 * sizeof(*ports));
+    if (ports == NULL)
+        fail_printf("OOM");
+
+    for (size_t i = 0; i < a->hdr->host_count; i++) {
+        const struct store_host *ha = &a->hosts[i];
+        const struct store_host *hb = store_find(b, ha->addr);
+
+        if (hb == NULL)
+            continue;
+
+        size_t n = store_ports(a, ha, ports);
+
+        for (size_t j = 0; j < n; j++) {
+            if (store_has(b, hb, ports[j]))
+                store_add(s, ha->addr, ports[j]);
+        }
+    }
+
+    return s;
+}
+
+struct store *store_diff(const struct store_file *a,
+                         const struct store_file *b) {
+    struct store *s = store_new();
+
+    _free_ uint16_t *ports = malloc(65536 * sizeof(*ports));
+    if (ports == NULL)
+        fail_printf("OOM");
+
+    for (size_t i = 0; i < a->hdr->host_count; i++) {
+        const struct store_host *ha = &a->hosts[i];
+        const struct store_host *hb = store_find(b, ha->addr);
+
+        size_t n = store_ports(a, ha, ports);
+
+        for (size_t j = 0; j < n; j++) {
+            if ((hb == NULL) || !store_has(b, hb, ports[j]))
+                store_add(s, ha->addr, ports[j]);
+        }
+    }
+
+    return s;
+}
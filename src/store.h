@@ -0,0 +1,108 @@
+/*
+ * Scriptable, asynchronous network packet generator/analyzer.
+ *
+ * Copyright (c) 2015, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define STORE_MAGIC      "PKTZSTOR"
+#define STORE_VERSION    1
+
+/* port sets with more ports than this are stored as bitmaps */
+#define STORE_ARRAY_MAX  4096
+#define STORE_BITMAP_LEN (65536 / 8)
+
+/*
+ * On-disk layout of the result store:
+ *
+ *   struct store_hdr
+ *   struct store_host[host_count]     (sorted by address)
+ *   port sets                         (8 bytes aligned)
+ *
+ * Every host points to the set of its ports, which is either a sorted array of
+ * 16 bit port numbers (when card <= STORE_ARRAY_MAX), or a bitmap of all the
+ * 65536 ports. All integers, including addresses, are in host byte order.
+ */
+struct store_hdr {
+    char     magic[8];
+    uint32_t version;
+    uint32_t host_count;
+    uint64_t port_count;
+    uint64_t size;
+    uint64_t time;
+};
+
+struct store_host {
+    uint32_t addr;
+    uint32_t card;
+    uint64_t off;
+};
+
+struct store_file {
+    struct store_hdr  *hdr;
+    struct store_host *hosts;
+
+    size_t size;
+};
+
+struct store_set {
+    uint32_t addr;
+    uint32_t card;
+    uint32_t cap;
+
+    uint16_t *ports;
+    uint64_t *bits;
+};
+
+struct store {
+    struct store_set *sets;
+    size_t            cnt;
+    size_t            cap;
+
+    uint32_t *index;
+    size_t    index_size;
+};
+
+struct store *store_new(void);
+void store_free(struct store *s);
+void store_add(struct store *s, uint32_t addr, uint16_t port);
+int store_save(struct store *s, const char *path);
+
+struct store_file *store_open(const char *path);
+void store_close(struct store_file *f);
+
+const struct store_host *store_find(const struct store_file *f, uint32_t addr);
+bool store_has(const struct store_file *f, const struct store_host *h,
+               uint16_t port);
+size_t store_ports(const struct store_file *f, const struct store_host *h,
+                   uint16_t *out);
+
+struct store *store_union(const struct store_file *a,
+                          const struct store_file *b);
+struct store *store_intersect(const struct store_file *a,
+                              const struct store_file *b);
+struct store *store_diff(const struct store_file *a,
+                         const struct store_file *b);
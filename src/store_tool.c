@@ -0,0 +1,178 @@
+/*
+ * Scriptable, asynchronous network packet generator/analyzer.
+ *
+ * Copyright (c) 2015, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Queries and set operations on result stores (see --output-store).
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <arpa/inet.h>
+
+#include "store.h"
+#include "printf.h"
+#include "util.h"
+
+static void print_addr(uint32_t addr) {
+    char str[INET_ADDRSTRLEN];
+    struct in_addr in = { .s_addr = htonl(addr) };
+
+    inet_ntop(AF_INET, &in, str, sizeof(str));
+    printf("%s", str);
+}
+
+static void cmd_info(struct store_file *f) {
+    time_t t = f->hdr->time;
+
+    printf("hosts: %u\n", f->hdr->host_count);
+    printf("ports: %zu\n", f->hdr->port_count);
+    printf("size:  %zu bytes\n", f->hdr->size);
+    printf("time:  %s", ctime(&t));
+}
+
+static void cmd_dump(struct store_file *f) {
+    _free_ uint16_t *ports = malloc(65536 * sizeof(*ports));
+    if (ports == NULL)
+        fail_printf("OOM");
+
+    for (size_t i = 0; i < f->hdr->host_count; i++) {
+        size_t n = store_ports(f, &f->hosts[i], ports);
+
+        for (size_t j = 0; j < n; j++) {
+            print_addr(f->hosts[i].addr);
+            printf(" %u\n", ports[j]);
+        }
+    }
+}
+
+/* prints the hosts that have all the given ports */
+static void cmd_hosts(struct store_file *f, char *spec) {
+    size_t cnt = 0;
+    uint16_t ports[64];
+
+    char *save = NULL;
+
+    for (char *tok = strtok_r(spec, ",", &save); tok;
+               tok = strtok_r(NULL, ",", &save)) {
+        char *end;
+        unsigned long port = strtoul(tok, &end, 10);
+
+        if ((*end != '\0') || (port > 65535) || (cnt == 64))
+            fail_printf("Invalid port list");
+
+        ports[cnt++] = port;
+    }
+
+    for (size_t i = 0; i < f->hdr->host_count; i++) {
+        size_t j;
+
+        for (j = 0; j < cnt; j++) {
+            if (!store_has(f, &f->hosts[i], ports[j]))
+                break;
+        }
+
+        if (j < cnt)
+            continue;
+
+        print_addr(f->hosts[i].addr);
+        printf("\n");
+    }
+}
+
+static void cmd_setop(const char *op, const char *a_path, const char *b_path,
+                      const char *out) {
+    struct store *s;
+    struct store_file *a = store_open(a_path);
+    struct store_file *b = store_open(b_path);
+
+    if (!strcmp(op, "union"))
+        s = store_union(a, b);
+    else if (!strcmp(op, "inter"))
+        s = store_intersect(a, b);
+    else
+        s = store_diff(a, b);
+
+    if (store_save(s, out) < 0)
+        sysf_printf("Error writing %s", out);
+
+    store_free(s);
+
+    store_close(a);
+    store_close(b);
+}
+
+static void usage(void) {
+    fprintf(stderr, "Usage: pktizr-store info <file>\n");
+    fprintf(stderr, "       pktizr-store dump <file>\n");
+    fprintf(stderr, "       pktizr-store hosts <file> <port>[,<port>...]\n");
+    fprintf(stderr, "       pktizr-store union|inter|diff <a> <b> <output>\n");
+}
+
+int main(int argc, char *argv[]) {
+    struct store_file *f;
+
+    if (argc < 3) {
+        usage();
+        return 1;
+    }
+
+    if (!strcmp(argv[1], "union") || !strcmp(argv[1], "inter") ||
+        !strcmp(argv[1], "diff")) {
+        if (argc != 5) {
+            usage();
+            return 1;
+        }
+
+        cmd_setop(argv[1], argv[2], argv[3], argv[4]);
+        return 0;
+    }
+
+    f = store_open(argv[2]);
+
+    if (!strcmp(argv[1], "info") && (argc == 3)) {
+        cmd_info(f);
+    } else if (!strcmp(argv[1], "dump") && (argc == 3)) {
+        cmd_dump(f);
+    } else if (!strcmp(argv[1], "hosts") && (argc == 4)) {
+        cmd_hosts(f, argv[3]);
+    } else {
+        usage();
+        return 1;
+    }
+
+    store_close(f);
+
+    return 0;
+}
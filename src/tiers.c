@@ -0,0 +1,161 @@
+/*
+ * Scriptable, asynchronous network packet generator/analyzer.
+ *
+ * Copyright (c) 2015, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tiers.h"
+#include "printf.h"
+#include "util.h"
+
+/* tiers are made of the ports ranked below each of these limits */
+static const size_t tier_limits[TIERS_MAX - 1] = { 10, 100, 1000 };
+
+/* the most common open TCP ports, most popular first */
+const uint16_t tiers_default_rank[] = {
+    80, 23, 443, 21, 22, 25, 3389, 110, 445, 139,
+    143, 53, 135, 3306, 8080, 1723, 111, 995, 993, 5900,
+    1025, 587, 8888, 199, 1720, 465, 548, 113, 81, 6001,
+    10000, 514, 5060, 179, 1026, 2000, 8443, 8000, 32768, 554,
+    26, 1433, 49152, 2001, 515, 8008, 49154, 1027, 5666, 646,
+    5000, 5631, 631, 49153, 8081, 2049, 88, 79, 5800, 106,
+    2121, 1110, 49155, 6000, 513, 990, 5357, 427, 49156, 543,
+    544, 5101, 144, 7, 389, 8009, 3128, 444, 9999, 5009,
+    7070, 5190, 3000, 5432, 1900, 3986, 13, 1029, 9, 5051,
+    6646, 49157, 1028, 873, 1755, 2717, 4899, 9100, 119, 37,
+};
+
+const size_t tiers_default_rank_cnt = sizeof(tiers_default_rank) /
+                                      sizeof(*tiers_default_rank);
+
+static size_t rank_tier(uint32_t rank) {
+    size_t i;
+
+    for (i = 0; i < TIERS_MAX - 1; i++) {
+        if (rank < tier_limits[i])
+            break;
+    }
+
+    return i;
+}
+
+/*
+ * Split the given ports in tiers according to their position in the ranking.
+ * Within a tier, the ports keep the order they were given in. Empty tiers are
+ * skipped.
+ */
+void tiers_build(struct port_tiers *t, const uint16_t *ports, size_t cnt,
+                 const uint16_t *rank, size_t rank_cnt) {
+    size_t tier_cnt[TIERS_MAX] = { 0 };
+    size_t tier_off[TIERS_MAX];
+
+    _free_ uint8_t *tier = malloc(65536);
+    if (tier == NULL)
+        fail_printf("OOM");
+
+    memset(tier, TIERS_MAX - 1, 65536);
+
+    /* only the first occurrence of a port in the ranking counts */
+    for (size_t i = rank_cnt; i > 0; i--)
+        tier[rank[i - 1]] = rank_tier(i - 1);
+
+    for (size_t i = 0; i < cnt; i++)
+        tier_cnt[tier[ports[i]]]++;
+
+    t->ports = malloc((cnt + 1) * sizeof(*t->ports));
+    if (t->ports == NULL)
+        fail_printf("OOM");
+
+    t->cnt      = cnt;
+    t->tier_cnt = 0;
+
+    for (size_t i = 0, off = 0; i < TIERS_MAX; i++) {
+        tier_off[i] = off;
+        off += tier_cnt[i];
+
+        if (tier_cnt[i])
+            t->tier_end[t->tier_cnt++] = off;
+    }
+
+    for (size_t i = 0; i < cnt; i++)
+        t->ports[tier_off[tier[ports[i]]]++] = ports[i];
+}
+
+void tiers_free(struct port_tiers *t) {
+    freep(&t->ports);
+}
+
+/*
+ * Load a port ranking from a file containing one port per line, most popular
+ * first. Empty lines and the ones starting with '#' are skipped.
+ */
+size_t tiers_load_rank(const char *path, uint16_t **rank) {
+    char  *line = NULL;
+    size_t size = 0, cnt = 0, cap = 0;
+
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        sysf_printf("fopen(%s)", path);
+
+    *rank = NULL;
+
+    while (getline(&line, &size, f) > 0) {
+        char *p = line, *end;
+        unsigned long port;
+
+        while (isspace(*p))
+            p++;
+
+        if ((*p == '\0') || (*p == '#'))
+            continue;
+
+        port = strtoul(p, &end, 10);
+        if ((end == p) || (port > 65535))
+            fail_printf("Invalid port in %s: %s", path, line);
+
+        if (cnt == cap) {
+            cap = cap ? cap * 2 : 256;
+
+            *rank = realloc(*rank, cap * sizeof(**rank));
+            if (*rank == NULL)
+                fail_printf("OOM");
+        }
+
+        (*rank)[cnt++] = port;
+    }
+
+    free(line);
+    fclose(f);
+
+    return cnt;
+}
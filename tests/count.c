@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "clar/clar.h"
+
+#include "count.h"
+
+static uint64_t get_count(struct count_table *t, const char *key) {
+    for (size_t i = 0; i <= t->mask; i++) {
+        struct count_entry *e = &t->entries[i];
+
+        if (e->count && (e->len == strlen(key)) &&
+            !memcmp(e->key, key, e->len))
+            return e->count;
+    }
+
+    return 0;
+}
+
+void test_count__simple(void) {
+    struct count_table *t = count_new(64);
+
+    count_add(t, "port 80", 7, 1);
+    count_add(t, "port 443", 8, 1);
+    count_add(t, "port 443", 8, 2);
+
+    cl_assert_equal_i(get_count(t, "port 80"), 1);
+    cl_assert_equal_i(get_count(t, "port 443"), 3);
+    cl_assert_equal_i(get_count(t, "port 22"), 0);
+    cl_assert_equal_i(t->evicted, 0);
+
+    count_free(t);
+}
+
+void test_count__heavy_hitters(void) {
+    char key[32];
+
+    struct count_table *t = count_new(64);
+
+    for (int i = 0; i < 10000; i++) {
+        /* a few frequent keys mixed with lots of unique ones */
+        count_add(t, "hot a", 5, 1);
+        count_add(t, "hot b", 5, 1);
+
+        snprintf(key, sizeof(key), "cold %d", i);
+        count_add(t, key, strlen(key), 1);
+    }
+
+    cl_assert(t->evicted > 0);
+
+    cl_assert(get_count(t, "hot a") >= 10000);
+    cl_assert(get_count(t, "hot b") >= 10000);
+
+    count_free(t);
+}
+
+void test_count__merge(void) {
+    struct count_table *a = count_new(64);
+    struct count_table *b = count_new(64);
+    struct count_table *m = count_new(128);
+
+    count_add(a, "x", 1, 2);
+    count_add(b, "x", 1, 3);
+    count_add(b, "y", 1, 1);
+
+    count_merge(m, a);
+    count_merge(m, b);
+
+    cl_assert_equal_i(get_count(m, "x"), 5);
+    cl_assert_equal_i(get_count(m, "y"), 1);
+
+    count_free(a);
+    count_free(b);
+    count_free(m);
+}
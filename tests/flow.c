@@ -0,0 +1,202 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clar/clar.h"
+
+#include "flow.h"
+
+static struct flow_key make_key(uint32_t n) {
+    struct flow_key key;
+
+    memset(&key, 0, sizeof(key));
+
+    key.raddr = 0x0a000000 | n;
+    key.laddr = 0x0a000001;
+    key.rport = 80;
+    key.lport = 1024 + (n & 0xff);
+    key.proto = 6;
+
+    return key;
+}
+
+/* the slot the key hashes to, found by inserting it into an empty table */
+static size_t key_slot(size_t max, struct flow_key *key) {
+    struct flow_table t;
+    size_t slot;
+
+    flow_table_init(&t, max);
+    slot = flow_insert(&t, key) - t.flows;
+    flow_table_free(&t);
+
+    return slot;
+}
+
+/* find the next key after the n-th one that hashes to slot */
+static struct flow_key find_key(size_t max, size_t slot, uint32_t *n) {
+    struct flow_key key;
+
+    do {
+        key = make_key(++*n);
+    } while (key_slot(max, &key) != slot);
+
+    return key;
+}
+
+void test_flow__insert(void) {
+    struct flow_table t;
+    struct flow_key key;
+
+    flow_table_init(&t, 64);
+
+    for (uint32_t n = 0; n < 64; n++) {
+        key = make_key(n);
+        cl_assert(flow_lookup(&t, &key) == NULL);
+        cl_assert(flow_insert(&t, &key) != NULL);
+    }
+
+    cl_assert_equal_i(t.count, 64);
+
+    /* the table is full */
+    key = make_key(64);
+    cl_assert(flow_insert(&t, &key) == NULL);
+
+    for (uint32_t n = 0; n < 64; n++) {
+        key = make_key(n);
+
+        struct flow *f = flow_lookup(&t, &key);
+        cl_assert(f != NULL);
+        cl_assert(!memcmp(&f->key, &key, sizeof(key)));
+        cl_assert_equal_i(f->ref, -1);
+    }
+
+    key = make_key(64);
+    cl_assert(flow_lookup(&t, &key) == NULL);
+
+    flow_table_free(&t);
+}
+
+void test_flow__remove_wrap(void) {
+    struct flow_table t;
+    struct flow_key a, b, c, d;
+    uint32_t n = 0;
+
+    flow_table_init(&t, 4);
+
+    /* a, b and c collide on the last slot, d hashes to the first one */
+    a = find_key(4, t.size - 1, &n);
+    b = find_key(4, t.size - 1, &n);
+    c = find_key(4, t.size - 1, &n);
+    d = find_key(4, 0, &n);
+
+    cl_assert_equal_i(flow_insert(&t, &a) - t.flows, t.size - 1);
+    cl_assert_equal_i(flow_insert(&t, &b) - t.flows, 0);
+    cl_assert_equal_i(flow_insert(&t, &c) - t.flows, 1);
+    cl_assert_equal_i(flow_insert(&t, &d) - t.flows, 2);
+
+    /* b and c shift back across the wrap, d towards its own slot */
+    flow_remove(&t, flow_lookup(&t, &a));
+
+    cl_assert(flow_lookup(&t, &a) == NULL);
+    cl_assert_equal_i(flow_lookup(&t, &b) - t.flows, t.size - 1);
+    cl_assert_equal_i(flow_lookup(&t, &c) - t.flows, 0);
+    cl_assert_equal_i(flow_lookup(&t, &d) - t.flows, 1);
+    cl_assert(!t.flows[2].used);
+
+    /* b stays in its own slot, d moves back to its own one */
+    flow_remove(&t, flow_lookup(&t, &c));
+
+    cl_assert_equal_i(flow_lookup(&t, &b) - t.flows, t.size - 1);
+    cl_assert_equal_i(flow_lookup(&t, &d) - t.flows, 0);
+    cl_assert(!t.flows[1].used);
+
+    flow_remove(&t, flow_lookup(&t, &b));
+    flow_remove(&t, flow_lookup(&t, &d));
+
+    cl_assert_equal_i(t.count, 0);
+
+    for (size_t i = 0; i < t.size; i++)
+        cl_assert(!t.flows[i].used);
+
+    flow_table_free(&t);
+}
+
+void test_flow__remove_random(void) {
+    struct flow_table t;
+    bool in[256] = { false };
+
+    flow_table_init(&t, 128);
+
+    srand(42);
+
+    for (unsigned i = 0; i < 100000; i++) {
+        uint32_t n = rand() % 256;
+        struct flow_key key = make_key(n);
+        struct flow *f = flow_lookup(&t, &key);
+
+        cl_assert_equal_i(f != NULL, in[n]);
+
+        if (f) {
+            flow_remove(&t, f);
+            in[n] = false;
+        } else if (flow_insert(&t, &key)) {
+            in[n] = true;
+        }
+    }
+
+    for (uint32_t n = 0; n < 256; n++) {
+        struct flow_key key = make_key(n);
+
+        cl_assert_equal_i(flow_lookup(&t, &key) != NULL, in[n]);
+    }
+
+    flow_table_free(&t);
+}
+
+void test_flow__expired(void) {
+    struct flow_table t;
+    struct flow_key key, keys[4];
+    size_t n;
+
+    flow_table_init(&t, 16);
+
+    for (uint32_t i = 0; i < 8; i++) {
+        key = make_key(i);
+        flow_insert(&t, &key)->deadline = 100 * (i + 1);
+    }
+
+    cl_assert_equal_i(flow_expired(&t, 50, keys, 4), 0);
+
+    n = flow_expired(&t, 300, keys, 4);
+    cl_assert_equal_i(n, 3);
+
+    for (size_t i = 0; i < n; i++)
+        cl_assert(flow_lookup(&t, &keys[i])->deadline <= 300);
+
+    /* no more than max keys are returned */
+    cl_assert_equal_i(flow_expired(&t, 1000, keys, 4), 4);
+
+    flow_table_free(&t);
+}
+
+void test_flow__pool(void) {
+    struct flow_table t;
+
+    flow_table_init(&t, 4);
+
+    cl_assert_equal_i(flow_pool_get(&t), -1);
+
+    for (int ref = 1; ref <= 4; ref++)
+        cl_assert(flow_pool_put(&t, ref));
+
+    /* the pool holds at most one ref per flow */
+    cl_assert(!flow_pool_put(&t, 5));
+
+    for (int ref = 4; ref >= 1; ref--)
+        cl_assert_equal_i(flow_pool_get(&t), ref);
+
+    cl_assert_equal_i(flow_pool_get(&t), -1);
+
+    flow_table_free(&t);
+}
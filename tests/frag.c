@@ -0,0 +1,162 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <arpa/inet.h>
+
+#include "clar/clar.h"
+
+#include "queue.h"
+#include "pkt.h"
+#include "frag.h"
+
+static uint8_t payload[3000];
+
+/* build a frame with the [off, off + len) bytes of payload */
+static size_t build_frag(uint8_t *frame, uint16_t id, size_t off, size_t len,
+                         bool mf) {
+    struct eth_hdr *eth = (struct eth_hdr *) frame;
+    struct ip4_hdr *ip4 = (struct ip4_hdr *) (frame + 14);
+
+    memset(frame, 0, 14 + 20);
+
+    eth->type = htons(ETHERTYPE_IP);
+
+    ip4->version  = 4;
+    ip4->ihl      = 5;
+    ip4->len      = htons(20 + len);
+    ip4->id       = htons(id);
+    ip4->frag_off = htons((off / 8) | (mf ? 0x2000 : 0));
+    ip4->ttl      = 64;
+    ip4->proto    = PROTO_UDP;
+    ip4->src      = htonl(0x0a000001);
+    ip4->dst      = htonl(0x0a000002);
+
+    memcpy(frame + 14 + 20, payload + off, len);
+
+    return 14 + 20 + len;
+}
+
+static void check_datagram(const uint8_t *out, size_t out_len, size_t len) {
+    const struct ip4_hdr *ip4 = (const struct ip4_hdr *) (out + 14);
+
+    cl_assert_equal_i(out_len, 14 + 20 + len);
+    cl_assert_equal_i(ntohs(ip4->len), 20 + len);
+    cl_assert_equal_i(ip4->frag_off, 0);
+    cl_assert_equal_i(pkt_chksum((uint8_t *) ip4, 20, 0), 0);
+    cl_assert(!memcmp(out + 14 + 20, payload, len));
+}
+
+void test_frag__initialize(void) {
+    for (size_t i = 0; i < sizeof(payload); i++)
+        payload[i] = i * 7;
+}
+
+void test_frag__in_order(void) {
+    uint8_t frame[2048];
+    const uint8_t *out;
+    size_t len, out_len;
+
+    struct frag_table t;
+    frag_table_init(&t, 4, 1000);
+
+    len = build_frag(frame, 1, 0, 1480, true);
+    cl_assert(frag_is_fragment(frame, len));
+    cl_assert_equal_i(frag_add(&t, frame, len, 0, &out, &out_len), 0);
+
+    len = build_frag(frame, 1, 1480, 1480, true);
+    cl_assert_equal_i(frag_add(&t, frame, len, 0, &out, &out_len), 0);
+
+    len = build_frag(frame, 1, 2960, 40, false);
+    cl_assert(frag_is_fragment(frame, len));
+    cl_assert_equal_i(frag_add(&t, frame, len, 0, &out, &out_len), 1);
+
+    check_datagram(out, out_len, 3000);
+
+    cl_assert_equal_i(t.frags, 3);
+    cl_assert_equal_i(t.done, 1);
+    cl_assert_equal_i(t.dropped, 0);
+
+    frag_table_free(&t);
+}
+
+void test_frag__out_of_order(void) {
+    uint8_t frame[2048];
+    const uint8_t *out;
+    size_t len, out_len;
+
+    struct frag_table t;
+    frag_table_init(&t, 4, 1000);
+
+    /* last fragment first, then overlapping and duplicate fragments */
+    len = build_frag(frame, 2, 2400, 600, false);
+    cl_assert_equal_i(frag_add(&t, frame, len, 0, &out, &out_len), 0);
+
+    len = build_frag(frame, 2, 800, 1000, true);
+    cl_assert_equal_i(frag_add(&t, frame, len, 0, &out, &out_len), 0);
+
+    len = build_frag(frame, 2, 1600, 1000, true);
+    cl_assert_equal_i(frag_add(&t, frame, len, 0, &out, &out_len), 0);
+
+    len = build_frag(frame, 2, 800, 1000, true);
+    cl_assert_equal_i(frag_add(&t, frame, len, 0, &out, &out_len), 0);
+
+    len = build_frag(frame, 2, 0, 800, true);
+    cl_assert_equal_i(frag_add(&t, frame, len, 0, &out, &out_len), 1);
+
+    check_datagram(out, out_len, 3000);
+
+    frag_table_free(&t);
+}
+
+void test_frag__timeout(void) {
+    uint8_t frame[2048];
+    const uint8_t *out;
+    size_t len, out_len;
+
+    struct frag_table t;
+    frag_table_init(&t, 4, 1000);
+
+    len = build_frag(frame, 3, 0, 800, true);
+    cl_assert_equal_i(frag_add(&t, frame, len, 0, &out, &out_len), 0);
+
+    /* the first fragment expired, so the datagram can't be completed */
+    len = build_frag(frame, 3, 800, 800, false);
+    cl_assert_equal_i(frag_add(&t, frame, len, 2000, &out, &out_len), 0);
+
+    cl_assert_equal_i(t.dropped, 1);
+    cl_assert_equal_i(t.done, 0);
+
+    frag_table_free(&t);
+}
+
+void test_frag__full(void) {
+    uint8_t frame[2048];
+    const uint8_t *out;
+    size_t len, out_len;
+
+    struct frag_table t;
+    frag_table_init(&t, 4, 1000);
+
+    for (uint16_t id = 10; id < 15; id++) {
+        len = build_frag(frame, id, 0, 800, true);
+        cl_assert_equal_i(frag_add(&t, frame, len, id, &out, &out_len), 0);
+    }
+
+    /* the oldest datagram has been evicted */
+    cl_assert_equal_i(t.dropped, 1);
+
+    len = build_frag(frame, 10, 800, 800, false);
+    cl_assert_equal_i(frag_add(&t, frame, len, 20, &out, &out_len), 0);
+
+    len = build_frag(frame, 14, 800, 800, false);
+    cl_assert_equal_i(frag_add(&t, frame, len, 20, &out, &out_len), 1);
+
+    check_datagram(out, out_len, 1600);
+
+    /* invalid fragments are dropped */
+    len = build_frag(frame, 20, 0, 801, true);
+    cl_assert_equal_i(frag_add(&t, frame, len, 20, &out, &out_len), -1);
+
+    frag_table_free(&t);
+}
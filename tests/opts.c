@@ -0,0 +1,154 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "clar/clar.h"
+
+#include "queue.h"
+#include "pkt.h"
+
+/* MSS, SACK permitted, timestamps, NOP, window scale (Linux SYN) */
+static const uint8_t syn_opts[] = {
+    0x02, 0x04, 0x05, 0xb4, 0x04, 0x02, 0x08, 0x0a,
+    0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,
+    0x01, 0x03, 0x03, 0x07,
+};
+
+void test_opts__parse(void) {
+    size_t len;
+    const uint8_t *data;
+    struct pkt_opts o;
+
+    cl_assert_equal_i(pkt_opts_parse(&o, syn_opts, sizeof(syn_opts)), 0);
+
+    cl_assert_equal_i(o.cnt, 5);
+    cl_assert_equal_i(o.opt[0].kind, OPT_MSS);
+    cl_assert_equal_i(o.opt[1].kind, OPT_SACK_PERM);
+    cl_assert_equal_i(o.opt[2].kind, OPT_TS);
+    cl_assert_equal_i(o.opt[3].kind, OPT_NOP);
+    cl_assert_equal_i(o.opt[4].kind, OPT_WSCALE);
+
+    data = pkt_opts_find(&o, OPT_MSS, &len);
+    cl_assert(data != NULL);
+    cl_assert_equal_i(len, 2);
+    cl_assert_equal_i((data[0] << 8) | data[1], 1460);
+
+    data = pkt_opts_find(&o, OPT_WSCALE, &len);
+    cl_assert(data != NULL);
+    cl_assert_equal_i(len, 1);
+    cl_assert_equal_i(data[0], 7);
+
+    cl_assert(pkt_opts_find(&o, OPT_SACK, &len) == NULL);
+}
+
+void test_opts__malformed(void) {
+    struct pkt_opts o;
+
+    /* the MSS option claims to be longer than the options */
+    const uint8_t bad[] = { 0x01, 0x02, 0x08, 0x05, 0xb4, 0x00 };
+
+    cl_assert_equal_i(pkt_opts_parse(&o, bad, sizeof(bad)), 0);
+    cl_assert_equal_i(o.cnt, 1);
+    cl_assert_equal_i(o.len, sizeof(bad));
+
+    /* zero length options would loop forever */
+    const uint8_t zero[] = { 0x02, 0x00, 0x00, 0x00 };
+
+    cl_assert_equal_i(pkt_opts_parse(&o, zero, sizeof(zero)), 0);
+    cl_assert_equal_i(o.cnt, 0);
+
+    uint8_t big[OPT_MAX_LEN + 1] = { 0 };
+    cl_assert_equal_i(pkt_opts_parse(&o, big, sizeof(big)), -1);
+}
+
+void test_opts__build(void) {
+    size_t len;
+    uint8_t buf[OPT_MAX_LEN];
+    struct pkt_opts o;
+
+    const uint8_t mss[] = { 0x05, 0xb4 };
+    const uint8_t ws[]  = { 0x07 };
+    const uint8_t mss2[] = { 0x02, 0x18 };
+
+    memset(&o, 0, sizeof(o));
+
+    cl_assert_equal_i(pkt_opts_set(&o, OPT_MSS, mss, sizeof(mss)), 0);
+    cl_assert_equal_i(pkt_opts_set(&o, OPT_WSCALE, ws, sizeof(ws)), 0);
+    cl_assert_equal_i(pkt_opts_set(&o, OPT_SACK_PERM, NULL, 0), 0);
+
+    cl_assert_equal_i(o.len, 9);
+    cl_assert_equal_i(pkt_opts_size(&o), 12);
+
+    cl_assert_equal_i(pkt_opts_pack(&o, buf), 12);
+    cl_assert(!memcmp(buf, "\x02\x04\x05\xb4\x03\x03\x07\x04\x02\x00\x00\x00",
+                      12));
+
+    /* same size options are rewritten in place */
+    cl_assert_equal_i(pkt_opts_set(&o, OPT_MSS, mss2, sizeof(mss2)), 0);
+    cl_assert_equal_i(o.opt[0].kind, OPT_MSS);
+    cl_assert_equal_i(o.len, 9);
+
+    cl_assert_equal_i(pkt_opts_del(&o, OPT_WSCALE), 0);
+    cl_assert_equal_i(o.cnt, 2);
+    cl_assert_equal_i(o.len, 6);
+    cl_assert_equal_i(o.opt[1].kind, OPT_SACK_PERM);
+    cl_assert_equal_i(o.opt[1].off, 4);
+
+    cl_assert(pkt_opts_find(&o, OPT_MSS, &len) != NULL);
+    cl_assert_equal_i(pkt_opts_del(&o, OPT_WSCALE), -1);
+}
+
+void test_opts__build_after_eol(void) {
+    struct pkt_opts o;
+
+    const uint8_t eol[] = { 0x02, 0x04, 0x05, 0xb4, 0x00, 0x00, 0x00, 0x00 };
+    const uint8_t ws[]  = { 0x07 };
+
+    cl_assert_equal_i(pkt_opts_parse(&o, eol, sizeof(eol)), 0);
+    cl_assert_equal_i(o.cnt, 2);
+
+    /* the end of list and its padding are dropped */
+    cl_assert_equal_i(pkt_opts_set(&o, OPT_WSCALE, ws, sizeof(ws)), 0);
+    cl_assert_equal_i(o.cnt, 2);
+    cl_assert_equal_i(o.len, 7);
+    cl_assert_equal_i(o.opt[1].kind, OPT_WSCALE);
+    cl_assert_equal_i(o.opt[1].off, 4);
+}
+
+void test_opts__full(void) {
+    struct pkt_opts o;
+    uint8_t data[OPT_MAX_LEN];
+
+    memset(&o, 0, sizeof(o));
+    memset(data, 0, sizeof(data));
+
+    cl_assert_equal_i(pkt_opts_set(&o, OPT_SACK, data, 38), 0);
+    cl_assert_equal_i(pkt_opts_set(&o, OPT_SACK_PERM, NULL, 0), -1);
+}
+
+void test_opts__truncate(void) {
+    uint8_t buf[20 + sizeof(syn_opts)] = { 0 };
+    struct pkt p;
+
+    memset(&p, 0, sizeof(p));
+
+    /* a SYN-ACK with the Linux SYN options, as received */
+    buf[12] = (5 + sizeof(syn_opts) / 4) << 4;
+    buf[13] = 0x12;
+    memcpy(buf + 20, syn_opts, sizeof(syn_opts));
+
+    pkt_unpack_tcp(&p, buf, sizeof(buf));
+    cl_assert_equal_i(p.p.tcp.doff, 10);
+    cl_assert_equal_i(pkt_opts_size(&p.p.tcp.opts), 20);
+
+    /* doff = 7 keeps MSS and SACK permitted, the timestamps are cut */
+    pkt_opts_truncate(&p.p.tcp.opts, 8);
+    cl_assert_equal_i(p.p.tcp.opts.cnt, 2);
+    cl_assert_equal_i(p.p.tcp.opts.len, 6);
+    cl_assert_equal_i(pkt_opts_size(&p.p.tcp.opts), 8);
+
+    /* doff = 5 drops all of them */
+    pkt_opts_truncate(&p.p.tcp.opts, 0);
+    cl_assert_equal_i(p.p.tcp.opts.cnt, 0);
+    cl_assert_equal_i(pkt_opts_size(&p.p.tcp.opts), 0);
+}
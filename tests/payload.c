@@ -0,0 +1,90 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+
+#include "clar/clar.h"
+
+#include "queue.h"
+#include "pkt.h"
+#include "payload.h"
+
+static char path[] = "/tmp/pktizr_payload_XXXXXX";
+
+void test_payload__initialize(void) {
+    int fd = mkstemp(path);
+    cl_assert(fd >= 0);
+    close(fd);
+}
+
+void test_payload__cleanup(void) {
+    unlink(path);
+    strcpy(path, "/tmp/pktizr_payload_XXXXXX");
+}
+
+void test_payload__simple(void) {
+    size_t len;
+    uint16_t csum;
+    const uint8_t *buf;
+
+    struct payload_db *db = payload_new();
+
+    cl_assert_equal_i(payload_add(db, 53, 53, (uint8_t *) "dns", 3), 0);
+    cl_assert_equal_i(payload_add(db, 161, 162, (uint8_t *) "snmp", 4), 0);
+    cl_assert_equal_i(payload_add(db, 53, 53, (uint8_t *) "dns2", 4), 0);
+
+    cl_assert_equal_i(payload_add(db, 1, 1, (uint8_t *) "", 0), -1);
+    cl_assert_equal_i(payload_add(db, 2, 1, (uint8_t *) "x", 1), -1);
+
+    cl_assert_equal_i(payload_save(db, path), 0);
+    payload_free(db);
+
+    db = payload_open(path);
+
+    cl_assert_equal_i(db->hdr->count, 3);
+
+    buf = payload_get(db, 53, &len, &csum);
+    cl_assert(buf != NULL);
+    cl_assert_equal_i(len, 4);
+    cl_assert(!memcmp(buf, "dns2", 4));
+
+    buf = payload_get(db, 162, &len, &csum);
+    cl_assert(buf != NULL);
+    cl_assert(!memcmp(buf, "snmp", 4));
+
+    cl_assert(payload_get(db, 160, &len, &csum) == NULL);
+    cl_assert(payload_get(db, 0, &len, &csum) == NULL);
+    cl_assert(payload_get(db, 65535, &len, &csum) == NULL);
+
+    payload_free(db);
+}
+
+void test_payload__chksum(void) {
+    size_t len;
+    uint16_t csum;
+    const uint8_t *buf;
+
+    uint8_t udp[8 + 5] = "\x12\x34\x00\x35\x00\x0d\x00\x00";
+    uint8_t data[5]    = "\xde\xad\xbe\xef\x01";
+
+    struct payload_db *db = payload_new();
+
+    cl_assert_equal_i(payload_add(db, 53, 53, data, sizeof(data)), 0);
+    cl_assert_equal_i(payload_save(db, path), 0);
+    payload_free(db);
+
+    db = payload_open(path);
+
+    buf = payload_get(db, 53, &len, &csum);
+    cl_assert(buf != NULL);
+
+    memcpy(udp + 8, buf, len);
+
+    /* the precomputed sum must give the same checksum as the whole datagram */
+    cl_assert_equal_i(pkt_chksum(udp, 8, 0x1234 + csum),
+                      pkt_chksum(udp, sizeof(udp), 0x1234));
+
+    payload_free(db);
+}
@@ -0,0 +1,110 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+#include <pthread.h>
+
+#include "clar/clar.h"
+
+#include "ring.h"
+
+static char path[] = "/tmp/pktizr_ring_XXXXXX";
+
+void test_ring__initialize(void) {
+    int fd = mkstemp(path);
+    cl_assert(fd >= 0);
+    close(fd);
+}
+
+void test_ring__cleanup(void) {
+    unlink(path);
+    strcpy(path, "/tmp/pktizr_ring_XXXXXX");
+}
+
+void test_ring__simple(void) {
+    struct ring_rec *rec;
+    const struct ring_rec *out;
+
+    struct ring *w = ring_create(path, 4);
+    struct ring *r = ring_open(path);
+
+    cl_assert(ring_peek(r) == NULL);
+    cl_assert(!ring_done(r));
+
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 4; i++) {
+            rec = ring_reserve(w);
+            cl_assert(rec != NULL);
+
+            rec->port = round * 4 + i;
+            ring_commit(w);
+        }
+
+        /* the ring is full, further records are dropped */
+        cl_assert(ring_reserve(w) == NULL);
+
+        for (int i = 0; i < 4; i++) {
+            out = ring_peek(r);
+            cl_assert(out != NULL);
+            cl_assert_equal_i(out->port, round * 4 + i);
+
+            ring_consume(r);
+        }
+
+        cl_assert(ring_peek(r) == NULL);
+    }
+
+    cl_assert_equal_i(w->hdr->dropped, 3);
+
+    ring_finish(w);
+    cl_assert(ring_done(r));
+
+    ring_close(r);
+    ring_close(w);
+}
+
+static void *producer(void *p) {
+    struct ring *w = p;
+
+    for (uint64_t i = 0; i < 100000; i++) {
+        struct ring_rec *rec;
+
+        while ((rec = ring_reserve(w)) == NULL)
+            w->hdr->dropped = 0;
+
+        rec->time = i;
+        ring_commit(w);
+    }
+
+    ring_finish(w);
+
+    return NULL;
+}
+
+void test_ring__concurrent(void) {
+    pthread_t thread;
+    uint64_t next = 0;
+
+    struct ring *w = ring_create(path, 64);
+    struct ring *r = ring_open(path);
+
+    pthread_create(&thread, NULL, producer, w);
+
+    while (!ring_done(r)) {
+        const struct ring_rec *out = ring_peek(r);
+        if (out == NULL)
+            continue;
+
+        cl_assert_equal_i(out->time, next++);
+        ring_consume(r);
+    }
+
+    pthread_join(thread, NULL);
+
+    cl_assert_equal_i(next, 100000);
+
+    ring_close(r);
+    ring_close(w);
+}
@@ -0,0 +1,80 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "clar/clar.h"
+
+#include "rtt.h"
+
+void test_rtt__match(void) {
+    uint32_t addr;
+    size_t sampled = 0;
+
+    struct rtt r;
+    rtt_init(&r, 1024);
+
+    for (addr = 1; addr <= 1000; addr++)
+        rtt_sent(&r, addr, 80, 1000000);
+
+    for (addr = 1; addr <= 1000; addr++) {
+        uint64_t samples = r.samples;
+
+        rtt_recv(&r, addr, 80, 1000000 + 300);
+
+        /* duplicate replies are ignored */
+        rtt_recv(&r, addr, 80, 1000000 + 900);
+
+        sampled += r.samples - samples;
+    }
+
+    /* roughly 1 in 16 addresses is sampled */
+    cl_assert(sampled > 20);
+    cl_assert(sampled < 150);
+    cl_assert_equal_i(r.samples, sampled);
+
+    /* all samples fall in the [256, 512) bucket */
+    cl_assert_equal_i(r.hist[8], sampled);
+
+    rtt_free(&r);
+}
+
+void test_rtt__ports(void) {
+    uint16_t port;
+
+    struct rtt r;
+    rtt_init(&r, 1024);
+
+    /* probes to the other ports don't overwrite the send time of each port */
+    for (port = 1; port <= 1000; port++)
+        rtt_sent(&r, 1, port, 1000000 + port * 1000);
+
+    for (port = 1; port <= 1000; port++)
+        rtt_recv(&r, 1, port, 1000000 + port * 1000 + 300);
+
+    /* replies from another port don't match */
+    rtt_sent(&r, 1, 53, 1000000);
+    rtt_recv(&r, 1, 0, 1000000 + 5000);
+
+    cl_assert(r.samples > 20);
+    cl_assert_equal_i(r.hist[8], r.samples);
+
+    rtt_free(&r);
+}
+
+void test_rtt__cdf(void) {
+    struct rtt r;
+    rtt_init(&r, 16);
+
+    cl_assert(rtt_cdf(&r, 1000) == 0);
+
+    r.hist[8]  = 10;
+    r.hist[10] = 10;
+    r.samples  = 20;
+
+    cl_assert(rtt_cdf(&r, 100) == 0);
+    cl_assert(rtt_cdf(&r, 512) == 0.5);
+    cl_assert(rtt_cdf(&r, 1536) == 0.75);
+    cl_assert(rtt_cdf(&r, 2048) == 1);
+    cl_assert(rtt_cdf(&r, 1000000) == 1);
+
+    rtt_free(&r);
+}
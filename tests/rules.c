@@ -0,0 +1,242 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <arpa/inet.h>
+
+#include "clar/clar.h"
+
+#include "queue.h"
+#include "pkt.h"
+#include "rules.h"
+
+#define SEED 0x1234
+
+static const struct rule any_rule = {
+    .icmp_type = -1,
+    .icmp_code = -1,
+    .sport     = -1,
+    .dport     = -1,
+};
+
+static size_t build_tcp(uint8_t *frame, uint8_t flags, uint32_t ack_seq) {
+    uint32_t src = htonl(0x0a000002), dst = htonl(0x0a000001);
+    uint16_t sport = htons(80), dport = htons(64434);
+
+    ack_seq = htonl(ack_seq);
+
+    memset(frame, 0, 14 + 40);
+
+    frame[12] = 0x08;
+
+    frame[14 + 0] = 0x45;
+    frame[14 + 8] = 57;
+    frame[14 + 9] = PROTO_TCP;
+    memcpy(frame + 14 + 12, &src, 4);
+    memcpy(frame + 14 + 16, &dst, 4);
+
+    memcpy(frame + 34, &sport, 2);
+    memcpy(frame + 36, &dport, 2);
+    memcpy(frame + 42, &ack_seq, 4);
+    frame[46] = 5 << 4;
+    frame[47] = flags;
+
+    return 14 + 40;
+}
+
+static uint32_t probe_cookie(void) {
+    return pkt_cookie(htonl(0x0a000001), htonl(0x0a000002), 64434, 80, SEED);
+}
+
+void test_rules__flags(void) {
+    uint8_t flags, mask;
+
+    cl_assert_equal_i(rules_parse_flags("SA", &flags, &mask), 0);
+    cl_assert_equal_i(flags, RULE_SYN | RULE_ACK);
+    cl_assert_equal_i(mask, RULE_SYN | RULE_ACK);
+
+    cl_assert_equal_i(rules_parse_flags("A/AR", &flags, &mask), 0);
+    cl_assert_equal_i(flags, RULE_ACK);
+    cl_assert_equal_i(mask, RULE_ACK | RULE_RST);
+
+    cl_assert_equal_i(rules_parse_flags("SA/A", &flags, &mask), -1);
+    cl_assert_equal_i(rules_parse_flags("X", &flags, &mask), -1);
+    cl_assert_equal_i(rules_parse_flags("S/S/S", &flags, &mask), -1);
+}
+
+void test_rules__match(void) {
+    uint8_t frame[64];
+    size_t len;
+    struct rule r;
+    struct rule_pkt p;
+    struct rule_table t;
+
+    rules_init(&t);
+
+    /* open */
+    r = any_rule;
+    r.proto = PROTO_TCP;
+    r.cookie = true;
+    rules_parse_flags("SA/SAR", &r.flags, &r.flags_mask);
+    cl_assert_equal_i(rules_add(&t, &r), 0);
+
+    /* closed */
+    r = any_rule;
+    r.proto = PROTO_TCP;
+    r.actions = RULE_DROP;
+    rules_parse_flags("R", &r.flags, &r.flags_mask);
+    cl_assert_equal_i(rules_add(&t, &r), 0);
+
+    /* anything else from port 80 */
+    r = any_rule;
+    r.proto = PROTO_TCP;
+    r.sport = 80;
+    cl_assert_equal_i(rules_add(&t, &r), 0);
+
+    /* cookies are only checked for TCP */
+    r = any_rule;
+    r.proto = PROTO_UDP;
+    r.cookie = true;
+    cl_assert_equal_i(rules_add(&t, &r), -1);
+
+    rules_compile(&t);
+
+    len = build_tcp(frame, RULE_SYN | RULE_ACK, probe_cookie() + 1);
+    cl_assert_equal_i(rules_parse(frame, len, &p), 0);
+    cl_assert_equal_i(p.sport, 80);
+    cl_assert_equal_i(p.dport, 64434);
+    cl_assert(rules_match(&t, &p, SEED) == &t.rules[0]);
+
+    /* the first matching rule wins */
+    len = build_tcp(frame, RULE_RST | RULE_ACK, probe_cookie() + 1);
+    cl_assert_equal_i(rules_parse(frame, len, &p), 0);
+    cl_assert(rules_match(&t, &p, SEED) == &t.rules[1]);
+
+    /* invalid cookie */
+    len = build_tcp(frame, RULE_SYN | RULE_ACK, probe_cookie());
+    cl_assert_equal_i(rules_parse(frame, len, &p), 0);
+    cl_assert(rules_match(&t, &p, SEED) == &t.rules[2]);
+
+    p.sport = 443;
+    cl_assert(rules_match(&t, &p, SEED) == NULL);
+
+    p.proto = PROTO_UDP;
+    cl_assert(rules_match(&t, &p, SEED) == NULL);
+
+    /* truncated */
+    cl_assert_equal_i(rules_parse(frame, len - 1, &p), -1);
+
+    rules_free(&t);
+}
+
+void test_rules__icmp(void) {
+    struct rule r;
+    struct rule_pkt p;
+    struct rule_table t;
+
+    rules_init(&t);
+
+    r = any_rule;
+    r.proto = PROTO_ICMP;
+    r.icmp_type = ICMPOP_DEST_UNREACH;
+    r.icmp_code = 3;
+    cl_assert_equal_i(rules_add(&t, &r), 0);
+
+    r = any_rule;
+    r.proto = PROTO_ICMP;
+    cl_assert_equal_i(rules_add(&t, &r), 0);
+
+    /* ICMP messages have no ports */
+    r.sport = 53;
+    cl_assert_equal_i(rules_add(&t, &r), -1);
+
+    rules_compile(&t);
+
+    memset(&p, 0, sizeof(p));
+    p.proto = PROTO_ICMP;
+
+    p.icmp_type = ICMPOP_DEST_UNREACH;
+    p.icmp_code = 3;
+    cl_assert(rules_match(&t, &p, SEED) == &t.rules[0]);
+
+    p.icmp_code = 1;
+    cl_assert(rules_match(&t, &p, SEED) == &t.rules[1]);
+
+    p.icmp_type = ICMPOP_ECHOREPLY;
+    cl_assert(rules_match(&t, &p, SEED) == &t.rules[1]);
+
+    rules_free(&t);
+}
+
+void test_rules__format(void) {
+    char buf[64];
+    struct rule_pkt p;
+
+    memset(&p, 0, sizeof(p));
+    p.src   = htonl(0x0a000002);
+    p.sport = 80;
+    p.ttl   = 57;
+
+    cl_assert_equal_i(rules_format("{src}:{sport} ttl {ttl}", &p,
+                                   buf, sizeof(buf)), 18);
+    cl_assert_equal_s(buf, "10.0.0.2:80 ttl 57");
+
+    /* truncated */
+    cl_assert_equal_i(rules_format("port {sport}", &p, buf, 7), 6);
+    cl_assert_equal_s(buf, "port 8");
+}
+
+void test_rules__rst(void) {
+    uint8_t frame[64], buf[40];
+    uint32_t seq;
+    struct rule_pkt p;
+
+    size_t len = build_tcp(frame, RULE_SYN | RULE_ACK, 1000);
+    cl_assert_equal_i(rules_parse(frame, len, &p), 0);
+
+    cl_assert_equal_i(rules_build_rst(&p, buf, sizeof(buf)), 40);
+
+    /* addresses and ports are swapped */
+    cl_assert(!memcmp(buf + 12, frame + 14 + 16, 4));
+    cl_assert(!memcmp(buf + 16, frame + 14 + 12, 4));
+    cl_assert(!memcmp(buf + 20, frame + 36, 2));
+    cl_assert(!memcmp(buf + 22, frame + 34, 2));
+
+    memcpy(&seq, buf + 24, 4);
+    cl_assert_equal_i(ntohl(seq), 1000);
+    cl_assert_equal_i(buf[33], RULE_RST);
+}
+
+void test_rules__rst_reply(void) {
+    uint8_t frame[64], buf[40], pseudo[12 + 20];
+    struct rule_pkt p;
+    struct pkt *rst;
+
+    size_t len = build_tcp(frame, RULE_SYN | RULE_ACK, 1000);
+    cl_assert_equal_i(rules_parse(frame, len, &p), 0);
+
+    rst = rules_reply_rst(&p);
+
+    /* pkt_send() only sends raw frames as they are with PKT_FRAME */
+    cl_assert(rst->flags & PKT_FRAME);
+    cl_assert(!(rst->flags & PKT_FRAME_L2));
+
+    cl_assert_equal_i(pkt_pack_frame(buf, sizeof(buf), rst->p.raw.payload,
+                                     rst->p.raw.len, rst->flags), 40);
+
+    /* the IPv4 length and checksums are filled in */
+    cl_assert_equal_i(buf[2], 0);
+    cl_assert_equal_i(buf[3], 40);
+    cl_assert_equal_i(pkt_chksum(buf, 20, 0), 0);
+
+    memset(pseudo, 0, 12);
+    memcpy(pseudo, buf + 12, 8);
+    pseudo[9]  = PROTO_TCP;
+    pseudo[11] = 20;
+    memcpy(pseudo + 12, buf + 20, 20);
+
+    cl_assert(buf[36] || buf[37]);
+    cl_assert_equal_i(pkt_chksum(pseudo, sizeof(pseudo), 0), 0);
+
+    pkt_free(rst);
+}
@@ -0,0 +1,175 @@
+#include <time.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "clar/clar.h"
+
+#include "shuffle.h"
+#include "tiers.h"
+#include "scan_map.h"
+
+static void random_map(struct scan_map *m, bool shuffle) {
+    size_t port_end[TIERS_MAX];
+    size_t tier_cnt = 1 + rand() % TIERS_MAX;
+
+    for (size_t t = 0, end = 0; t < tier_cnt; t++) {
+        end += 1 + rand() % 8;
+        port_end[t] = end;
+    }
+
+    scan_map_init(m, 1 + rand() % 50, port_end, tier_cnt, 1 + rand() % 4,
+                  shuffle, rand());
+}
+
+static uint64_t probe_slot(const struct scan_map *m,
+                           const struct scan_probe *p) {
+    return (p->port * m->addr_cnt + p->addr) * m->rep_cnt + p->rep;
+}
+
+void test_scan_map__roundtrip(void) {
+    srand(time(NULL));
+
+    for (unsigned n = 0; n < 200; n++) {
+        struct scan_map m;
+        struct scan_probe p;
+
+        random_map(&m, n & 1);
+
+        uint64_t shard_cnt = 1 + rand() % 5;
+        uint64_t total = m.tier_end[m.tier_cnt - 1];
+        uint64_t seen = 0;
+
+        uint8_t *hits = calloc(total, 1);
+
+        for (uint64_t s = 0; s < shard_cnt; s++) {
+            scan_map_shard(&m, s, shard_cnt);
+
+            for (uint64_t i = 0; i < scan_map_count(&m); i++) {
+                uint64_t j;
+
+                scan_map_pick(&m, i, &p);
+
+                cl_assert(p.addr < m.addr_cnt);
+                cl_assert(p.port < m.port_end[m.tier_cnt - 1]);
+                cl_assert(p.rep < m.rep_cnt);
+
+                cl_assert_equal_i(scan_map_index(&m, &p, &j), 0);
+                cl_assert_equal_i(j, i);
+
+                hits[probe_slot(&m, &p)]++;
+                seen++;
+            }
+        }
+
+        /* the shards partition the scan */
+        cl_assert_equal_i(seen, total);
+
+        for (uint64_t k = 0; k < total; k++)
+            cl_assert_equal_i(hits[k], 1);
+
+        free(hits);
+    }
+}
+
+void test_scan_map__other_shard(void) {
+    struct scan_map m;
+    struct scan_probe p;
+    uint64_t j;
+    size_t ports = 10;
+
+    scan_map_init(&m, 20, &ports, 1, 2, true, 42);
+
+    scan_map_shard(&m, 1, 3);
+    scan_map_pick(&m, 5, &p);
+
+    scan_map_shard(&m, 0, 3);
+    cl_assert_equal_i(scan_map_index(&m, &p, &j), -1);
+
+    scan_map_shard(&m, 2, 3);
+    cl_assert_equal_i(scan_map_index(&m, &p, &j), -1);
+
+    /* out of range */
+    scan_map_shard(&m, 0, 1);
+
+    p.addr = 20;
+    cl_assert_equal_i(scan_map_index(&m, &p, &j), -1);
+
+    p.addr = 0;
+    p.port = 10;
+    cl_assert_equal_i(scan_map_index(&m, &p, &j), -1);
+
+    p.port = 0;
+    p.rep  = 2;
+    cl_assert_equal_i(scan_map_index(&m, &p, &j), -1);
+}
+
+void test_scan_map__tiers(void) {
+    struct scan_map m;
+    struct scan_probe p;
+    size_t port_end[] = { 2, 5, 9 };
+    size_t tier = 0;
+
+    scan_map_init(&m, 7, port_end, 3, 3, true, 42);
+
+    /* the tiers are probed one after the other */
+    for (uint64_t i = 0; i < scan_map_count(&m); i++) {
+        scan_map_pick(&m, i, &p);
+
+        while (p.port >= port_end[tier])
+            tier++;
+
+        cl_assert(i >= (tier ? 7 * port_end[tier - 1] * 3 : 0));
+        cl_assert(i < 7 * port_end[tier] * 3);
+    }
+
+    cl_assert_equal_i(tier, 2);
+}
+
+void test_scan_map__linear(void) {
+    struct scan_map m;
+    struct scan_probe p;
+    size_t ports = 2;
+
+    scan_map_init(&m, 3, &ports, 1, 2, false, 0);
+
+    /* repetitions first, then addresses, then ports */
+    scan_map_pick(&m, 0, &p);
+    cl_assert_equal_i(p.rep, 0);
+    cl_assert_equal_i(p.addr, 0);
+    cl_assert_equal_i(p.port, 0);
+
+    scan_map_pick(&m, 1, &p);
+    cl_assert_equal_i(p.rep, 1);
+    cl_assert_equal_i(p.addr, 0);
+
+    scan_map_pick(&m, 2, &p);
+    cl_assert_equal_i(p.rep, 0);
+    cl_assert_equal_i(p.addr, 1);
+
+    scan_map_pick(&m, 11, &p);
+    cl_assert_equal_i(p.rep, 1);
+    cl_assert_equal_i(p.addr, 2);
+    cl_assert_equal_i(p.port, 1);
+}
+
+void test_scan_map__empty(void) {
+    struct scan_map m;
+    struct scan_probe p = { 0, 0, 0 };
+    uint64_t j;
+    size_t ports = 4;
+
+    /* no targets, as with --idle or without --prior */
+    scan_map_init(&m, 0, &ports, 1, 1, true, 42);
+
+    cl_assert_equal_i(scan_map_count(&m), 0);
+    cl_assert_equal_i(scan_map_index(&m, &p, &j), -1);
+
+    scan_map_shard(&m, 1, 2);
+    cl_assert_equal_i(scan_map_count(&m), 0);
+
+    ports = 0;
+    scan_map_init(&m, 5, &ports, 1, 1, true, 42);
+
+    cl_assert_equal_i(scan_map_count(&m), 0);
+}
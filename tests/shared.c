@@ -0,0 +1,122 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#include "clar/clar.h"
+
+#include "shared.h"
+
+void test_shared__simple(void) {
+    double num;
+    struct shared_obj key, val;
+
+    struct shared *s = shared_new(1024);
+
+    shared_obj_int(&key, 42);
+    cl_assert_equal_i(shared_get(s, &key, &val), -1);
+    cl_assert_equal_i(val.type, SHARED_NIL);
+
+    shared_obj_num(&val, 1.5);
+    cl_assert_equal_i(shared_set(s, &key, &val), 0);
+
+    memset(&val, 0, sizeof(val));
+    cl_assert_equal_i(shared_get(s, &key, &val), 0);
+    cl_assert_equal_i(val.type, SHARED_NUMBER);
+
+    memcpy(&num, val.data, sizeof(num));
+    cl_assert(num == 1.5);
+
+    cl_assert_equal_i(shared_obj_str(&key, "a string key", 12), 0);
+    cl_assert_equal_i(shared_obj_str(&val, "value", 5), 0);
+    cl_assert_equal_i(shared_set(s, &key, &val), 0);
+
+    memset(&val, 0, sizeof(val));
+    cl_assert_equal_i(shared_get(s, &key, &val), 0);
+    cl_assert_equal_i(val.type, SHARED_STRING);
+    cl_assert_equal_i(val.len, 5);
+    cl_assert(!memcmp(val.data, "value", 5));
+
+    cl_assert_equal_i(shared_obj_str(&key, "a way too long string key", 25), -1);
+
+    shared_free(s);
+}
+
+void test_shared__skip(void) {
+    struct shared *s = shared_new(1024);
+
+    cl_assert(!shared_skip(s, 0x0a000001));
+    cl_assert_equal_i(shared_set_skip(s, 0x0a000001), 0);
+    cl_assert(shared_skip(s, 0x0a000001));
+    cl_assert(!shared_skip(s, 0x0a000002));
+
+    shared_free(s);
+}
+
+void test_shared__full(void) {
+    int64_t i;
+    struct shared_obj key, val;
+
+    struct shared *s = shared_new(1);
+
+    shared_obj_num(&val, 1);
+
+    for (i = 0; i < 10000; i++) {
+        shared_obj_int(&key, i);
+
+        if (shared_set(s, &key, &val) < 0)
+            break;
+    }
+
+    /* one slot per shard, the table must fill up at some point */
+    cl_assert(i < 10000);
+
+    for (int64_t j = 0; j < i; j++) {
+        shared_obj_int(&key, j);
+        cl_assert_equal_i(shared_get(s, &key, &val), 0);
+    }
+
+    shared_free(s);
+}
+
+static void *add_cb(void *p) {
+    struct shared *s = p;
+    struct shared_obj key;
+
+    for (int64_t i = 0; i < 10000; i++) {
+        shared_obj_int(&key, i % 16);
+        shared_add(s, &key, 1, NULL);
+    }
+
+    return NULL;
+}
+
+void test_shared__concurrent(void) {
+    double total = 0;
+    pthread_t threads[4];
+
+    struct shared_obj key, val;
+    struct shared *s = shared_new(1024);
+
+    for (int i = 0; i < 4; i++)
+        pthread_create(&threads[i], NULL, add_cb, s);
+
+    for (int i = 0; i < 4; i++)
+        pthread_join(threads[i], NULL);
+
+    for (int64_t i = 0; i < 16; i++) {
+        double num;
+
+        shared_obj_int(&key, i);
+        cl_assert_equal_i(shared_get(s, &key, &val), 0);
+
+        memcpy(&num, val.data, sizeof(num));
+        total += num;
+    }
+
+    cl_assert(total == 40000);
+
+    shared_free(s);
+}
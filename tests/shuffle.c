@@ -43,3 +43,27 @@ void test_shuffle__verify(void) {
         free(results);
     }
 }
+
+void test_shuffle__batch(void) {
+    struct shuffle r;
+    uint64_t in[997], out[997];
+
+    shuffle_init(&r, 997, time(NULL));
+
+    for (unsigned j = 0; j < 997; j++)
+        in[j] = shuffle(&r, j);
+
+    unshuffle_batch(&r, in, out, 997);
+
+    for (unsigned j = 0; j < 997; j++)
+        cl_assert_equal_i(out[j], j);
+}
+
+void test_shuffle__empty(void) {
+    struct shuffle r;
+
+    /* e.g. --idle, where there's nothing to probe */
+    shuffle_init(&r, 0, 500);
+
+    cl_assert_equal_i(r.range, 0);
+}
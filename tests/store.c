@@ -0,0 +1,165 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+
+#include "clar/clar.h"
+
+#include "store.h"
+
+static char path_a[] = "/tmp/pktizr_store_a_XXXXXX";
+static char path_b[] = "/tmp/pktizr_store_b_XXXXXX";
+static char path_c[] = "/tmp/pktizr_store_c_XXXXXX";
+
+void test_store__initialize(void) {
+    close(mkstemp(path_a));
+    close(mkstemp(path_b));
+    close(mkstemp(path_c));
+}
+
+void test_store__cleanup(void) {
+    unlink(path_a);
+    unlink(path_b);
+    unlink(path_c);
+
+    strcpy(path_a, "/tmp/pktizr_store_a_XXXXXX");
+    strcpy(path_b, "/tmp/pktizr_store_b_XXXXXX");
+    strcpy(path_c, "/tmp/pktizr_store_c_XXXXXX");
+}
+
+void test_store__simple(void) {
+    uint16_t ports[16];
+    const struct store_host *h;
+
+    struct store *s = store_new();
+
+    store_add(s, 0x0a000002, 443);
+    store_add(s, 0x0a000001, 80);
+    store_add(s, 0x0a000002, 22);
+    store_add(s, 0x0a000002, 443);
+
+    cl_assert_equal_i(s->cnt, 2);
+    cl_assert_equal_i(store_save(s, path_a), 0);
+    store_free(s);
+
+    struct store_file *f = store_open(path_a);
+
+    cl_assert_equal_i(f->hdr->host_count, 2);
+    cl_assert_equal_i(f->hdr->port_count, 3);
+
+    /* hosts are sorted by address */
+    cl_assert_equal_i(f->hosts[0].addr, 0x0a000001);
+
+    h = store_find(f, 0x0a000002);
+    cl_assert(h != NULL);
+    cl_assert(store_has(f, h, 22));
+    cl_assert(store_has(f, h, 443));
+    cl_assert(!store_has(f, h, 80));
+
+    cl_assert_equal_i(store_ports(f, h, ports), 2);
+    cl_assert_equal_i(ports[0], 22);
+    cl_assert_equal_i(ports[1], 443);
+
+    cl_assert(store_find(f, 0x0a000003) == NULL);
+    cl_assert(store_find(f, 0) == NULL);
+
+    store_close(f);
+}
+
+void test_store__bitmap(void) {
+    const struct store_host *h;
+
+    struct store *s = store_new();
+
+    /* enough ports to switch to a bitmap */
+    for (uint32_t p = 0; p < 65536; p += 3)
+        store_add(s, 1, p);
+
+    for (uint32_t i = 0; i < 10000; i++)
+        store_add(s, 1000 + i, i % 7);
+
+    cl_assert(s->sets[0].bits != NULL);
+    cl_assert_equal_i(s->sets[0].card, 21846);
+
+    cl_assert_equal_i(store_save(s, path_a), 0);
+    store_free(s);
+
+    struct store_file *f = store_open(path_a);
+
+    cl_assert_equal_i(f->hdr->host_count, 10001);
+
+    h = store_find(f, 1);
+    cl_assert(h != NULL);
+    cl_assert_equal_i(h->card, 21846);
+
+    for (uint32_t p = 0; p < 65536; p++)
+        cl_assert_equal_i(store_has(f, h, p), (p % 3) == 0);
+
+    uint16_t *ports = malloc(65536 * sizeof(*ports));
+    cl_assert_equal_i(store_ports(f, h, ports), 21846);
+    cl_assert_equal_i(ports[21845], 65535);
+    free(ports);
+
+    h = store_find(f, 1000 + 9999);
+    cl_assert(h != NULL);
+    cl_assert(store_has(f, h, 9999 % 7));
+
+    store_close(f);
+}
+
+void test_store__setops(void) {
+    struct store *s;
+    struct store_file *a, *b, *c;
+
+    s = store_new();
+    store_add(s, 1, 22);
+    store_add(s, 1, 80);
+    store_add(s, 2, 22);
+    cl_assert_equal_i(store_save(s, path_a), 0);
+    store_free(s);
+
+    s = store_new();
+    store_add(s, 1, 80);
+    store_add(s, 1, 443);
+    store_add(s, 3, 22);
+    cl_assert_equal_i(store_save(s, path_b), 0);
+    store_free(s);
+
+    a = store_open(path_a);
+    b = store_open(path_b);
+
+    s = store_union(a, b);
+    cl_assert_equal_i(store_save(s, path_c), 0);
+    store_free(s);
+
+    c = store_open(path_c);
+    cl_assert_equal_i(c->hdr->host_count, 3);
+    cl_assert_equal_i(c->hdr->port_count, 5);
+    store_close(c);
+
+    s = store_intersect(a, b);
+    cl_assert_equal_i(store_save(s, path_c), 0);
+    store_free(s);
+
+    c = store_open(path_c);
+    cl_assert_equal_i(c->hdr->host_count, 1);
+    cl_assert_equal_i(c->hdr->port_count, 1);
+    cl_assert(store_has(c, store_find(c, 1), 80));
+    store_close(c);
+
+    s = store_diff(a, b);
+    cl_assert_equal_i(store_save(s, path_c), 0);
+    store_free(s);
+
+    c = store_open(path_c);
+    cl_assert_equal_i(c->hdr->host_count, 2);
+    cl_assert_equal_i(c->hdr->port_count, 2);
+    cl_assert(store_has(c, store_find(c, 1), 22));
+    cl_assert(store_has(c, store_find(c, 2), 22));
+    store_close(c);
+
+    store_close(a);
+    store_close(b);
+}
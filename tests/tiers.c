@@ -0,0 +1,54 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "clar/clar.h"
+
+#include "tiers.h"
+
+void test_tiers__build(void) {
+    uint16_t ports[1024];
+    struct port_tiers t;
+
+    for (unsigned i = 0; i < 1024; i++)
+        ports[i] = i + 1;
+
+    tiers_build(&t, ports, 1024, tiers_default_rank, tiers_default_rank_cnt);
+
+    cl_assert_equal_i(t.cnt, 1024);
+    cl_assert_equal_i(t.tier_cnt, 3);
+
+    /* 3389 is the only one of the top 10 ports above 1024 */
+    cl_assert_equal_i(t.tier_end[0], 9);
+    cl_assert(t.tier_end[1] < 100);
+    cl_assert_equal_i(t.tier_end[2], 1024);
+
+    /* tiers keep the original port order */
+    cl_assert_equal_i(t.ports[0], 21);
+    cl_assert_equal_i(t.ports[4], 80);
+    cl_assert_equal_i(t.ports[8], 445);
+    cl_assert_equal_i(t.ports[9], 7);
+    cl_assert_equal_i(t.ports[t.tier_end[1]], 1);
+
+    tiers_free(&t);
+}
+
+void test_tiers__subset(void) {
+    uint16_t ports[] = { 8080, 9000, 443, 22 };
+    uint16_t rank[]  = { 22, 22, 8080 };
+    struct port_tiers t;
+
+    tiers_build(&t, ports, 4, rank, 3);
+
+    /* duplicated ports only count once in the ranking */
+    cl_assert_equal_i(t.tier_cnt, 2);
+    cl_assert_equal_i(t.tier_end[0], 2);
+    cl_assert_equal_i(t.tier_end[1], 4);
+
+    cl_assert_equal_i(t.ports[0], 8080);
+    cl_assert_equal_i(t.ports[1], 22);
+    cl_assert_equal_i(t.ports[2], 9000);
+    cl_assert_equal_i(t.ports[3], 443);
+
+    tiers_free(&t);
+}